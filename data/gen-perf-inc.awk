@@ -6,10 +6,27 @@ BEGIN {
     print("//")
     print("")
     N = 0
+    M = 0
 }
 
 /#define/ { next }
 
+/PERF_HISTOGRAM_DECLARE/ {
+    a = index($0, "(");
+    b = index($0, ")");
+    names = substr($0, a + 1, b - a - 1)
+    gsub(" ", "", names)
+    split(names, temp, ",")
+
+    HGROUP[M] = temp[1];
+    HNAME[M]  = temp[2];
+    t = length(temp[1]) + length(temp[2])
+    if (HL < t) HL = t
+    t = length(temp[1])
+    if (HG < t) HG = t;
+    M++
+}
+
 /PERF_DECLARE/ {
     a = index($0, "(");
     b = index($0, ")");
@@ -44,4 +61,23 @@ END {
         printf(format, "\"" GROUP[i] "\"", "\"" name "\"", name)
     }
     print("};")
+    print("")
+
+    format = sprintf("Histogram %%%ds;\n", -(HL+2))
+    for(i = 0; i < M; i++) {
+        # Histogram a1;
+        name = HGROUP[i] "::" HNAME[i]
+        printf(format, name)
+    }
+    print("")
+
+    format = sprintf("    {%%%ds, %%%ds, %%s},\n", -(HG+2), -(HL+4))
+    print("std::vector<HistogramEntry> allHistogram {");
+    for(i = 0; i < M; i++) {
+        # {"a1", a1},
+        name = HGROUP[i] "::" HNAME[i]
+
+        printf(format, "\"" HGROUP[i] "\"", "\"" name "\"", name)
+    }
+    print("};")
 }
\ No newline at end of file
@@ -37,6 +37,7 @@
 #include "../util/Debug.h"
 #include "../util/Util.h"
 #include <chrono>
+#include <vector>
 static const Logger logger(__FILE__);
 
 #include "../mesa/Pilot.h"
@@ -45,6 +46,7 @@ static const Logger logger(__FILE__);
 #include "../mesa/processor.h"
 
 #include "../util/DiskFile.h"
+#include "../util/tsc_clock.h"
 
 #include "AgentDisk.h"
 
@@ -58,108 +60,276 @@ static CARD32 getBlock(DiskDCBType* dcb, DiskIOCBType* iocb) {
 	return (H * iocb->diskAddress.cylinder + iocb->diskAddress.head) * S + iocb->diskAddress.sector;
 }
 
-void AgentDisk::IOThread::process(const Item& item) {
-	std::chrono::steady_clock::time_point time_start;
-	if (PERF_ENABLE) time_start = std::chrono::steady_clock::now();
+void AgentDisk::IOThread::process(Transfer* const& transfer) {
+	agent->waitDependency(transfer);
 
-	auto fcb = item.fcb;
-	auto iocb = item.iocb;
-	auto diskFile = item.diskFile;
-	auto dcb = fcb->dcbs + iocb->deviceIndex;
-	auto interruptSelector = fcb->interruptSelector;
+	if (PERF_ENABLE) transfer->timeService = tsc_clock::now();
 
-	// CARD32 C = iocb->diskAddress.cylinder;
-	// CARD32 H = iocb->diskAddress.head;
-	// CARD32 S = iocb->diskAddress.sector;
-	// CARD32 block = (C * dcb->numberOfHeads + H) * dcb->sectorsPerTrack + S;
+	auto diskFile = transfer->diskFile;
+	CARD32 block = transfer->block;
+	int result = 0;
 
-	CARD32 block = getBlock(dcb, iocb);
-
-	//"AGENT %s %d", name, fcb->command
-	Command command = (Command)iocb->command;
-	switch(command) {
-	case Command::read: {
-		if (DEBUG_SHOW_AGENT_DISK) logger.debug("IOThread::process %4d READ   %08X + %3d dataPtr = %08X  nextIOCB = %08X", iocb->deviceIndex, block, iocb->pageCount, iocb->dataPtr, iocb->nextIOCB);
-
-		CARD32 dataPtr = iocb->dataPtr;
-		for(int i = 0; i < iocb->pageCount; i++) {
-			CARD16 *buffer = memory::peek(dataPtr);
+	switch(transfer->command) {
+	case Command::read:
+		if (DEBUG_SHOW_AGENT_DISK) logger.debug("IOThread::process READ   %08X + %3d", block, transfer->buffers.size());
+		for(auto buffer: transfer->buffers) {
 			diskFile->readPage(block++, buffer);
-			dataPtr += PageSize;
 		}
-		//
-		iocb->pageCount = 0;
-		iocb->status = (CARD16)Status::goodCompletion;
-		//
-		PERF_COUNT(disk, read)
-	}
 		break;
-	case Command::write: {
-		if (DEBUG_SHOW_AGENT_DISK) logger.debug("IOThread::process %4d WRITE  %08X + %3d dataPtr = %08X  nextIOCB = %08X", iocb->deviceIndex, block, iocb->pageCount, iocb->dataPtr, iocb->nextIOCB);
+	case Command::write:
+		if (DEBUG_SHOW_AGENT_DISK) logger.debug("IOThread::process WRITE  %08X + %3d", block, transfer->buffers.size());
+		// all-zero block becomes hole
+		diskFile->writePages(block, transfer->buffers);
+		break;
+	case Command::verify:
+		if (DEBUG_SHOW_AGENT_DISK) logger.debug("IOThread::process VERIFY %08X + %3d", block, transfer->buffers.size());
+		for(auto buffer: transfer->buffers) {
+			if (diskFile->verifyPage(block++, buffer)) result = 1;
+		}
+		break;
+	default:
+		logger.fatal("command = %d", transfer->command);
+		ERROR();
+		break;
+	}
 
-		CARD32 dataPtr = iocb->dataPtr;
-		for(int i = 0; i < iocb->pageCount; i++) {
-			CARD16 *buffer = memory::peek(dataPtr);
-			diskFile->writePage(block++, buffer);
-			dataPtr += PageSize;
+	if (PERF_ENABLE) {
+		auto time_stop = tsc_clock::now();
+		auto duration = std::chrono::duration_cast<std::chrono::microseconds>(time_stop - transfer->timeService).count();
+		PERF_ADD(disk, process_time, duration)
+	}
+
+	agent->finish(transfer, result);
+}
+
+
+void AgentDisk::addDiskFile(DiskFile* diskFile) {
+	if (MAX_DEVICE_COUNT <= deviceList.size()) {
+		logger.fatal("Too many disk  %d", deviceList.size() + 1);
+		ERROR();
+	}
+	auto& device = deviceList.emplace_back((uint32_t)deviceList.size(), diskFile);
+	for(uint32_t i = 0; i < workerCount; i++) device.ioThreads.emplace_back(this);
+}
+
+void AgentDisk::setWorkerCount(uint32_t newValue) {
+	if (newValue == 0) newValue = DEFAULT_WORKER_COUNT;
+	workerCount = newValue;
+	for(auto& device: deviceList) {
+		device.ioThreads.clear();
+		for(uint32_t i = 0; i < workerCount; i++) device.ioThreads.emplace_back(this);
+	}
+}
+
+bool AgentDisk::isDone(DiskDevice* device, uint64_t sequence) {
+	if (sequence < device->nextComplete) return true;
+	auto i = device->transferMap.find(sequence);
+	return i == device->transferMap.end() || i->second->done;
+}
+
+void AgentDisk::waitDependency(Transfer* transfer) {
+	if (transfer->dependency.empty()) return;
+
+	PERF_COUNT(disk, dependency_wait)
+	auto device = transfer->device;
+	std::unique_lock<std::mutex> lock(device->transferMutex);
+	for(auto sequence: transfer->dependency) {
+		while(!isDone(device, sequence)) {
+			device->transferCV.wait_for(lock, Util::ONE_SECOND);
 		}
-		//
-		iocb->pageCount = 0;
-		iocb->status = (CARD16)Status::goodCompletion;
-		//
-		PERF_COUNT(disk, write)
 	}
-		break;
-	case Command::verify: {
-		if (DEBUG_SHOW_AGENT_DISK) logger.debug("IOThread::process %4d VERIFY %08X + %3d dataPtr = %08X  nextIOCB = %08X", iocb->deviceIndex, block, iocb->pageCount, iocb->dataPtr, iocb->nextIOCB);
+}
 
-		int ret = 0;
-		CARD32 dataPtr = iocb->dataPtr;
-		for(int i = 0; i < iocb->pageCount; i++) {
-			CARD16 *buffer = memory::peek(dataPtr);
-			ret |= diskFile->verifyPage(block++, buffer);
-			dataPtr += PageSize;
+void AgentDisk::dispatch(Transfer* transfer, std::vector<DiskFile::Request>& requestList) {
+	auto device = transfer->device;
+	if (transfer->command == Command::read) {
+		transfer->diskFile->readAhead(transfer->block, transfer->buffers.size());
+	}
+	{
+		std::unique_lock<std::mutex> lock(device->transferMutex);
+		transfer->sequence = device->nextSequence++;
+		transfer->done     = false;
+		transfer->discard  = false;
+		transfer->result   = 0;
+		// transfer that overlaps earlier write (or earlier transfer overlaps this write) must wait
+		for(auto [sequence, that]: device->transferMap) {
+			if (that->done) continue;
+			if (transfer->command != Command::write && that->command != Command::write) continue;
+			if (transfer->overlap(*that)) {
+				transfer->dependency.push_back(sequence);
+				transfer->worker = that->worker;
+			}
 		}
-		//
-		iocb->pageCount = 0;
-		iocb->status = ret ? (CARD16)Status::dataVerifyError : (CARD16)Status::goodCompletion;
-		//
-		PERF_COUNT(disk, verify)
+		if (transfer->dependency.empty()) {
+			transfer->worker = device->nextWorker++ % device->ioThreads.size();
+		}
+		device->transferMap[transfer->sequence] = transfer;
+	}
+	device->pendingCount++;
+	pendingCount++;
+	PERF_RECORD(disk, transfer_page, transfer->buffers.size())
+
+	if (transfer->diskFile->isAsync()) {
+		DiskFile::Request request;
+		request.operation = (transfer->command == Command::read) ? DiskFile::Operation::read :
+			((transfer->command == Command::write) ? DiskFile::Operation::write : DiskFile::Operation::verify);
+		request.pageNo    = transfer->block;
+		request.buffers   = transfer->buffers;
+		request.context   = transfer;
+		// let io_uring wait previous requests
+		request.barrier   = !transfer->dependency.empty();
+		requestList.push_back(request);
+	} else {
+		device->ioThreads[transfer->worker].push(transfer);
 	}
+}
+
+static void recordLatency(AgentDisk::Transfer* transfer) {
+	auto timeStop = tsc_clock::now();
+	uint64_t wait    = std::chrono::duration_cast<std::chrono::microseconds>(transfer->timeService - transfer->timeStart).count();
+	uint64_t service = std::chrono::duration_cast<std::chrono::microseconds>(timeStop - transfer->timeService).count();
+
+	switch(transfer->command) {
+	case PilotDiskFace::Command::read:
+		PERF_RECORD(disk, read_wait, wait)
+		PERF_RECORD(disk, read_service, service)
+		break;
+	case PilotDiskFace::Command::write:
+		PERF_RECORD(disk, write_wait, wait)
+		PERF_RECORD(disk, write_service, service)
+		break;
+	case PilotDiskFace::Command::verify:
+		PERF_RECORD(disk, verify_wait, wait)
+		PERF_RECORD(disk, verify_service, service)
 		break;
 	default:
-		logger.fatal("command = %d", command);
-		ERROR();
 		break;
 	}
+}
 
-	PERF_COUNT(disk, process)
-	processor::notifyInterrupt(interruptSelector);
+bool AgentDisk::complete(DiskDevice* device) {
+	bool completed = false;
+	for(;;) {
+		auto i = device->transferMap.find(device->nextComplete);
+		if (i == device->transferMap.end() || !i->second->done) break;
+		auto t = i->second;
+		device->transferMap.erase(i);
+		device->nextComplete++;
+		device->pendingCount--;
+		pendingCount--;
+
+		// read writes guest memory through pointer of peek
+		if (t->command == Command::read) {
+			for(auto iocb: t->iocbList) memory::markDirty(iocb->dataPtr, iocb->pageCount * PageSize);
+		}
+		if (t->discard) {
+			delete t;
+			continue;
+		}
 
-	if (PERF_ENABLE) {
-		auto time_stop = std::chrono::steady_clock::now();
-		auto duration = std::chrono::duration_cast<std::chrono::microseconds>(time_stop - time_start).count();
-		PERF_ADD(disk, process_time, duration)
+		CARD16 status = (t->result == 0) ? (CARD16)Status::goodCompletion :
+			((t->result == 1) ? (CARD16)Status::dataVerifyError : (CARD16)Status::otherError);
+		for(auto iocb: t->iocbList) {
+			iocb->pageCount = 0;
+			iocb->status    = status;
+
+			switch(t->command) {
+			case Command::read:
+				PERF_COUNT(disk, read)
+				break;
+			case Command::write:
+				PERF_COUNT(disk, write)
+				break;
+			case Command::verify:
+				PERF_COUNT(disk, verify)
+				break;
+			default:
+				break;
+			}
+			PERF_COUNT(disk, process)
+		}
+		if (PERF_ENABLE) {
+			auto duration = std::chrono::duration_cast<std::chrono::microseconds>(tsc_clock::now() - t->timeStart).count();
+			PERF_ADD(disk, latency_time, duration * t->iocbList.size())
+		}
+		delete t;
+		completed = true;
+	}
+	device->transferCV.notify_all();
+	return completed;
+}
+
+void AgentDisk::finish(Transfer* transfer, int result) {
+	if (result < 0) PERF_COUNT(disk, io_error)
+	if (PERF_ENABLE) recordLatency(transfer);
+
+	auto device = transfer->device;
+	bool completed;
+	bool idle;
+	{
+		std::unique_lock<std::mutex> lock(device->transferMutex);
+		transfer->result = result;
+		transfer->done   = true;
+		completed = complete(device);
+		idle      = device->pendingCount == 0;
+	}
+
+	// notify outside of transferMutex
+	if (completed) {
+		processor::notifyInterrupt(fcb->interruptSelector);
+		if (idle) device->diskFile->notifyIdle();
+	}
+}
+
+void AgentDisk::drain() {
+	for(auto& device: deviceList) {
+		// transfer not yet taken by IOThread is never processed
+		std::vector<Transfer*> queuedList;
+		for(auto& ioThread: device.ioThreads) {
+			ioThread.erase_if([&queuedList](Transfer* const& transfer) {
+				queuedList.push_back(transfer);
+				return true;
+			});
+		}
+
+		std::unique_lock<std::mutex> lock(device.transferMutex);
+		if (device.transferMap.empty()) continue;
+		logger.warn("AGENT %s %d discard %d transfer", name, device.deviceIndex, device.transferMap.size());
+		// transfer in progress is processed but IOCBs are not updated
+		for(auto [sequence, transfer]: device.transferMap) transfer->discard = true;
+		for(auto transfer: queuedList) transfer->done = true;
+		complete(&device);
+		// wait transfer in progress
+		while(!device.transferMap.empty()) {
+			device.transferCV.wait_for(lock, Util::ONE_SECOND);
+		}
 	}
 }
 
 
 void AgentDisk::Initialize() {
 	if (fcbAddress == 0) ERROR();
-	if (diskFile == 0) ERROR();
+	if (deviceList.empty()) ERROR();
 
 	fcb = (DiskFCBType*)memory::peek(fcbAddress);
 	fcb->nextIOCB = 0;
 	fcb->interruptSelector = 0;
 	fcb->stopAgent = 0;
 	fcb->agentStopped = 1;
-	fcb->numberOfDCBs = 1;
+	fcb->numberOfDCBs = (CARD16)deviceList.size();
 
-	if (fcb->numberOfDCBs != 1) ERROR(); // support only one disk
+	for(CARD32 deviceIndex = 0; deviceIndex < deviceList.size(); deviceIndex++) {
+		initializeDevice(deviceIndex);
+	}
+}
+
+void AgentDisk::initializeDevice(CARD32 deviceIndex) {
+	auto& device   = deviceList[deviceIndex];
+	auto  diskFile = device.diskFile;
 
 	// initialize dcb using diskSize
 	auto diskByteSize = diskFile->getByteSize();
-	auto dcb = fcb->dcbs + 0; // dcb points first entry of dcbs
+	auto dcb = fcb->dcbs + deviceIndex;
 	dcb->deviceType         = Device::T_anyPilotDisk;
 	dcb->numberOfHeads      = DISK_NUMBER_OF_HEADS;
 	dcb->sectorsPerTrack    = DISK_SECTORS_PER_TRACK;
@@ -174,7 +344,13 @@ void AgentDisk::Initialize() {
 	// sanity check
 	if (diskByteSize != (CARD32)(dcb->numberOfHeads * dcb->sectorsPerTrack * dcb->numberOfCylinders * PAGE_SIZE_IN_BYTE)) ERROR();
 
-	logger.info("AGENT %s  CHS = %5d %2d %2d  %s", name, dcb->numberOfCylinders, dcb->numberOfHeads, dcb->sectorsPerTrack, diskFile->getPath());
+	logger.info("AGENT %s %d  CHS = %5d %2d %2d  %s", name, deviceIndex, dcb->numberOfCylinders, dcb->numberOfHeads, dcb->sectorsPerTrack, diskFile->getPath());
+
+	if (diskFile->isAsync()) {
+		diskFile->setCompletion([this](void* context, int result) {
+			finish((Transfer*)context, result);
+		});
+	}
 }
 
 void AgentDisk::Call() {
@@ -189,7 +365,8 @@ void AgentDisk::Call() {
 	} else {
 		if (fcb->agentStopped) {
 			logger.info("AGENT %s start  %04X", name, fcb->interruptSelector);
-			ioThread.clear();
+			// transfer queued before restart must not complete into new IOCBs
+			if (isPending()) drain();
 		}
 		fcb->agentStopped = 0;
 	}
@@ -198,6 +375,13 @@ void AgentDisk::Call() {
 		if (DEBUG_SHOW_AGENT_DISK) logger.debug("AGENT %s fcb->nextIOCB == 0", name);
 		return; // Return if there is no IOCB
 	}
+
+	// merge contiguous IOCBs of same command and same device into one transfer
+	Transfer* transfer = 0;
+	auto timeStart = tsc_clock::now();
+	// asynchronous DiskFile receives whole IOCB chain at once. index is deviceIndex
+	std::vector<std::vector<DiskFile::Request>> requestList(deviceList.size());
+
 	CARD32 nextIOCB = fcb->nextIOCB;
 	DiskIOCBType *iocb = (DiskIOCBType *)Store(nextIOCB);
 	for(;;) {
@@ -220,13 +404,51 @@ void AgentDisk::Call() {
 			logger.fatal("AGENT %s command = %d", name, command);
 			ERROR();
 		}
-
-		Item item(fcb, iocb, diskFile);
-		ioThread.push(item);
+		if (DEBUG_SHOW_AGENT_DISK) logger.debug("AGENT %s %4d %d %3d dataPtr = %08X  nextIOCB = %08X", name, iocb->deviceIndex, command, iocb->pageCount, iocb->dataPtr, iocb->nextIOCB);
+		PERF_COUNT(disk, iocb)
+		PERF_RECORD(disk, iocb_page, iocb->pageCount)
+
+		CARD32 block  = getBlock(fcb->dcbs + iocb->deviceIndex, iocb);
+		auto   device = &deviceList[iocb->deviceIndex];
+		// don't merge verify to report dataVerifyError for each IOCB
+		bool merge = transfer != 0 && command != Command::verify && transfer->command == command &&
+			transfer->device == device && transfer->block + transfer->buffers.size() == block &&
+			transfer->buffers.size() + iocb->pageCount <= MAX_TRANSFER_PAGE;
+		if (merge) {
+			PERF_COUNT(disk, merge)
+		} else {
+			if (transfer) dispatch(transfer, requestList[transfer->device->deviceIndex]);
+			PERF_COUNT(disk, transfer)
+			transfer = new Transfer;
+			transfer->device    = device;
+			transfer->diskFile  = device->diskFile;
+			transfer->command   = command;
+			transfer->block     = block;
+			transfer->timeStart = timeStart;
+		}
+		transfer->iocbList.push_back(iocb);
+		CARD32 dataPtr = iocb->dataPtr;
+		for(int i = 0; i < iocb->pageCount; i++) {
+			transfer->buffers.push_back(memory::peek(dataPtr));
+			dataPtr += PageSize;
+		}
 
 		if (iocb->nextIOCB == 0) break;
 		// advance to next IOCB
 		nextIOCB = iocb->nextIOCB;
 		iocb = (DiskIOCBType *)Store(nextIOCB);
 	}
+	dispatch(transfer, requestList[transfer->device->deviceIndex]);
+
+	for(CARD32 deviceIndex = 0; deviceIndex < deviceList.size(); deviceIndex++) {
+		auto& list = requestList[deviceIndex];
+		if (list.empty()) continue;
+		PERF_ADD(disk, async_submit, list.size())
+		if (PERF_ENABLE) {
+			// queue wait of asynchronous request ends at submission
+			auto timeService = tsc_clock::now();
+			for(auto& request: list) ((Transfer*)request.context)->timeService = timeService;
+		}
+		deviceList[deviceIndex].diskFile->submit(list);
+	}
 }
@@ -35,6 +35,14 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+
 #include "../util/DiskFile.h"
 #include "../util/ThreadQueue.h"
 
@@ -46,47 +54,111 @@ class AgentDisk : public Agent {
 	using DiskFCBType  = DiskIOFaceGuam::DiskFCBType;
 	using DiskDCBType  = DiskIOFaceGuam::DiskDCBType;
 	using DiskIOCBType = DiskIOFaceGuam::DiskIOCBType;
+	using Command      = PilotDiskFace::Command;
 public:
-	class Item {
-	public:
-		DiskFCBType*  fcb;
-		DiskIOCBType* iocb;
-		DiskFile*     diskFile;
-
-		Item(DiskFCBType* fcb_, DiskIOCBType* iocb_, DiskFile* diskFile_) :
-			fcb(fcb_), iocb(iocb_), diskFile(diskFile_) {}
-		Item(const Item& that) :
-			fcb(that.fcb), iocb(that.iocb), diskFile(that.diskFile) {}
+	struct DiskDevice;
+
+	// Transfer is contiguous IOCBs of same command and same device in IOCB chain
+	struct Transfer {
+		DiskDevice*                device;
+		DiskFile*                  diskFile;
+		Command                    command;
+		CARD32                     block;      // first block of transfer
+		std::vector<DiskIOCBType*> iocbList;
+		std::vector<CARD16*>       buffers;    // buffer of each page
+		uint64_t                   sequence;   // IOCBs are completed in order of sequence
+		std::vector<uint64_t>      dependency; // sequence of earlier transfer that overlaps this transfer
+		uint32_t                   worker;     // index of device->ioThreads
+		int                        result;     // 0 for success, 1 for verify error, negative for io error
+		bool                       done;
+		bool                       discard;    // transfer of previous run of agent. IOCBs are not updated
+		std::chrono::steady_clock::time_point timeStart;   // time of AgentDisk::Call
+		std::chrono::steady_clock::time_point timeService; // time of start of io
+
+		bool overlap(const Transfer& that) const {
+			return block < that.block + that.buffers.size() && that.block < block + buffers.size();
+		}
 	};
 
-	class IOThread : public thread_queue::ThreadQueueProcessor<Item> { 
+	class IOThread : public thread_queue::ThreadQueueProcessor<Transfer*> {
+		AgentDisk* agent;
 	public:
-		IOThread() : thread_queue::ThreadQueueProcessor<Item>("IOThread") {}
-		void process(const Item& data);
+		IOThread(AgentDisk* agent_) : thread_queue::ThreadQueueProcessor<Transfer*>("IOThread"), agent(agent_) {}
+		void process(Transfer* const& transfer);
+	};
+
+	// Each disk device has own DiskFile, IOThreads and completion order.
+	// Device of deviceIndex of IOCB is deviceList[deviceIndex].
+	struct DiskDevice {
+		uint32_t             deviceIndex;
+		DiskFile*            diskFile;
+		std::deque<IOThread> ioThreads;
+
+		// transfers not yet completed. guarded by transferMutex
+		std::mutex                    transferMutex;
+		std::condition_variable       transferCV;
+		std::map<uint64_t, Transfer*> transferMap;
+		uint64_t                      nextSequence = 0;
+		uint64_t                      nextComplete = 0;
+		uint32_t                      nextWorker   = 0;
+		std::atomic<int>              pendingCount = 0;
+
+		DiskDevice(uint32_t deviceIndex_, DiskFile* diskFile_) : deviceIndex(deviceIndex_), diskFile(diskFile_) {}
 	};
 
-	IOThread ioThread;
+	std::deque<DiskDevice> deviceList;
 
 	static const inline auto index_ = GuamInputOutput::AgentDeviceIndex::disk;
 	static const inline auto name_ = "Disk";
-	static const inline auto fcbSize_ = SIZE(DiskFCBType) + SIZE(DiskDCBType);
+	static const constexpr CARD32 MAX_DEVICE_COUNT = 8;
+	// reserve DCBs for MAX_DEVICE_COUNT devices
+	static const inline auto fcbSize_ = SIZE(DiskFCBType) + SIZE(DiskDCBType) * MAX_DEVICE_COUNT;
 	AgentDisk() : Agent(index_, name_, fcbSize_) {
-		fcb      = 0;
-		diskFile = 0;
+		fcb         = 0;
+		workerCount = DEFAULT_WORKER_COUNT;
 	}
 
 	void Initialize();
 	void Call();
 
-	void addDiskFile(DiskFile* diskFile_) {
-		diskFile = diskFile_;
+	// add disk device. deviceIndex is order of addDiskFile
+	void addDiskFile(DiskFile* diskFile);
+	void clearDiskFile() {
+		deviceList.clear();
+	}
+	// number of IOThread of each device. call before starting IOThread
+	void setWorkerCount(uint32_t newValue);
+
+	// true if any disk request is not completed
+	static bool isPending() {
+		return pendingCount != 0;
 	}
 
 private:
 	static const constexpr CARD32 PAGE_SIZE_IN_BYTE       = DiskFile::PAGE_SIZE_IN_BYTE;
 	static const constexpr CARD32 DISK_NUMBER_OF_HEADS    =  2;
 	static const constexpr CARD32 DISK_SECTORS_PER_TRACK  = 16;
+	static const constexpr uint32_t DEFAULT_WORKER_COUNT  =  2;
+	static const constexpr uint32_t MAX_TRANSFER_PAGE     = 256;
+
+	DiskFCBType* fcb = 0;
+	uint32_t     workerCount;
+
+	// number of pending transfer of all devices
+	static inline std::atomic<int> pendingCount;
 
-	DiskFCBType* fcb      = 0;
-	DiskFile*    diskFile = 0;
+	void initializeDevice(CARD32 deviceIndex);
+	// asynchronous request is appended to requestList
+	void dispatch(Transfer* transfer, std::vector<DiskFile::Request>& requestList);
+	// caller holds device->transferMutex
+	bool isDone(DiskDevice* device, uint64_t sequence);
+	// wait until all dependency of transfer is done
+	void waitDependency(Transfer* transfer);
+	// caller holds device->transferMutex. complete IOCBs of device in order of sequence
+	// return true if any IOCB is completed
+	bool complete(DiskDevice* device);
+	// called when io of transfer is finished
+	void finish(Transfer* transfer, int result);
+	// discard transfer of previous run of agent. called when agent is started again
+	void drain();
 };
@@ -41,8 +41,14 @@ static const Logger logger(__FILE__);
 #include "../mesa/memory.h"
 #include "../mesa/processor.h"
 
+#include "../util/Perf.h"
+#include "../util/tsc_clock.h"
+
 #include "AgentFloppy.h"
 
+// source of formatTrack
+static CARD16 zeroPage[PageSize];
+
 
 
 //SectorToDiskAddress: PROCEDURE [
@@ -137,6 +143,10 @@ void AgentFloppy::Call() {
 		if (DEBUG_SHOW_AGENT_FLOPPY) logger.debug("AGENT %s fcb->nextIOCB == 0", name);
 		return; // Return if there is no IOCB
 	}
+	// resolve sectors and buffers of whole IOCB chain on processor thread. io is done in ioThread
+	Batch* batch = new Batch;
+	batch->timeStart = tsc_clock::now();
+
 	FloppyIOCBType *iocb = (FloppyIOCBType *)Store(fcb->nextIOCB);
 	for(;;) {
 		const CARD16 deviceIndex = iocb->operation.device;
@@ -146,20 +156,25 @@ void AgentFloppy::Call() {
 		}
 		FloppyIOFaceGuam::FloppyDCBType* dcb = fcb->dcbs + deviceIndex;
 		const CARD32 sectorNo = diskAddressToSector(dcb, iocb->operation.address);
-		
+		PERF_COUNT(floppy, iocb)
+
+		Item item;
+		item.iocb     = iocb;
+		item.function = (Function)iocb->operation.function;
+		item.address  = iocb->operation.address;
+		item.dataPtr  = iocb->operation.dataPtr;
+
 		//"AGENT %s %d", name, fcb->command
-		FloppyDiskFace::Function command = (FloppyDiskFace::Function)iocb->operation.function;
-		switch(command) {
-		case FloppyDiskFace::Function::nop:
+		switch(item.function) {
+		case Function::nop:
 			if (DEBUG_SHOW_AGENT_FLOPPY)
 				logger.debug("AGENT %s %1d NOP    %8X (%02d-%d-%02d) + %4d %3d %d  dataPtr = %08X  nextIOCB = %08X",
 					name, deviceIndex, sectorNo,
 					iocb->operation.address.cylinder, iocb->operation.address.head + 0, iocb->operation.address.sector + 0,
 					iocb->operation.count, iocb->sectorLength, iocb->operation.incrementDataPointer + 0,
 					iocb->operation.dataPtr, fcb->nextIOCB);
-			iocb->status = (CARD16)FloppyDiskFace::Status::goodCompletion;
 			break;
-		case FloppyDiskFace::Function::readSector: {
+		case Function::readSector: {
 			if (DEBUG_SHOW_AGENT_FLOPPY)
 				logger.debug("AGENT %s %1d READ   %8X (%02d-%d-%02d) + %4d %3d %d  dataPtr = %08X  nextIOCB = %08X",
 					name, deviceIndex, sectorNo,
@@ -172,20 +187,18 @@ void AgentFloppy::Call() {
 			}
 
 			for(int i = 0; i < iocb->operation.count; i++) {
-				CARD32 sector = diskAddressToSector(dcb, iocb->operation.address);
-				CARD16 *buffer = Store(iocb->operation.dataPtr);
-				diskFile->readPage(sector - 1, buffer);
+				CARD32 sector = diskAddressToSector(dcb, item.address);
+				item.pageList.push_back(sector - 1);
+				item.buffers.push_back(Store(item.dataPtr));
 				if (iocb->operation.incrementDataPointer) {
-					iocb->operation.dataPtr += iocb->sectorLength;
+					item.dataPtr += iocb->sectorLength;
 				}
 				sector++;
-				iocb->operation.address = sectorToDiskAddress(dcb, sector);
+				item.address = sectorToDiskAddress(dcb, sector);
 			}
-			iocb->operation.count = 0;
-			iocb->status = (CARD16)FloppyDiskFace::Status::goodCompletion;
 		}
 			break;
-		case FloppyDiskFace::Function::writeSector: {
+		case Function::writeSector: {
 			if (DEBUG_SHOW_AGENT_FLOPPY)
 				logger.debug("AGENT %s %1d WRITE  %8X (%02d-%d-%02d) + %4d %3d %d  dataPtr = %08X  nextIOCB = %08X",
 					name, deviceIndex, sectorNo,
@@ -198,20 +211,18 @@ void AgentFloppy::Call() {
 			}
 
 			for(int i = 0; i < iocb->operation.count; i++) {
-				CARD32 sector = diskAddressToSector(dcb, iocb->operation.address);
-				CARD16 *buffer = Fetch(iocb->operation.dataPtr);
-				diskFile->writePage(sector - 1, buffer);
+				CARD32 sector = diskAddressToSector(dcb, item.address);
+				item.pageList.push_back(sector - 1);
+				item.buffers.push_back(Fetch(item.dataPtr));
 				if (iocb->operation.incrementDataPointer) {
-					iocb->operation.dataPtr += iocb->sectorLength;
+					item.dataPtr += iocb->sectorLength;
 					sector++;
-					iocb->operation.address = sectorToDiskAddress(dcb, sector);
+					item.address = sectorToDiskAddress(dcb, sector);
 				}
 			}
-			iocb->operation.count = 0;
-			iocb->status = (CARD16)FloppyDiskFace::Status::goodCompletion;
 		}
 			break;
-		case FloppyDiskFace::Function::formatTrack: {
+		case Function::formatTrack: {
 			if (DEBUG_SHOW_AGENT_FLOPPY)
 				logger.debug("AGENT %s %1d FORMAT %8X (%02d-%d-%02d) + %4d %3d %d  dataPtr = %08X  nextIOCB = %08X",
 					name, deviceIndex, sectorNo,
@@ -221,28 +232,97 @@ void AgentFloppy::Call() {
 			CARD32 sector = diskAddressToSector(dcb, iocb->operation.address);
 			CARD32 count = iocb->operation.count * iocb->sectorsPerTrack;
 			for(CARD32 i = 0; i < count; i++) {
-				diskFile->zeroPage(sector - 1);
+				item.pageList.push_back(sector - 1);
+				item.buffers.push_back(zeroPage);
 				sector++;
 			}
-			iocb->operation.count = 0;
-			iocb->status = (CARD16)FloppyDiskFace::Status::goodCompletion;
 		}
 			break;
 		default:
 			logger.debug("AGENT %s %1d %6d %8X (%02d-%d-%02d) + %4d %3d %d  dataPtr = %08X  nextIOCB = %08X",
-				name, deviceIndex, command, sectorNo,
+				name, deviceIndex, item.function, sectorNo,
 				iocb->operation.address.cylinder, iocb->operation.address.head + 0, iocb->operation.address.sector + 0,
 				iocb->operation.count, iocb->sectorLength, iocb->operation.incrementDataPointer + 0,
 				iocb->operation.dataPtr, fcb->nextIOCB);
 			ERROR();
 			break;
 		}
+		batch->itemList.push_back(std::move(item));
 
 		if (iocb->nextIOCB == 0) break;
 		// advance to next IOCB
 		iocb = (FloppyIOFaceGuam::FloppyIOCBType *)Store(iocb->nextIOCB);
 	}
 
+	PERF_COUNT(floppy, batch)
+	ioThread.push(batch);
+}
+
+void AgentFloppy::IOThread::process(Batch* const& batch) {
+	agent->process(batch);
+}
+
+// true if pageList is contiguous
+static bool isContiguous(const std::vector<CARD32>& pageList) {
+	for(size_t i = 1; i < pageList.size(); i++) {
+		if (pageList[i] != pageList[i - 1] + 1) return false;
+	}
+	return true;
+}
+
+void AgentFloppy::process(Batch* batch) {
+	auto timeService = tsc_clock::now();
+
+	for(auto& item: batch->itemList) {
+		switch(item.function) {
+		case Function::nop:
+			break;
+		case Function::readSector:
+			PERF_COUNT(floppy, read)
+			PERF_ADD(floppy, sector, item.pageList.size())
+			for(size_t i = 0; i < item.pageList.size(); i++) {
+				diskFile->readPage(item.pageList[i], item.buffers[i]);
+			}
+			break;
+		case Function::writeSector:
+		case Function::formatTrack:
+			if (item.function == Function::writeSector) {
+				PERF_COUNT(floppy, write)
+			} else {
+				PERF_COUNT(floppy, format)
+			}
+			PERF_ADD(floppy, sector, item.pageList.size())
+			if (!item.pageList.empty() && isContiguous(item.pageList)) {
+				// multi-sector write
+				diskFile->writePages(item.pageList.front(), item.buffers);
+			} else {
+				for(size_t i = 0; i < item.pageList.size(); i++) {
+					diskFile->writePage(item.pageList[i], item.buffers[i]);
+				}
+			}
+			break;
+		default:
+			ERROR();
+			break;
+		}
+
+		// update IOCB. set status at last
+		auto iocb = item.iocb;
+		if (item.function == Function::readSector || item.function == Function::writeSector) {
+			iocb->operation.address = item.address;
+			iocb->operation.dataPtr = item.dataPtr;
+		}
+		if (item.function != Function::nop) iocb->operation.count = 0;
+		iocb->status = (CARD16)FloppyDiskFace::Status::goodCompletion;
+	}
+
+	if (PERF_ENABLE) {
+		auto timeStop = tsc_clock::now();
+		PERF_RECORD(floppy, latency, std::chrono::duration_cast<std::chrono::microseconds>(timeStop - batch->timeStart).count())
+		PERF_RECORD(floppy, service, std::chrono::duration_cast<std::chrono::microseconds>(timeStop - timeService).count())
+	}
+	delete batch;
+
 	// notify with interrupt
 	processor::notifyInterrupt(fcb->interruptSelector);
 }
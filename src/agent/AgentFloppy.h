@@ -35,16 +35,45 @@
 
 #pragma once
 
+#include <chrono>
+#include <vector>
+
 #include "Agent.h"
 #include "../util/DiskFile.h"
+#include "../util/ThreadQueue.h"
 
 
 class AgentFloppy : public Agent {
 	using FloppyFCBType  = FloppyIOFaceGuam::FloppyFCBType;
 	using FloppyDCBType  = FloppyIOFaceGuam::FloppyDCBType;
 	using FloppyIOCBType = FloppyIOFaceGuam::FloppyIOCBType;
+	using Function       = FloppyDiskFace::Function;
 
 public:
+	// Item is one IOCB. sectors and buffers are resolved in Call
+	struct Item {
+		FloppyIOCBType*             iocb;
+		Function                    function;
+		std::vector<CARD32>         pageList; // page number of DiskFile for each sector
+		std::vector<CARD16*>        buffers;  // buffer of each sector
+		FloppyDiskFace::DiskAddress address;  // iocb->operation.address after completion
+		CARD32                      dataPtr;  // iocb->operation.dataPtr after completion
+	};
+	// Batch is whole IOCB chain of one Call. IOCBs are completed together with one interrupt
+	struct Batch {
+		std::vector<Item> itemList;
+		std::chrono::steady_clock::time_point timeStart;
+	};
+
+	class IOThread : public thread_queue::ThreadQueueProcessor<Batch*> {
+		AgentFloppy* agent;
+	public:
+		IOThread(AgentFloppy* agent_) : thread_queue::ThreadQueueProcessor<Batch*>("Floppy"), agent(agent_) {}
+		void process(Batch* const& batch);
+	};
+
+	IOThread ioThread;
+
 	static const CARD32 PAGE_SIZE_IN_BYTE        = DiskFile::PAGE_SIZE_IN_BYTE;
 	static const CARD32 FLOPPY_NUMBER_OF_HEADS   =  2;
 	static const CARD32 FLOPPY_SECTORS_PER_TRACK = 18;
@@ -52,7 +81,7 @@ public:
 	static const inline auto index_ = GuamInputOutput::AgentDeviceIndex::floppy;
 	static const inline auto name_ = "Floppy";
 	static const inline auto fcbSize_ = SIZE(FloppyFCBType) + SIZE(FloppyDCBType);
-	AgentFloppy() : Agent(index_, name_, fcbSize_) {
+	AgentFloppy() : Agent(index_, name_, fcbSize_), ioThread(this) {
 		fcb = 0;
 	}
 
@@ -65,7 +94,15 @@ public:
 		diskFile = diskFile_;
 	}
 
+	// true if any floppy request is not completed
+	static bool isPending() {
+		return IOThread::isPending();
+	}
+
 private:
 	FloppyFCBType* fcb;
 	DiskFile*      diskFile;
+
+	// called from ioThread
+	void process(Batch* batch);
 };
@@ -50,31 +50,58 @@ static const Logger logger(__FILE__);
 #include "AgentNetwork.h"
 
 
-void AgentNetwork::TransmitThread::process(const Item& item) {
-	PERF_COUNT(network, transmit)
-	auto interruptSelector = item.interruptSelector;
-	auto iocb = item.iocb;
-
-	if (iocb == 0) ERROR();
-	if (iocb->bufferLength == 0) ERROR();
-	if (iocb->bufferAddress == 0) ERROR();
+// byteswap while copying into driver buffer. size is even
+static void copyByteswap(const uint8_t* source, uint8_t* dest, uint32_t size) {
+	Util::byteswap((uint16_t*)source, (uint16_t*)dest, size / 2);
+}
 
-	CARD32 dataLen = iocb->bufferLength;
-	CARD8* data    = (CARD8*)memory::peek(iocb->bufferAddress);
-	CARD8  buffer[net::PACKET_SIZE];
+void AgentNetwork::TransmitThread::process(const Item& item) {
+	processBatch({item});
+}
 
-	// sanity check for odd byte and minimu packet length
-	if (dataLen & 1 || dataLen < net::minBytesPerEthernetPacket) {
-		logger.fatal("dataLen  %d", dataLen);
-		ERROR()
+void AgentNetwork::TransmitThread::processBatch(const std::vector<Item>& itemList) {
+	PERF_COUNT(network, transmit_batch)
+	PERF_RECORD(network, transmit_batch_size, itemList.size())
+
+	// capture needs byteswapped packet. otherwise driver byteswaps packet into its own buffer
+	const bool useBuffer = capture && capture->isEnabled();
+	if (useBuffer && bufferList.size() < itemList.size()) bufferList.resize(itemList.size());
+	dataList.clear();
+	for(size_t i = 0; i < itemList.size(); i++) {
+		PERF_COUNT(network, transmit)
+		auto iocb = itemList[i].iocb;
+
+		if (iocb == 0) ERROR();
+		if (iocb->bufferLength == 0) ERROR();
+		if (iocb->bufferAddress == 0) ERROR();
+
+		CARD32 dataLen = iocb->bufferLength;
+		CARD8* data    = (CARD8*)memory::peek(iocb->bufferAddress);
+
+		// sanity check for odd byte and minimu packet length
+		if (dataLen & 1 || dataLen < net::minBytesPerEthernetPacket || net::PACKET_SIZE < dataLen) {
+			logger.fatal("dataLen  %d", dataLen);
+			ERROR()
+		}
+		if (useBuffer) {
+			// byteswap and copy from data to buffer
+			CARD8* buffer = bufferList[i].data();
+			Util::byteswap((CARD16*)data, (CARD16*)buffer, dataLen / 2);
+			dataList.emplace_back(buffer, dataLen);
+		} else {
+			dataList.emplace_back(data, dataLen);
+		}
 	}
-	// byteswap and copy from data to buffer
-	Util::byteswap((CARD16*)data, (CARD16*)buffer, (dataLen + 1) / 2);
 
-	std::span<uint8_t> span{buffer, dataLen};
-	int ret = driver->transmit(span);
-
-	if (ret == -1) {
+	int ret;
+	if (useBuffer) {
+		auto timestamp = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch());
+		for(const auto& data: dataList) capture->capture(PacketCapture::Direction::transmit, timestamp, data);
+		ret = driver->transmitBatch(dataList);
+	} else {
+		ret = driver->transmitBatchCopy(dataList, copyByteswap);
+	}
+	if (ret != (int)dataList.size()) {
 		// set iocb->status if possibble
 
 		//static const CARD16 S_inProgress              =   1;
@@ -84,13 +111,16 @@ void AgentNetwork::TransmitThread::process(const Item& item) {
 		//static const CARD16 S_alignmentError          =  16;
 		//static const CARD16 S_packetTooLong           =  32;
 		//static const CARD16 S_bacCRDAndAlignmentError = 128;
+		logger.fatal("%s  %d  ret != size.  ret = %d  size = %d", __FUNCTION__, __LINE__, ret, (int)dataList.size());
 		ERROR();
 	}
-	if (ret != (int)dataLen) {
-		logger.fatal("%s  %d  ret != dataLen.  ret = %d  dataLen = %d", __FUNCTION__, __LINE__, ret, dataLen);
-		ERROR();
+
+	// one interrupt for whole batch
+	CARD16 interruptSelector = 0;
+	for(const auto& item: itemList) {
+		item.iocb->status = EthernetIOFaceGuam::S_completedOK;
+		interruptSelector |= item.interruptSelector;
 	}
-	iocb->status = EthernetIOFaceGuam::S_completedOK;
 	processor::notifyInterrupt(interruptSelector);
 }
 
@@ -98,6 +128,8 @@ void AgentNetwork::ReceiveThread::push(const Item& item) {
 	PERF_COUNT(network, receive_request)
 	std::unique_lock<std::mutex> lock(mutex);
 	queue.push_front(item);
+	// hand over packet waiting in ring
+	drain();
 	// {
 	// 	auto iocb = item.iocb;
 	// 	auto status = iocb->status;
@@ -105,24 +137,80 @@ void AgentNetwork::ReceiveThread::push(const Item& item) {
 	// }
 }
 
+void AgentNetwork::ReceiveThread::clear() {
+	std::unique_lock<std::mutex> lock(mutex);
+	if (ringCount || !queue.empty()) logger.info("ReceiveThread  clear  ring = %d  queue = %d", ringCount, queue.size());
+	queue.clear();
+	ringHead  = 0;
+	ringCount = 0;
+	// driver is not thread safe. receive thread clears driver
+	clearDriver = true;
+}
+
+std::vector<AgentNetwork::Item> AgentNetwork::ReceiveThread::getQueue() {
+	// push adds to front
+	return std::vector<Item>(queue.rbegin(), queue.rend());
+}
+
 void AgentNetwork::ReceiveThread::run() {
 	stopThread = false;
 	for(;;) {
 		if (stopThread) break;
+		if (clearDriver.exchange(false)) driver->clear();
 		std::span<uint8_t> span;
-		if (driver->receive(span, Util::ONE_SECOND)) {
+		std::chrono::microseconds timestamp{0};
+		if (driver->receive(span, Util::ONE_SECOND, &timestamp)) {
 			PERF_COUNT(network, receive_packet)
+			if (capture && capture->isEnabled()) {
+				// use time of capture if driver has no timestamp
+				if (timestamp.count() == 0) timestamp = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch());
+				capture->capture(PacketCapture::Direction::receive, timestamp, span);
+			}
 			std::unique_lock<std::mutex> lock(mutex);
-			if (!queue.empty()) {
+			// packet received before clear
+			if (clearDriver) continue;
+			if (!queue.empty() && ringCount == 0) {
 				const auto& item = queue.back();
 				// process item
 				process(item, span);
 				queue.pop_back();
+			} else {
+				// keep packet until guest posts next receive IOCB
+				enqueue(span);
 			}
 		}
 	}
 }
 
+void AgentNetwork::ReceiveThread::enqueue(const std::span<uint8_t>& span) {
+	if (ringCount == RING_SIZE || net::PACKET_SIZE < span.size()) {
+		missed();
+		return;
+	}
+	PERF_COUNT(network, receive_ring)
+	auto& packet = ring[(ringHead + ringCount) % RING_SIZE];
+	packet.length = span.size();
+	std::copy(span.begin(), span.end(), packet.data);
+	ringCount++;
+	PERF_RECORD(network, ring_occupancy, ringCount)
+}
+
+void AgentNetwork::ReceiveThread::drain() {
+	while(ringCount && !queue.empty()) {
+		auto& packet = ring[ringHead];
+		std::span<uint8_t> span{packet.data, packet.length};
+		process(queue.back(), span);
+		queue.pop_back();
+		ringHead = (ringHead + 1) % RING_SIZE;
+		ringCount--;
+	}
+}
+
+void AgentNetwork::ReceiveThread::missed() {
+	PERF_COUNT(network, receive_drop)
+	if (fcb) fcb->packetsMissed = fcb->packetsMissed + 1;
+}
+
 void AgentNetwork::ReceiveThread::process(const Item& item, const std::span<uint8_t>& span) {
 	PERF_COUNT(network, receive_process)
 	auto interruptSelector = item.interruptSelector;
@@ -138,6 +226,10 @@ void AgentNetwork::ReceiveThread::process(const Item& item, const std::span<uint
 	CARD8* buffer    = span.data();
 	CARD32 bufferLen = span.size();
 
+	// dirty bit of IOCB and buffer can be cleared by checkpoint after Call
+	memory::markDirty(item.iocbAddress, SIZE(EthernetIOCBType));
+	memory::markDirty(iocb->bufferAddress, (dataLen + 1) / 2);
+
 	if (bufferLen < dataLen) {
 		// byteswap and copy from buffer to data
 		Util::byteswap((uint16_t*)buffer, (CARD16*)data, (bufferLen + 1) / 2);
@@ -174,8 +266,8 @@ void AgentNetwork::Initialize() {
 	fcb->packetsMissed             = 0;
 	fcb->agentBlockSize            = 0;
 
-	transmitThread.set(driver);
-	receiveThread.set(driver);
+	transmitThread.set(driver, capture);
+	receiveThread.set(driver, fcb, capture);
 }
 
 void AgentNetwork::Call() {
@@ -183,6 +275,7 @@ void AgentNetwork::Call() {
 	if (fcb->stopAgent) {
 		if (!fcb->receiveStopped) {
 			logger.info("AGENT %s  stop", name);
+			receiveThread.clear();
 		}
 		fcb->receiveStopped  = 1;
 		fcb->transmitStopped = 1;
@@ -191,6 +284,8 @@ void AgentNetwork::Call() {
 	} else {
 		if (fcb->receiveStopped) {
 			logger.info("AGENT %s  start  %04X %04X", name, fcb->transmitInterruptSelector + 0, fcb->receiveInterruptSelector + 0);
+			// packet buffered while agent is stopped must not go into new IOCB
+			receiveThread.clear();
 		}
 		fcb->receiveStopped  = 0;
 		fcb->transmitStopped = 0;
@@ -198,23 +293,26 @@ void AgentNetwork::Call() {
 	if (DEBUG_SHOW_AGENT_NETWORK) logger.debug("AGENT %s  receiveIOCB = %08X  transmitIOCB = %08X", name, fcb->receiveIOCB + 0, fcb->transmitIOCB + 0);
 
 	if (fcb->receiveIOCB) {
-		EthernetIOCBType* iocb = (EthernetIOCBType*)Store(fcb->receiveIOCB);
+		CARD32 iocbAddress = fcb->receiveIOCB;
+		EthernetIOCBType* iocb = (EthernetIOCBType*)Store(iocbAddress);
 
 		for(;;) {
 			CARD16 packetType= iocb->packetType;
 			if (packetType != EthernetIOFaceGuam::PT_receive) ERROR();
 
 			if (DEBUG_SHOW_AGENT_NETWORK) logger.debug("AGENT %s  receive  status = %04X  nextIOCB = %08X", name, iocb->status + 0, iocb->nextIOCB);
-			Item item(fcb->receiveInterruptSelector, iocb);
+			Item item(fcb->receiveInterruptSelector, iocb, iocbAddress);
 			receiveThread.push(item);
 			//
 			if (iocb->nextIOCB == 0) break;
-			iocb = (EthernetIOCBType*)Store(iocb->nextIOCB);
+			iocbAddress = iocb->nextIOCB;
+			iocb = (EthernetIOCBType*)Store(iocbAddress);
 		}
 	}
 
 	if (fcb->transmitIOCB) {
-		EthernetIOCBType* iocb = (EthernetIOCBType*)Store(fcb->transmitIOCB);
+		CARD32 iocbAddress = fcb->transmitIOCB;
+		EthernetIOCBType* iocb = (EthernetIOCBType*)Store(iocbAddress);
 
 		for(;;) {
 			CARD16 packetType= iocb->packetType;
@@ -222,11 +320,27 @@ void AgentNetwork::Call() {
 
 			if (DEBUG_SHOW_AGENT_NETWORK) logger.debug("AGENT %s  transmit status = %04X  nextIOCB = %08X", name, iocb->status + 0, iocb->nextIOCB);
 
-			Item item(fcb->transmitInterruptSelector, iocb);
+			Item item(fcb->transmitInterruptSelector, iocb, iocbAddress);
 			transmitThread.push(item);
 			//
 			if (iocb->nextIOCB == 0) break;
-			iocb = (EthernetIOCBType*)Store(iocb->nextIOCB);
+			iocbAddress = iocb->nextIOCB;
+			iocb = (EthernetIOCBType*)Store(iocbAddress);
 		}
 	}
 }
+
+std::vector<AgentNetwork::PendingReceive> AgentNetwork::getPendingReceive() {
+	std::vector<PendingReceive> list;
+	for(const auto& item: receiveThread.getQueue()) {
+		list.push_back({item.iocbAddress, item.interruptSelector});
+	}
+	return list;
+}
+
+void AgentNetwork::setPendingReceive(const std::vector<PendingReceive>& list) {
+	for(const auto& e: list) {
+		EthernetIOCBType* iocb = (EthernetIOCBType*)memory::peek(e.iocbAddress);
+		receiveThread.push(Item(e.interruptSelector, iocb, e.iocbAddress));
+	}
+}
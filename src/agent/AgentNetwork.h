@@ -35,10 +35,14 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <mutex>
 #include <deque>
+#include <vector>
 
 #include "../util/net.h"
+#include "../util/PacketCapture.h"
 #include "../util/ThreadQueue.h"
 
 #include "Agent.h"
@@ -51,47 +55,87 @@ public:
 	struct Item {
 		CARD16            interruptSelector;
 		EthernetIOCBType* iocb;
+		CARD32            iocbAddress; // virtual address of iocb
 
-		Item(CARD16 interruptSelector_, EthernetIOCBType* iocb_) :
-			interruptSelector(interruptSelector_), iocb(iocb_) {}
+		Item(CARD16 interruptSelector_, EthernetIOCBType* iocb_, CARD32 iocbAddress_) :
+			interruptSelector(interruptSelector_), iocb(iocb_), iocbAddress(iocbAddress_) {}
 		// use default implementation
 		Item(const Item& that)            = default;
 		Item& operator=(const Item& that) = default;	
 	};
 
 	class TransmitThread : public thread_queue::ThreadQueueProcessor<Item> {
-		net::Driver* driver;
+		net::Driver*   driver;
+		PacketCapture* capture;
+		// byteswapped packet of batch for capture
+		std::vector<std::array<uint8_t, net::PACKET_SIZE>> bufferList;
+		std::vector<net::Driver::data_type>                dataList;
 	public:
 		static void stop() {
 			thread_queue::ThreadQueueProcessor<Item>::stop();
 		}
 
-		TransmitThread() : driver(0) {}
+		TransmitThread() : driver(0), capture(0) {}
 
-		void set(net::Driver* driver_) {
-			driver = driver_;
+		void set(net::Driver* driver_, PacketCapture* capture_) {
+			driver  = driver_;
+			capture = capture_;
 		}
 
 		void process(const Item& data);
+		// transmit all queued IOCB with one driver call and one interrupt
+		void processBatch(const std::vector<Item>& itemList);
 	};
 
 	class ReceiveThread {
+	public:
+		// number of packet that can wait for receive IOCB
+		static constexpr uint32_t RING_SIZE = 64;
+	private:
+		struct Packet {
+			uint32_t length;
+			uint8_t  data[net::PACKET_SIZE];
+		};
+
 		static inline bool stopThread;
-		std::mutex         mutex;
-		std::deque<Item>   queue;
-		net::Driver*       driver;
+		// set by clear. receive thread discards packet buffered in driver
+		std::atomic<bool>   clearDriver;
+		std::mutex          mutex;
+		std::deque<Item>    queue;
+		// bounded ring of packet received while queue is empty. guarded by mutex
+		std::vector<Packet> ring;
+		uint32_t            ringHead;
+		uint32_t            ringCount;
+		net::Driver*        driver;
+		EthernetFCBType*    fcb;
+		PacketCapture*      capture;
+
+		// caller must hold mutex
+		void enqueue(const std::span<uint8_t>& span);
+		void drain();
+		void missed();
 	public:
 		static void stop() {
 			stopThread = true;
 		}
 
-		ReceiveThread() : driver(0) {}
+		ReceiveThread() : clearDriver(false), ring(RING_SIZE), ringHead(0), ringCount(0), driver(0), fcb(0), capture(0) {}
 
-		void set(net::Driver* driver_) {
-			driver = driver_;
+		void set(net::Driver* driver_, EthernetFCBType* fcb_, PacketCapture* capture_) {
+			driver  = driver_;
+			fcb     = fcb_;
+			capture = capture_;
 		}
 
 		void push(const Item& item);
+		// discard waiting item and packet received before agent stop or start
+		void clear();
+		// items waiting for packet. oldest first. caller must hold mutex
+		std::vector<Item> getQueue();
+		// process writes guest memory while holding mutex
+		std::mutex& getMutex() {
+			return mutex;
+		}
 		void run();
 		void process(const Item& item, const std::span<uint8_t>& span);
 	};
@@ -102,18 +146,43 @@ public:
 	static const inline auto index_ = GuamInputOutput::AgentDeviceIndex::network;
 	static const inline auto name_ = "Network";
 	static const inline auto fcbSize_ = SIZE(EthernetFCBType);
-	AgentNetwork() : Agent(index_, name_, fcbSize_), fcb(0), driver(0) {}
+	AgentNetwork() : Agent(index_, name_, fcbSize_), fcb(0), driver(0), capture(0) {}
 
 	void Initialize();
 	void Call();
 
 	void poll();
 
+	// for snapshot. receive IOCB posted by guest and waiting for packet. oldest first
+	struct PendingReceive {
+		CARD32 iocbAddress;
+		CARD16 interruptSelector;
+	};
+	// receive thread doesn't write guest memory while lock is held
+	std::unique_lock<std::mutex> lockReceive() {
+		return std::unique_lock<std::mutex>(receiveThread.getMutex());
+	}
+	// caller must hold lockReceive
+	std::vector<PendingReceive> getPendingReceive();
+	// call after Initialize
+	void setPendingReceive(const std::vector<PendingReceive>& list);
+
 	void setDriver(net::Driver* driver_) {
 		driver = driver_;
 	}
+	// replace driver after Initialize. threads must be stopped
+	void changeDriver(net::Driver* driver_) {
+		driver = driver_;
+		transmitThread.set(driver, capture);
+		receiveThread.set(driver, fcb, capture);
+	}
+	// optional. capture receive and transmit packet
+	void setCapture(PacketCapture* capture_) {
+		capture = capture_;
+	}
 
 private:
 	EthernetFCBType* fcb;
 	net::Driver*     driver;
+	PacketCapture*   capture;
 };
@@ -127,6 +127,8 @@ CARD32 StreamCopyPaste::GetBuffer::get32() {
 
 StreamCopyPaste::PutBuffer::PutBuffer(CoProcessorIOFaceGuam::CoProcessorIOCBType *iocb) : transferRec(iocb->mesaGet) {
 	data = (CARD8*)memory::peek(transferRec.buffer);
+	// buffer can span pages
+	memory::markDirty(transferRec.buffer, (transferRec.bufferSize + 1) / 2);
 }
 void StreamCopyPaste::PutBuffer::PutBuffer::put8(CARD8 value) {
 	if (transferRec.bytesWritten == transferRec.bufferSize) {
@@ -0,0 +1,118 @@
+/*******************************************************************************
+ * Copyright (c) 2025, Yasuhiro Hasegawa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+//
+// main.cpp
+//
+
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "../util/Util.h"
+static const Logger logger(__FILE__);
+
+#include "../util/net.h"
+#include "../util/tsc_clock.h"
+
+// benchmark [NAME ...]
+//   run micro benchmark of NAME. run all benchmark without NAME
+//   benchmark measures time of host. keep it out of unit test that must not depend on load of host
+
+// compare cost of reading clock
+static void benchmarkClock() {
+	tsc_clock::calibrate();
+	const int COUNT = 10'000'000;
+
+	int64_t sum_steady = 0;
+	auto start_steady = std::chrono::steady_clock::now();
+	for(int i = 0; i < COUNT; i++) sum_steady += std::chrono::steady_clock::now().time_since_epoch().count();
+	auto time_steady = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_steady).count();
+
+	int64_t sum_tsc = 0;
+	auto start_tsc = std::chrono::steady_clock::now();
+	for(int i = 0; i < COUNT; i++) sum_tsc += tsc_clock::now().time_since_epoch().count();
+	auto time_tsc = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_tsc).count();
+
+	logger.info("benchmarkClock  steady_clock  %5.1f ns/read", (double)time_steady / COUNT);
+	logger.info("benchmarkClock  tsc_clock     %5.1f ns/read  %s", (double)time_tsc / COUNT, tsc_clock::info());
+	// use sum to keep loop
+	if (sum_steady == 0 || sum_tsc == 0) logger.warn("benchmarkClock  unexpected sum");
+}
+
+// compare cost of byteswap of one packet and one page
+static void benchmarkByteswap() {
+	std::vector<uint16_t> source(net::PACKET_SIZE / 2);
+	std::vector<uint16_t> dest(source.size());
+	for(size_t i = 0; i < source.size(); i++) source[i] = (uint16_t)i;
+
+	for(const auto& kernel: Util::getByteswapKernelList()) {
+		for(int size: {net::PACKET_SIZE / 2, 256}) {
+			const int COUNT = 1'000'000;
+			auto start = std::chrono::steady_clock::now();
+			for(int i = 0; i < COUNT; i++) {
+				kernel.function(source.data(), dest.data(), size);
+				// prevent optimizer from removing loop
+				asm volatile("" : : "r"(dest.data()) : "memory");
+			}
+			auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+			logger.info("benchmarkByteswap  %-6s  %4d words  %6.1f ns/call  %5.2f GB/s", kernel.name, size, (double)time / COUNT, (double)size * 2 * COUNT / time);
+		}
+	}
+}
+
+struct Benchmark {
+	const char*           name;
+	std::function<void()> function;
+};
+
+static const std::vector<Benchmark> benchmarkList = {
+	{"clock",    benchmarkClock},
+	{"byteswap", benchmarkByteswap},
+};
+
+int main(int argc, char** argv) {
+	logger.info("START");
+
+	for(const auto& e: benchmarkList) {
+		bool run = argc == 1;
+		for(int i = 1; i < argc; i++) {
+			if (e.name == std::string(argv[i])) run = true;
+		}
+		if (!run) continue;
+		logger.info("benchmark %s", e.name);
+		e.function();
+	}
+
+	logger.info("STOP");
+	return 0;
+}
@@ -0,0 +1,80 @@
+/*******************************************************************************
+ * Copyright (c) 2025, Yasuhiro Hasegawa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+//
+// main.cpp
+//
+
+#include <filesystem>
+#include <string>
+
+#include "../util/Util.h"
+static const Logger logger(__FILE__);
+
+#include "../mesa/checkpoint.h"
+
+// checkpoint-log info    LOG         show records of checkpoint log
+// checkpoint-log compact LOG OUTPUT  write latest state of LOG as log of one record
+
+static void usage() {
+	logger.info("usage");
+	logger.info("  checkpoint-log info    LOG");
+	logger.info("  checkpoint-log compact LOG OUTPUT");
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		usage();
+		return 1;
+	}
+	std::string command = argv[1];
+
+	if (command == "info" && argc == 3) {
+		std::string path = argv[2];
+		auto log = checkpoint::scan(path);
+		logger.info("log      %s", path);
+		logger.info("vpSize   %s", formatWithCommas(log.vpSize));
+		logger.info("rpSize   %s", formatWithCommas(log.rpSize));
+		for(const auto& e: log.recordList) {
+			logger.info("record %4d  MP %4d  page %6d  map chunk %3d  receive %2d  disk %d  %s byte",
+				e.sequence, e.MP, e.pageCount, e.mapChunkCount, e.receiveCount, e.diskCount, formatWithCommas(e.size));
+		}
+		logger.info("record   %d", (int)log.recordList.size());
+		logger.info("disk     %s / %s byte", formatWithCommas(log.validSize), formatWithCommas(std::filesystem::file_size(path)));
+		return 0;
+	}
+	if (command == "compact" && argc == 4) {
+		checkpoint::compact(argv[2], argv[3]);
+		return 0;
+	}
+
+	usage();
+	return 1;
+}
@@ -0,0 +1,125 @@
+/*******************************************************************************
+ * Copyright (c) 2025, Yasuhiro Hasegawa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+//
+// main.cpp
+//
+
+#include <filesystem>
+#include <string>
+
+#include "../util/Util.h"
+static const Logger logger(__FILE__);
+
+#include "../util/DiskFile.h"
+#include "../util/DiskOverlay.h"
+
+// disk-image create  PATH PAGE       create sparse disk image of PAGE pages
+// disk-image compact PATH            punch hole of all-zero block of disk image
+// disk-image overlay BASE OVERLAY    create empty overlay of BASE
+// disk-image info    PATH            show information of disk image
+// disk-image commit  OVERLAY         write pages in OVERLAY to base image and make OVERLAY empty
+//                                    refuse when other overlay of same base exists, unless --force is given
+//                                    as 3rd argument. other overlay of same base can not be attached after commit
+// disk-image squash  OVERLAY OUTPUT  write contents of OVERLAY as sparse flat disk image
+
+static void usage() {
+	logger.info("usage");
+	logger.info("  disk-image create  PATH PAGE");
+	logger.info("  disk-image compact PATH");
+	logger.info("  disk-image overlay BASE OVERLAY");
+	logger.info("  disk-image info    PATH");
+	logger.info("  disk-image commit  OVERLAY [--force]");
+	logger.info("  disk-image squash  OVERLAY OUTPUT");
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		usage();
+		return 1;
+	}
+	std::string command = argv[1];
+
+	if (command == "create" && argc == 4) {
+		DiskFile::create(argv[2], (uint32_t)std::stoul(argv[3]));
+		return 0;
+	}
+	if (command == "compact" && argc == 3) {
+		auto released = DiskFile::compact(argv[2]);
+		logger.info("released %s byte", formatWithCommas(released));
+		return 0;
+	}
+	if (command == "overlay" && argc == 4) {
+		DiskOverlay::create(argv[3], argv[2]);
+		return 0;
+	}
+	if (command == "info" && argc == 3) {
+		std::string path = argv[2];
+		if (DiskOverlay::isOverlay(path)) {
+			DiskOverlay overlay;
+			overlay.attach(path);
+			logger.info("overlay  %s", path);
+			logger.info("base     %s", overlay.getBasePath());
+			logger.info("page     %s / %s", formatWithCommas(overlay.getPageSize()), formatWithCommas(overlay.countPage()));
+			overlay.detach();
+		} else {
+			auto size = std::filesystem::file_size(path);
+			logger.info("image    %s", path);
+			logger.info("page     %s", formatWithCommas(size / DiskOverlay::PAGE_SIZE_IN_BYTE));
+		}
+		logger.info("disk     %s / %s byte", formatWithCommas(DiskFile::getAllocatedSize(path)), formatWithCommas(std::filesystem::file_size(path)));
+		return 0;
+	}
+	if (command == "commit" && (argc == 3 || (argc == 4 && std::string(argv[3]) == "--force"))) {
+		auto otherList = DiskOverlay::findOther(argv[2]);
+		if (!otherList.empty()) {
+			for(const auto& e: otherList) logger.warn("other overlay of same base  %s", e);
+			if (argc == 3) {
+				logger.error("commit changes base of other overlay. use --force to commit");
+				return 1;
+			}
+		}
+		DiskOverlay overlay;
+		overlay.attach(argv[2], false);
+		overlay.commit();
+		overlay.detach();
+		return 0;
+	}
+	if (command == "squash" && argc == 4) {
+		DiskOverlay overlay;
+		overlay.attach(argv[2]);
+		overlay.squash(argv[3]);
+		overlay.detach();
+		return 0;
+	}
+
+	usage();
+	return 1;
+}
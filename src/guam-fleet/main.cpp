@@ -0,0 +1,314 @@
+/*******************************************************************************
+ * Copyright (c) 2025, Yasuhiro Hasegawa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+//
+// main.cpp
+//
+
+#include <chrono>
+#include <csignal>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../util/Util.h"
+static const Logger logger(__FILE__);
+
+#include "../util/Perf.h"
+
+#include "../mesa/guam.h"
+#include "../mesa/guam_config.h"
+
+// guam-fleet [--config PATH] [--restart N] [--report-interval SECOND] ENTRY ...
+//   run one headless workstation for each ENTRY of guam-config.json in own process.
+//   cpu and memory of entry places threads and real memory of the instance.
+//   instance that crashes is restarted up to N times. instance that stops normally is not restarted.
+//   counters of all instance are reported as one perf::dump every report interval and at the end.
+
+static constexpr int DEFAULT_RESTART         = 3;
+static constexpr int DEFAULT_REPORT_INTERVAL = 60; // in second
+
+// child sends perf::toText() followed by this line
+static const std::string REPORT_END = "END";
+
+struct Instance {
+	std::string         name;
+	guam_config::Entry  entry;
+	pid_t               pid;
+	int                 fd;          // read end of report pipe
+	int                 restartCount;
+	bool                stopped;
+	std::string         buffer;      // partial report from pipe
+	std::string         report;      // latest report of current process
+	std::string         retiredReport; // perf::toText() of all previous process
+
+	Instance(const std::string& name_, const guam_config::Entry& entry_) :
+		name(name_), entry(entry_), pid(-1), fd(-1), restartCount(0), stopped(false) {}
+};
+
+static volatile sig_atomic_t stopRequest = 0;
+static void stopHandler(int) {
+	stopRequest = 1;
+}
+
+// all cpu of instance. thread that has no cpu list, such as disk flush thread, runs on these cpu
+static std::string allCPU(const guam_config::Entry::CPU& cpu) {
+	std::string ret;
+	for(const auto& e: {cpu.processor, cpu.timer, cpu.disk, cpu.network}) {
+		if (e.empty()) continue;
+		if (!ret.empty()) ret += ",";
+		ret += e;
+	}
+	return ret;
+}
+
+static std::mutex reportMutex;
+static void writeReport(int fd) {
+	std::lock_guard<std::mutex> lock(reportMutex);
+	auto text = perf::toText() + REPORT_END + "\n";
+	for(size_t pos = 0; pos < text.size();) {
+		auto ret = write(fd, text.data() + pos, text.size() - pos);
+		if (ret < 0) {
+			if (errno == EINTR) continue;
+			return; // supervisor is gone
+		}
+		pos += ret;
+	}
+}
+
+// body of child process. never return
+[[noreturn]] static void runInstance(const Instance& instance, int fd, int reportInterval) {
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+
+	logger.info("instance %s  pid %d", instance.name, getpid());
+	auto cpuList = allCPU(instance.entry.cpu);
+	if (!cpuList.empty()) Util::setAffinity(cpuList);
+
+	guam::setConfig(guam_config::toConfig(instance.entry));
+
+	std::thread([fd, reportInterval]() {
+		for(;;) {
+			std::this_thread::sleep_for(std::chrono::seconds(reportInterval));
+			writeReport(fd);
+		}
+	}).detach();
+
+	guam::run();
+
+	writeReport(fd);
+	_exit(0);
+}
+
+static void start(std::deque<Instance>& instanceList, Instance& instance, int reportInterval) {
+	int pipeFD[2];
+	int ret;
+	CHECK_SYSCALL(ret, pipe(pipeFD))
+
+	pid_t pid;
+	CHECK_SYSCALL(pid, fork())
+	if (pid == 0) {
+		close(pipeFD[0]);
+		for(const auto& e: instanceList) {
+			if (0 <= e.fd) close(e.fd);
+		}
+		runInstance(instance, pipeFD[1], reportInterval);
+	}
+	close(pipeFD[1]);
+	instance.pid    = pid;
+	instance.fd     = pipeFD[0];
+	instance.buffer.clear();
+	instance.report.clear();
+	logger.info("start    %-16s  pid %6d  restart %d", instance.name, pid, instance.restartCount);
+}
+
+// read report from pipe. return false at end of file
+static bool receive(Instance& instance) {
+	char buffer[4096];
+	auto ret = read(instance.fd, buffer, sizeof(buffer));
+	if (ret < 0) {
+		if (errno == EINTR) return true;
+		int errNo = errno;
+		LOG_ERRNO(errNo)
+		return false;
+	}
+	if (ret == 0) return false;
+
+	instance.buffer.append(buffer, ret);
+	// keep last complete report
+	for(;;) {
+		auto pos = instance.buffer.find(REPORT_END + "\n");
+		while(pos != std::string::npos && pos != 0 && instance.buffer[pos - 1] != '\n') {
+			pos = instance.buffer.find(REPORT_END + "\n", pos + 1);
+		}
+		if (pos == std::string::npos) break;
+		instance.report = instance.buffer.substr(0, pos);
+		instance.buffer.erase(0, pos + REPORT_END.size() + 1);
+	}
+	return true;
+}
+
+static void report(const std::deque<Instance>& instanceList) {
+	PERF_CLEAR()
+	for(const auto& e: instanceList) {
+		if (!perf::merge(e.retiredReport) || !perf::merge(e.report)) {
+			logger.warn("unexpected report  %s", e.name);
+		}
+		logger.info("instance %-16s  pid %6d  restart %d  %s", e.name, e.pid, e.restartCount, e.stopped ? "stopped" : "running");
+	}
+	PERF_LOG()
+}
+
+static void usage() {
+	logger.info("usage");
+	logger.info("  guam-fleet [--config PATH] [--restart N] [--report-interval SECOND] ENTRY ...");
+}
+
+int main(int argc, char** argv) {
+	logger.info("START");
+
+	std::string configPath;
+	int restartLimit   = DEFAULT_RESTART;
+	int reportInterval = DEFAULT_REPORT_INTERVAL;
+	std::vector<std::string> entryNameList;
+	for(int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--config" && i + 1 < argc) {
+			configPath = argv[++i];
+		} else if (arg == "--restart" && i + 1 < argc) {
+			restartLimit = std::stoi(argv[++i]);
+		} else if (arg == "--report-interval" && i + 1 < argc) {
+			reportInterval = std::stoi(argv[++i]);
+		} else if (arg.starts_with("--")) {
+			logger.error("Unexpected argument %s", arg);
+			usage();
+			return 1;
+		} else {
+			entryNameList.push_back(arg);
+		}
+	}
+	if (entryNameList.empty() || reportInterval <= 0) {
+		usage();
+		return 1;
+	}
+
+	auto guamConfig = configPath.empty() ? guam_config::getInstance() : guam_config::getInstance(configPath);
+	// deque keeps reference of element
+	std::deque<Instance> instanceList;
+	for(const auto& name: entryNameList) {
+		instanceList.emplace_back(std_sprintf("%s#%d", name, (int)instanceList.size()), guamConfig.getEntry(name));
+	}
+
+	signal(SIGINT,  stopHandler);
+	signal(SIGTERM, stopHandler);
+	signal(SIGHUP,  stopHandler);
+	signal(SIGPIPE, SIG_IGN);
+
+	for(auto& e: instanceList) start(instanceList, e, reportInterval);
+
+	bool stopping = false;
+	auto reportTime = std::chrono::steady_clock::now() + std::chrono::seconds(reportInterval);
+	for(;;) {
+		if (stopRequest && !stopping) {
+			logger.info("stop all instance");
+			stopping = true;
+			for(const auto& e: instanceList) {
+				if (!e.stopped) kill(e.pid, SIGTERM);
+			}
+		}
+
+		// read report until end of file that means process is gone
+		std::vector<pollfd> pollList;
+		std::vector<Instance*> pollInstance;
+		for(auto& e: instanceList) {
+			if (e.fd < 0) continue;
+			pollList.push_back({e.fd, POLLIN, 0});
+			pollInstance.push_back(&e);
+		}
+		if (!pollList.empty()) {
+			int ret = poll(pollList.data(), pollList.size(), 1000);
+			if (ret < 0 && errno != EINTR) {
+				int errNo = errno;
+				LOG_ERRNO(errNo)
+				ERROR()
+			}
+			for(size_t i = 0; 0 < ret && i < pollList.size(); i++) {
+				if (pollList[i].revents == 0) continue;
+				auto& instance = *pollInstance[i];
+				if (!receive(instance)) {
+					close(instance.fd);
+					instance.fd = -1;
+				}
+			}
+		}
+
+		// reap process and restart crashed one
+		for(auto& e: instanceList) {
+			if (e.stopped || 0 <= e.fd) continue;
+			int status;
+			pid_t pid;
+			CHECK_SYSCALL(pid, waitpid(e.pid, &status, 0))
+			bool crashed = WIFSIGNALED(status) || (WIFEXITED(status) && WEXITSTATUS(status) != 0);
+			if (WIFSIGNALED(status)) {
+				logger.warn("instance %-16s  pid %6d  signal %d", e.name, pid, WTERMSIG(status));
+			} else {
+				logger.info("instance %-16s  pid %6d  exit %d", e.name, pid, WEXITSTATUS(status));
+			}
+			e.retiredReport += e.report;
+			e.report.clear();
+			if (crashed && !stopping && e.restartCount < restartLimit) {
+				e.restartCount++;
+				start(instanceList, e, reportInterval);
+			} else {
+				e.stopped = true;
+			}
+		}
+
+		bool allStopped = true;
+		for(const auto& e: instanceList) allStopped = allStopped && e.stopped;
+		if (allStopped) break;
+
+		if (reportTime <= std::chrono::steady_clock::now()) {
+			report(instanceList);
+			reportTime += std::chrono::seconds(reportInterval);
+		}
+	}
+
+	report(instanceList);
+
+	logger.info("STOP");
+	return 0;
+}
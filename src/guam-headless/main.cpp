@@ -28,26 +28,293 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  *******************************************************************************/
 
-
 //
 // main.cpp
 //
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
 #include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <nlohmann/json.hpp>
 
 #include "../util/Util.h"
 static const Logger logger(__FILE__);
 
+#include "../util/DiskFile.h"
+#include "../util/DiskOverlay.h"
+#include "../util/guest_clock.h"
 #include "../util/Perf.h"
 #include "../util/trace.h"
 
 #include "../mesa/guam.h"
+#include "../mesa/memory.h"
 #include "../mesa/processor.h"
 #include "../mesa/guam_config.h"
+#include "../mesa/Variable.h"
 
 #include "../opcode/opcode.h"
 
-int main(int /* argc */, char** /* argv */) {
+using json = nlohmann::json;
+
+// guam-headless [OPTION] [ENTRY]
+//   ENTRY                    entry of guam-config.json. default is GVWin
+//   --config PATH            path of guam-config.json
+//   --stop MP                stop processor at MP. can be repeated. default is 915 and 8000
+//   --interval FROM-TO       measure time from MP FROM to MP TO. can be repeated. default is 900-8000
+//   --iteration N            cold boot N times back to back. each boot uses new overlay of disk. base image is never written
+//   --format text|json       json writes interval, opcode, perf and page cache stats to output
+//   --output PATH            output of json format. default is build/run/guam-headless.json
+//   --virtual-time           advance guest clock when processor is idle
+//   --snapshot-save PATH     save snapshot of machine when processor stops. disk must be overlay
+//   --snapshot-load PATH     restore machine from snapshot or checkpoint log instead of boot
+//   --checkpoint PATH        append incremental checkpoint to log. disk must be overlay
+//   --checkpoint-interval MS
+//   --clone N                fork N child at stop MP. each child continues with own disk overlay and network
+//                            virtual switch of network needs %d in name when N > 1. such as vswitch:net%d
+//
+// Each boot runs in child process, so every boot starts from initial state of process.
+// Exit status is 1 if a boot fails or misses MP of interval.
+
+struct Interval {
+	CARD16 from;
+	CARD16 to;
+	std::vector<double> timeList; // in millisecond. one for each boot that shows both MP
+
+	std::string toString() const {
+		return std_sprintf("%d-%d", from, to);
+	}
+};
+
+// stats of one boot sent from child to parent
+//   S MP                        stop MP
+//   I FROM TO NANOSECOND        -1 for missing MP
+//   M CODE COUNT                opcode stats of mop
+//   E CODE COUNT                opcode stats of esc
+//   P USED HIT MISS_EMPTY MISS_CONFLICT   page cache stats
+//   C ... H ...                 perf::toText()
+struct PageCacheStats {
+	int      used;
+	uint64_t hit;
+	uint64_t missEmpty;
+	uint64_t missConflict;
+
+	PageCacheStats() : used(0), hit(0), missEmpty(0), missConflict(0) {}
+};
+
+static std::string toText(const std::vector<Interval>& intervalList) {
+	std::ostringstream oss;
+	oss << "S " << (CARD16)MP << "\n";
+	for(const auto& e: intervalList) {
+		auto from = processor::getMPTime(e.from);
+		auto to   = processor::getMPTime(e.to);
+		int64_t time = -1;
+		if (from != std::chrono::steady_clock::time_point::min() && to != std::chrono::steady_clock::time_point::min()) {
+			time = std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+		}
+		oss << "I " << e.from << " " << e.to << " " << time << "\n";
+	}
+	for(int i = 0; i < opcode::TABLE_SIZE; i++) {
+		if (opcode::statsMop[i]) oss << "M " << i << " " << opcode::statsMop[i] << "\n";
+		if (opcode::statsEsc[i]) oss << "E " << i << " " << opcode::statsEsc[i] << "\n";
+	}
+	oss << "P " << memory::cache::getUsedCount() << " " << memory::cache::hit << " " << memory::cache::missEmpty << " " << memory::cache::missConflict << "\n";
+	oss << perf::toText();
+	return oss.str();
+}
+
+// add stats of one boot. return false if boot misses MP of interval
+static bool merge(const std::string& text, std::vector<Interval>& intervalList, PageCacheStats& pageCache) {
+	bool ret = true;
+	std::string perfText;
+	std::istringstream iss(text);
+	for(std::string line; std::getline(iss, line);) {
+		std::istringstream lss(line);
+		std::string type;
+		lss >> type;
+		if (type == "S") {
+			int mp;
+			lss >> mp;
+			logger.info("stop at MP %4d", mp);
+		} else if (type == "I") {
+			int from;
+			int to;
+			int64_t time;
+			lss >> from >> to >> time;
+			for(auto& e: intervalList) {
+				if (e.from != from || e.to != to) continue;
+				if (time < 0) {
+					logger.warn("missing MP of interval %s", e.toString());
+					ret = false;
+				} else {
+					e.timeList.push_back(time / 1'000'000.0);
+				}
+			}
+		} else if (type == "M" || type == "E") {
+			int code;
+			uint64_t count;
+			lss >> code >> count;
+			auto& stats = (type == "M") ? opcode::statsMop : opcode::statsEsc;
+			stats.at(code) += count;
+		} else if (type == "P") {
+			int used;
+			uint64_t hit;
+			uint64_t missEmpty;
+			uint64_t missConflict;
+			lss >> used >> hit >> missEmpty >> missConflict;
+			pageCache.used         = std::max(pageCache.used, used);
+			pageCache.hit          += hit;
+			pageCache.missEmpty    += missEmpty;
+			pageCache.missConflict += missConflict;
+		} else {
+			perfText += line + "\n";
+		}
+	}
+	if (!perf::merge(perfText)) {
+		logger.warn("unexpected perf text");
+		ret = false;
+	}
+	return ret;
+}
+
+// nearest rank. list is sorted
+static double percentile(const std::vector<double>& list, double percentile) {
+	if (list.empty()) return 0;
+	auto rank = (size_t)std::ceil(percentile / 100.0 * list.size());
+	return list[std::max(rank, (size_t)1) - 1];
+}
+
+static json toJSON(const std::string& entryName, int iteration, int failure, std::vector<Interval>& intervalList, const PageCacheStats& pageCache) {
+	json ret;
+	ret["entry"]     = entryName;
+	ret["iteration"] = iteration;
+	ret["failure"]   = failure;
+
+	for(auto& e: intervalList) {
+		std::sort(e.timeList.begin(), e.timeList.end());
+		json interval;
+		interval["count"] = e.timeList.size();
+		interval["time"]  = e.timeList;
+		if (!e.timeList.empty()) {
+			interval["min"] = e.timeList.front();
+			interval["p50"] = percentile(e.timeList, 50);
+			interval["p95"] = percentile(e.timeList, 95);
+			interval["max"] = e.timeList.back();
+		}
+		ret["interval"][e.toString()] = interval;
+	}
+
+	ret["opcode"]["mop"] = json::object();
+	ret["opcode"]["esc"] = json::object();
+	for(int i = 0; i < opcode::TABLE_SIZE; i++) {
+		if (opcode::statsMop[i]) ret["opcode"]["mop"][opcode::nameMop[i]] = opcode::statsMop[i];
+		if (opcode::statsEsc[i]) ret["opcode"]["esc"][opcode::nameEsc[i]] = opcode::statsEsc[i];
+	}
+
+	for(const auto& e: perf::all) {
+		ret["perf"]["counter"][e.group][e.name] = e.value;
+	}
+	for(const auto& e: perf::allHistogram) {
+		const auto& h = e.value;
+		if (h.count == 0) continue;
+		ret["perf"]["histogram"][e.group][e.name] = {
+			{"count", h.count.load()}, {"sum", h.sum.load()}, {"max", h.max.load()},
+			{"p50", h.percentile(50)}, {"p90", h.percentile(90)}, {"p99", h.percentile(99)}};
+	}
+
+	ret["pageCache"] = {
+		{"size", memory::cache::N_ENTRY}, {"used", pageCache.used},
+		{"hit", pageCache.hit}, {"missEmpty", pageCache.missEmpty}, {"missConflict", pageCache.missConflict}};
+	return ret;
+}
+
+// body of child process. never return
+[[noreturn]] static void boot(const guam::Config& config, const std::vector<CARD16>& stopList, const std::vector<Interval>& intervalList, bool logStats, int fd) {
+	const pid_t pid = getpid();
+
+	guam::setConfig(config);
+	for(auto e: stopList) processor::stopAtMP(e);
+
+	logger.info("thread start");
+	auto thread = std::thread(guam::run);
+	logger.info("thread joinning");
+	thread.join();
+	logger.info("thread joined");
+
+	// clone of Config::cloneCount returns from guam::run also
+	if (getpid() != pid) _exit(0);
+
+//	trace::dump();
+
+	if (logStats) {
+		opcode::stats();
+		PERF_LOG();
+		variable::dump();
+		memory::cache::stats();
+	}
+	logger.info(processor::getBootTime());
+	logger.info(processor::getElapsedTime());
+
+	auto text = toText(intervalList);
+	for(size_t pos = 0; pos < text.size();) {
+		auto ret = write(fd, text.data() + pos, text.size() - pos);
+		if (ret < 0) {
+			if (errno == EINTR) continue;
+			_exit(1);
+		}
+		pos += ret;
+	}
+	_exit(0);
+}
+
+// run one boot in child process and return its stats. return empty string if boot fails
+static std::string bootChild(const guam::Config& config, const std::vector<CARD16>& stopList, const std::vector<Interval>& intervalList, bool logStats) {
+	int pipeFD[2];
+	int ret;
+	CHECK_SYSCALL(ret, pipe(pipeFD))
+
+	pid_t pid;
+	CHECK_SYSCALL(pid, fork())
+	if (pid == 0) {
+		close(pipeFD[0]);
+		boot(config, stopList, intervalList, logStats, pipeFD[1]);
+	}
+	close(pipeFD[1]);
+
+	std::string text;
+	char buffer[4096];
+	for(;;) {
+		auto ret = read(pipeFD[0], buffer, sizeof(buffer));
+		if (ret < 0 && errno == EINTR) continue;
+		if (ret <= 0) break;
+		text.append(buffer, ret);
+	}
+	close(pipeFD[0]);
+
+	int status;
+	CHECK_SYSCALL(ret, waitpid(pid, &status, 0))
+	if (WIFSIGNALED(status)) {
+		logger.error("boot failed  signal %d", WTERMSIG(status));
+		return "";
+	}
+	if (WEXITSTATUS(status) != 0) {
+		logger.error("boot failed  exit %d", WEXITSTATUS(status));
+		return "";
+	}
+	return text;
+}
+
+int main(int argc, char** argv) {
 	logger.info("START");
 
 	setSignalHandler(SIGINT);
@@ -55,56 +322,134 @@ int main(int /* argc */, char** /* argv */) {
 	setSignalHandler(SIGHUP);
 	setSignalHandler(SIGSEGV);
 
-	// sanity check
-	// if (argc != 2) {
-	// 	logger.error("Unexpected argc %d", argc);
-	// 	ERROR();
-	// }
-	// std::string entryName = argv[1];
-	auto entryName = "GVWin";
+	std::string entryName = "GVWin";
+	std::string configPath;
+	std::vector<CARD16>   stopList;
+	std::vector<Interval> intervalList;
+	int         iteration          = 1;
+	std::string format             = "text";
+	std::string outputPath         = "build/run/guam-headless.json";
+	std::string snapshotSavePath;
+	std::string snapshotLoadPath;
+	std::string checkpointPath;
+	int         checkpointInterval = 0;
+	int         cloneCount         = 0;
+	for(int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--config" && i + 1 < argc) {
+			configPath = argv[++i];
+		} else if (arg == "--stop" && i + 1 < argc) {
+			stopList.push_back((CARD16)std::stoi(argv[++i]));
+		} else if (arg == "--interval" && i + 1 < argc) {
+			std::string value = argv[++i];
+			auto pos = value.find('-');
+			if (pos == std::string::npos) {
+				logger.error("Unexpected interval %s", value);
+				ERROR();
+			}
+			intervalList.push_back({(CARD16)std::stoi(value.substr(0, pos)), (CARD16)std::stoi(value.substr(pos + 1)), {}});
+		} else if (arg == "--iteration" && i + 1 < argc) {
+			iteration = std::stoi(argv[++i]);
+		} else if (arg == "--format" && i + 1 < argc) {
+			format = argv[++i];
+		} else if (arg == "--output" && i + 1 < argc) {
+			outputPath = argv[++i];
+		} else if (arg == "--virtual-time") {
+			guest_clock::enable(true);
+		} else if (arg == "--snapshot-save" && i + 1 < argc) {
+			snapshotSavePath = argv[++i];
+		} else if (arg == "--snapshot-load" && i + 1 < argc) {
+			snapshotLoadPath = argv[++i];
+		} else if (arg == "--checkpoint" && i + 1 < argc) {
+			checkpointPath = argv[++i];
+		} else if (arg == "--checkpoint-interval" && i + 1 < argc) {
+			checkpointInterval = std::stoi(argv[++i]);
+		} else if (arg == "--clone" && i + 1 < argc) {
+			cloneCount = std::stoi(argv[++i]);
+		} else if (!arg.starts_with("--")) {
+			entryName = arg;
+		} else {
+			logger.error("Unexpected argument %s", arg);
+			ERROR();
+		}
+	}
+	if (iteration <= 0 || (format != "text" && format != "json")) {
+		logger.error("Unexpected iteration %d  format %s", iteration, format);
+		ERROR();
+	}
+	// stop at MP 8000
+	//   restored machine stops at once if snapshot is taken at MP 8000
+	if (stopList.empty()) stopList = {915, 8000};
+	if (intervalList.empty()) intervalList.push_back({900, 8000, {}});
 	logger.info("entryName = %s", entryName);
+	logger.info("iteration = %d", iteration);
 
-	auto guamConfig = guam_config::getInstance();
+	auto guamConfig = configPath.empty() ? guam_config::getInstance() : guam_config::getInstance(configPath);
 	auto entry = guamConfig.getEntry(entryName);
 
-	guam::Config config;
-	config.diskFilePath     = entry.file.disk;
-    config.germFilePath     = entry.file.germ;
-    config.bootFilePath     = entry.file.boot;
-    config.floppyFilePath   = entry.file.floppy;
-    config.networkInterface = entry.network.interface;
-    config.networkAddress   = entry.network.address;
-    config.bootSwitch       = entry.boot.switch_;
-    config.bootDevice       = entry.boot.device;
-    config.displayType      = entry.display.type;
-    config.displayWidth     = entry.display.width;
-    config.displayHeight    = entry.display.height;
-    config.vmBits           = entry.memory.vmbits;
-    config.rmBits           = entry.memory.rmbits;
+	guam::Config config = guam_config::toConfig(entry);
+	config.snapshotSavePath   = snapshotSavePath;
+	config.snapshotLoadPath   = snapshotLoadPath;
+	config.checkpointPath     = checkpointPath;
+	config.checkpointInterval = checkpointInterval;
+	config.cloneCount         = cloneCount;
+	// overlay supports only mmap backend without flush
+	if (DiskFile::toBackend(config.diskBackend) != DiskFile::Backend::mmap || DiskFile::toFlush(config.diskFlush) != DiskFile::Flush::none) {
+		logger.warn("overlay of boot ignores diskBackend %s and diskFlush %s. boot uses mmap backend and no flush",
+			config.diskBackend, config.diskFlush);
+		config.diskBackend = DiskFile::toString(DiskFile::Backend::mmap);
+		config.diskFlush   = DiskFile::toString(DiskFile::Flush::none);
+	}
 
-	guam::setConfig(config);
+	// parent accumulates stats of all boot. opcode::initialize gives name of opcode
+	opcode::initialize();
+	PERF_CLEAR()
+	PageCacheStats pageCache;
+	int failure = 0;
 
-	// stop at MP 8000
-	processor::stopAtMP( 915);
-	processor::stopAtMP(8000);
+	for(int i = 0; i < iteration; i++) {
+		logger.info("boot %d / %d", i + 1, iteration);
 
-	logger.info("thread start");
-	auto thread = std::thread(guam::run);
-	logger.info("thread joinning");
-	thread.join();
-	logger.info("thread joined");
-	
-//	trace::dump();
+		// start each boot from same contents of disk. every boot, including first, runs on throwaway overlay of disk,
+		// so that base image is never written and every boot measures same backend
+		guam::Config bootConfig = config;
+		std::vector<std::string> overlayList;
+		auto overlay = [&](const std::string& path) {
+			auto overlayPath = std_sprintf("%s.headless%d", path, getpid());
+			if (DiskOverlay::isOverlay(path)) {
+				// copy pages of configured overlay. base of configured overlay is shared
+				DiskOverlay source;
+				source.attach(path);
+				source.save(overlayPath);
+				source.detach();
+			} else {
+				DiskOverlay::create(overlayPath, path);
+			}
+			overlayList.push_back(overlayPath);
+			return overlayPath;
+		};
+		bootConfig.diskFilePath = overlay(config.diskFilePath);
+		for(auto& e: bootConfig.extraDiskFilePathList) e = overlay(e);
 
-	// output stats
-	opcode::stats();
-	PERF_LOG();
-	variable::dump();
-	memory::cache::stats();
+		auto text = bootChild(bootConfig, stopList, intervalList, format == "text");
+		if (text.empty() || !merge(text, intervalList, pageCache)) failure++;
 
-	logger.info(processor::getBootTime());
-    logger.info(processor::getElapsedTime());
+		for(const auto& e: overlayList) std::filesystem::remove(e);
+	}
+
+	// output stats
+	for(auto& e: intervalList) {
+		std::sort(e.timeList.begin(), e.timeList.end());
+		logger.info("interval %-10s  count %3d  p50 %10.3f  p95 %10.3f  max %10.3f  ms", e.toString(), (int)e.timeList.size(),
+			percentile(e.timeList, 50), percentile(e.timeList, 95), e.timeList.empty() ? 0 : e.timeList.back());
+	}
+	if (format == "json") {
+		std::ofstream ofs(outputPath);
+		ofs << toJSON(entryName, iteration, failure, intervalList, pageCache).dump(2) << std::endl;
+		logger.info("output = %s", outputPath);
+	}
+	logger.info("failure = %d", failure);
 
 	logger.info("STOP");
-	return 0;
+	return failure ? 1 : 0;
 }
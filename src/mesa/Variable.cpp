@@ -118,6 +118,27 @@ void variable::Values::set() {
 	lastOpcode = opcode::lastOpcodeName();
 }
 
+void variable::Values::restore() const {
+	::MP.restore(MP);
+	::WP  = WP;
+	::WDC = WDC;
+	::PTC = PTC;
+	::XTS = XTS;
+	::PSB = PSB;
+	::MDS = MDS;
+	::LF  = LF;
+	::GF  = GF;
+	::CB  = CB;
+	::GFI = GFI;
+	::PC  = PC;
+	for(int i = 0; i < StackDepth; i++) ::stack[i] = stack[i];
+	::SP  = SP;
+	::savedPC   = savedPC;
+	::savedSP   = savedSP;
+	::breakByte = breakByte;
+	::running   = running;
+}
+
 void variable::initialize() {
 	// Processor ID
 	PID[0] = 0x0000;
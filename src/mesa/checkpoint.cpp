@@ -0,0 +1,496 @@
+/*******************************************************************************
+ * Copyright (c) 2025, Yasuhiro Hasegawa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+
+//
+// checkpoint.cpp
+//
+
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../util/Util.h"
+static const Logger logger(__FILE__);
+
+#include "../util/Perf.h"
+
+#include "memory.h"
+#include "checkpoint.h"
+
+namespace checkpoint {
+
+constexpr char RECORD_MAGIC[8]  = {'M', 'E', 'S', 'A', 'C', 'K', 'R', '1'};
+constexpr char TRAILER_MAGIC[8] = {'M', 'E', 'S', 'A', 'C', 'K', 'E', '1'};
+
+struct FileHeader {
+	char     magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+	uint32_t vpSize;
+	uint32_t rpSize;
+};
+
+struct RecordHeader {
+	char     magic[8];
+	uint64_t recordSize; // including header and trailer
+	uint32_t sequence;
+	uint32_t pageCount;
+	uint32_t mapChunkCount;
+	uint32_t receiveCount;
+	int32_t  displayPageSize;
+	int32_t  displayVP;
+	int32_t  displayRP;
+	uint32_t diskCount;
+	snapshot::Registers registers;
+};
+
+struct RecordTrailer {
+	char     magic[8];
+	uint64_t recordSize;
+	uint32_t sequence;
+	uint32_t reserved;
+};
+
+static constexpr uint64_t PAGE_BYTE_SIZE  = sizeof(CARD16) * PageSize;
+static constexpr uint64_t CHUNK_BYTE_SIZE = sizeof(memory::Map) * MAP_CHUNK_SIZE;
+
+static FileHeader makeFileHeader(uint32_t vpSize, uint32_t rpSize) {
+	FileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version    = VERSION;
+	header.headerSize = sizeof(FileHeader);
+	header.vpSize     = vpSize;
+	header.rpSize     = rpSize;
+	return header;
+}
+
+// replace contents of record with new record
+static void putRecord(std::vector<uint8_t>& record, uint32_t sequence, const memory::Config& config, const snapshot::Registers& registers,
+	const std::vector<uint32_t>& pageList, const CARD16* pages, const std::vector<uint32_t>& chunkList, const memory::Map* maps,
+	const std::vector<AgentNetwork::PendingReceive>& pendingReceive, const std::vector<snapshot::Disk>& diskList) {
+	RecordHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, RECORD_MAGIC, sizeof(RECORD_MAGIC));
+	header.recordSize      = sizeof(RecordHeader) + sizeof(uint32_t) * (pageList.size() + chunkList.size()) +
+		sizeof(AgentNetwork::PendingReceive) * pendingReceive.size() + sizeof(snapshot::Disk) * diskList.size() +
+		PAGE_BYTE_SIZE * pageList.size() + CHUNK_BYTE_SIZE * chunkList.size() + sizeof(RecordTrailer);
+	header.sequence        = sequence;
+	header.pageCount       = pageList.size();
+	header.mapChunkCount   = chunkList.size();
+	header.receiveCount    = pendingReceive.size();
+	header.displayPageSize = config.display.pageSize;
+	header.displayVP       = config.display.vp;
+	header.displayRP       = config.display.rp;
+	header.diskCount       = diskList.size();
+	header.registers       = registers;
+
+	RecordTrailer trailer;
+	memset(&trailer, 0, sizeof(trailer));
+	memcpy(trailer.magic, TRAILER_MAGIC, sizeof(TRAILER_MAGIC));
+	trailer.recordSize = header.recordSize;
+	trailer.sequence   = sequence;
+
+	record.resize(header.recordSize);
+	uint8_t* p = record.data();
+	auto put = [&p](const void* data, uint64_t size) {
+		memcpy(p, data, size);
+		p += size;
+	};
+	put(&header, sizeof(header));
+	put(pageList.data(), sizeof(uint32_t) * pageList.size());
+	put(chunkList.data(), sizeof(uint32_t) * chunkList.size());
+	put(pendingReceive.data(), sizeof(AgentNetwork::PendingReceive) * pendingReceive.size());
+	put(diskList.data(), sizeof(snapshot::Disk) * diskList.size());
+	for(auto rp: pageList) put(pages + (uint64_t)rp * PageSize, PAGE_BYTE_SIZE);
+	for(auto chunk: chunkList) put(maps + (uint64_t)chunk * MAP_CHUNK_SIZE, CHUNK_BYTE_SIZE);
+	put(&trailer, sizeof(trailer));
+	if (p != record.data() + record.size()) ERROR();
+}
+
+// state of latest record
+struct Image {
+	uint32_t                                  sequence;
+	memory::Config                            config;
+	std::vector<memory::Map>                  maps;
+	std::vector<CARD16>                       pages;
+	snapshot::Registers                       registers;
+	std::vector<AgentNetwork::PendingReceive> pendingReceive;
+	std::vector<snapshot::Disk>               diskList;
+};
+
+// apply every record of log from the first
+static Image load(const std::string& path) {
+	auto log = scan(path);
+	if (log.recordList.empty()) {
+		logger.error("no record in log  %s", path);
+		ERROR();
+	}
+
+	Image image;
+	image.config.vpSize = log.vpSize;
+	image.config.rpSize = log.rpSize;
+	image.maps.resize(log.vpSize);
+	image.pages.resize((uint64_t)log.rpSize * PageSize);
+
+	std::ifstream ifs(path, std::ios::in | std::ios::binary);
+	std::vector<uint32_t> pageList;
+	std::vector<uint32_t> chunkList;
+	for(const auto& e: log.recordList) {
+		RecordHeader header;
+		ifs.seekg(e.offset);
+		ifs.read((char*)&header, sizeof(header));
+		pageList.resize(header.pageCount);
+		chunkList.resize(header.mapChunkCount);
+		image.pendingReceive.resize(header.receiveCount);
+		image.diskList.resize(header.diskCount);
+		ifs.read((char*)pageList.data(), sizeof(uint32_t) * pageList.size());
+		ifs.read((char*)chunkList.data(), sizeof(uint32_t) * chunkList.size());
+		ifs.read((char*)image.pendingReceive.data(), sizeof(AgentNetwork::PendingReceive) * image.pendingReceive.size());
+		ifs.read((char*)image.diskList.data(), sizeof(snapshot::Disk) * image.diskList.size());
+		for(auto rp: pageList) {
+			if (log.rpSize <= rp) ERROR();
+			ifs.read((char*)(image.pages.data() + (uint64_t)rp * PageSize), PAGE_BYTE_SIZE);
+		}
+		for(auto chunk: chunkList) {
+			if (log.vpSize / MAP_CHUNK_SIZE <= chunk) ERROR();
+			ifs.read((char*)(image.maps.data() + (uint64_t)chunk * MAP_CHUNK_SIZE), CHUNK_BYTE_SIZE);
+		}
+		if (!ifs) {
+			logger.error("read failed  %s  sequence %d", path, e.sequence);
+			ERROR();
+		}
+		image.sequence       = header.sequence;
+		image.registers      = header.registers;
+		image.config.display = e.display;
+	}
+	return image;
+}
+
+std::string overlayPath(const std::string& path, uint32_t sequence, int index) {
+	return std_sprintf("%s.%u.disk%d", path, sequence, index);
+}
+
+bool isLog(const std::string& path) {
+	std::ifstream ifs(path, std::ios::in | std::ios::binary);
+	char magic[sizeof(MAGIC)];
+	if (!ifs.read(magic, sizeof(magic))) return false;
+	return memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+Log scan(const std::string& path) {
+	std::ifstream ifs(path, std::ios::in | std::ios::binary);
+	FileHeader fileHeader;
+	if (!ifs.read((char*)&fileHeader, sizeof(fileHeader))) {
+		logger.error("cannot read header  %s", path);
+		ERROR();
+	}
+	if (memcmp(fileHeader.magic, MAGIC, sizeof(MAGIC)) != 0) {
+		logger.error("not checkpoint log  %s", path);
+		ERROR();
+	}
+	if (fileHeader.version != VERSION || fileHeader.headerSize != sizeof(FileHeader)) {
+		logger.error("unexpected version  %d  %d", fileHeader.version, fileHeader.headerSize);
+		ERROR();
+	}
+	if (fileHeader.vpSize % MAP_CHUNK_SIZE) ERROR();
+
+	const uint64_t fileSize = std::filesystem::file_size(path);
+	Log log;
+	log.vpSize    = fileHeader.vpSize;
+	log.rpSize    = fileHeader.rpSize;
+	log.validSize = sizeof(FileHeader);
+	for(uint64_t offset = log.validSize; offset + sizeof(RecordHeader) <= fileSize; offset = log.validSize) {
+		RecordHeader  header;
+		RecordTrailer trailer;
+		ifs.seekg(offset);
+		if (!ifs.read((char*)&header, sizeof(header))) break;
+		if (memcmp(header.magic, RECORD_MAGIC, sizeof(RECORD_MAGIC)) != 0) break;
+		if (header.recordSize < sizeof(RecordHeader) + sizeof(RecordTrailer)) break;
+		if (fileSize < offset + header.recordSize) break;
+		ifs.seekg(offset + header.recordSize - sizeof(RecordTrailer));
+		if (!ifs.read((char*)&trailer, sizeof(trailer))) break;
+		if (memcmp(trailer.magic, TRAILER_MAGIC, sizeof(TRAILER_MAGIC)) != 0) break;
+		if (trailer.recordSize != header.recordSize || trailer.sequence != header.sequence) break;
+
+		Record record;
+		record.sequence         = header.sequence;
+		record.offset           = offset;
+		record.size             = header.recordSize;
+		record.pageCount        = header.pageCount;
+		record.mapChunkCount    = header.mapChunkCount;
+		record.receiveCount     = header.receiveCount;
+		record.diskCount        = header.diskCount;
+		record.MP               = header.registers.MP;
+		record.display.pageSize = header.displayPageSize;
+		record.display.vp       = header.displayVP;
+		record.display.rp       = header.displayRP;
+		log.recordList.push_back(record);
+		log.validSize = offset + header.recordSize;
+	}
+	if (log.validSize != fileSize) {
+		logger.warn("ignore torn record at end of log  %s  %s bytes", path, formatWithCommas(fileSize - log.validSize));
+	}
+	return log;
+}
+
+snapshot::State restore(const std::string& path) {
+	auto image = load(path);
+
+	// pages are zero filled and written from image
+	memory::restore(image.config, image.maps.data(), -1, 0);
+	std::copy(image.pages.begin(), image.pages.end(), memory::getPages());
+
+	snapshot::State state;
+	state.values         = snapshot::toValues(image.registers);
+	state.pendingReceive = image.pendingReceive;
+	state.diskList       = image.diskList;
+
+	logger.info("checkpoint::restore  %s  sequence %d  MP %4d  receive %d  disk %d",
+		path, image.sequence, image.registers.MP, (int)state.pendingReceive.size(), (int)state.diskList.size());
+	return state;
+}
+
+void compact(const std::string& path, const std::string& outputPath) {
+	auto image = load(path);
+
+	// restore starts with zero page
+	std::vector<uint32_t> pageList;
+	for(uint32_t rp = 0; rp < image.config.rpSize; rp++) {
+		if (!Util::isZero(image.pages.data() + (uint64_t)rp * PageSize, PAGE_BYTE_SIZE)) pageList.push_back(rp);
+	}
+	std::vector<uint32_t> chunkList;
+	for(uint32_t chunk = 0; chunk < image.config.vpSize / MAP_CHUNK_SIZE; chunk++) {
+		chunkList.push_back(chunk);
+	}
+	std::vector<uint8_t> record;
+	putRecord(record, image.sequence, image.config, image.registers, pageList, image.pages.data(), chunkList, image.maps.data(),
+		image.pendingReceive, image.diskList);
+	for(size_t i = 0; i < image.diskList.size(); i++) {
+		DiskOverlay overlay;
+		overlay.attach(overlayPath(path, image.sequence, i));
+		overlay.save(overlayPath(outputPath, image.sequence, i));
+		overlay.detach();
+	}
+
+	auto fileHeader = makeFileHeader(image.config.vpSize, image.config.rpSize);
+	std::ofstream ofs(outputPath, std::ios::out | std::ios::binary | std::ios::trunc);
+	ofs.write((const char*)&fileHeader, sizeof(fileHeader));
+	ofs.write((const char*)record.data(), record.size());
+	ofs.close();
+	if (!ofs) {
+		logger.error("write failed  %s", outputPath);
+		ERROR();
+	}
+	logger.info("checkpoint::compact  %s  =>  %s  sequence %d  page %d  %s bytes",
+		path, outputPath, image.sequence, (int)pageList.size(), formatWithCommas(sizeof(fileHeader) + record.size()));
+}
+
+
+void Writer::open(const std::string& path_, const std::vector<DiskOverlay*>& diskList_) {
+	if (file) ERROR();
+	path     = path_;
+	diskList = diskList_;
+	const auto& config = memory::getConfig();
+	if (config.vpSize == 0) ERROR();
+
+	bool append = false;
+	sequence = 0;
+	if (isLog(path)) {
+		auto log = scan(path);
+		if (log.vpSize == config.vpSize && log.rpSize == config.rpSize) {
+			append = true;
+			// drop torn record before append
+			std::filesystem::resize_file(path, log.validSize);
+			if (!log.recordList.empty()) sequence = log.recordList.back().sequence + 1;
+		} else {
+			logger.warn("memory size of log is different. create new log  %s", path);
+		}
+	}
+
+	file = fopen(path.c_str(), append ? "ab" : "wb");
+	if (file == 0) {
+		int errNo = errno;
+		logger.fatal("Cannot open  %s", path);
+		LOG_ERRNO(errNo)
+		ERROR();
+	}
+	if (!append) {
+		auto fileHeader = makeFileHeader(config.vpSize, config.rpSize);
+		fwrite(&fileHeader, sizeof(fileHeader), 1, file);
+		fflush(file);
+	}
+	skipZeroPage = !append;
+	shadowMaps.clear();
+
+	stopThread = false;
+	busy       = false;
+	thread = std::thread(&Writer::run, this);
+	logger.info("checkpoint open  %s  %s  sequence %d", path, append ? "append" : "create", sequence);
+}
+
+void Writer::close() {
+	if (file == 0) return;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		stopThread = true;
+	}
+	cv.notify_one();
+	thread.join();
+	fclose(file);
+	file = 0;
+	logger.info("checkpoint close  %s", path);
+}
+
+void Writer::run() {
+	for(;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cv.wait(lock, [this]{ return busy || stopThread; });
+			// write pending record before stop
+			if (!busy) break;
+		}
+		auto timeStart = std::chrono::steady_clock::now();
+		// overlay file is synced before record, so complete record always has its overlay file
+		for(const auto& overlayPath: recordOverlayList) {
+			int fd = ::open(overlayPath.c_str(), O_RDONLY);
+			if (fd < 0 || ::fsync(fd) < 0) {
+				int errNo = errno;
+				logger.error("sync failed  %s", overlayPath);
+				LOG_ERRNO(errNo)
+			}
+			if (0 <= fd) ::close(fd);
+		}
+		size_t ret = fwrite(record.data(), 1, record.size(), file);
+		fflush(file);
+		fdatasync(fileno(file));
+		if (ret != record.size()) {
+			int errNo = errno;
+			logger.error("write failed  %s", path);
+			LOG_ERRNO(errNo)
+		}
+		PERF_ADD(checkpoint, write_byte, record.size())
+		PERF_RECORD(checkpoint, write_time, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - timeStart).count())
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			busy = false;
+		}
+	}
+}
+
+bool Writer::take(const variable::Values& values, const std::vector<AgentNetwork::PendingReceive>& pendingReceive) {
+	if (file == 0) ERROR();
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (busy) {
+			PERF_COUNT(checkpoint, skip)
+			return false;
+		}
+	}
+	auto timeStart = std::chrono::steady_clock::now();
+
+	const auto&        config = memory::getConfig();
+	const uint64_t*    dirty  = memory::getDirty();
+	const CARD16*      pages  = memory::getPages();
+	const memory::Map* maps   = memory::getMaps();
+
+	std::vector<uint32_t> chunkList;
+	const bool fullMap = shadowMaps.size() != config.vpSize;
+	if (fullMap) shadowMaps.assign(maps, maps + config.vpSize);
+	for(uint32_t chunk = 0; chunk < config.vpSize / MAP_CHUNK_SIZE; chunk++) {
+		const memory::Map* p = maps + (uint64_t)chunk * MAP_CHUNK_SIZE;
+		memory::Map*       q = shadowMaps.data() + (uint64_t)chunk * MAP_CHUNK_SIZE;
+		if (fullMap || memcmp(p, q, CHUNK_BYTE_SIZE) != 0) {
+			chunkList.push_back(chunk);
+			// page that becomes dirty in MapFlags since last record is written by guest
+			for(uint32_t i = 0; i < MAP_CHUNK_SIZE; i++) {
+				memory::Map map = p[i];
+				if (map.mf.isVacant() || !map.mf.dirty) continue;
+				if (q[i].mf.dirty && q[i].rp == map.rp) continue;
+				memory::markDirty((chunk * MAP_CHUNK_SIZE + i) * PageSize, 1);
+			}
+			std::copy(p, p + MAP_CHUNK_SIZE, q);
+		}
+	}
+
+	std::vector<uint32_t> pageList;
+	for(uint32_t i = 0; i < (config.rpSize + 63) / 64; i++) {
+		for(uint64_t word = dirty[i]; word; word &= word - 1) {
+			uint32_t rp = i * 64 + std::countr_zero(word);
+			if (config.rpSize <= rp) break;
+			if (skipZeroPage && Util::isZero(pages + (uint64_t)rp * PageSize, PAGE_BYTE_SIZE)) continue;
+			pageList.push_back(rp);
+		}
+	}
+
+	// disk is quiescent while processor is paused without pending io
+	std::vector<snapshot::Disk> recordDiskList;
+	recordOverlayList.clear();
+	for(size_t i = 0; i < diskList.size(); i++) {
+		recordOverlayList.push_back(overlayPath(path, sequence, i));
+		diskList[i]->save(recordOverlayList.back());
+		recordDiskList.push_back({diskList[i]->getPageSize(), 1});
+	}
+
+	putRecord(record, sequence, config, snapshot::toRegisters(values), pageList, pages, chunkList, maps, pendingReceive, recordDiskList);
+	memory::clearDirty();
+	const uint32_t recordSequence = sequence++;
+	const uint64_t recordSize     = record.size();
+	skipZeroPage = false;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		busy = true;
+	}
+	cv.notify_one();
+	// previous record is complete, because take runs only after previous record is written
+	if (2 <= recordSequence) {
+		for(size_t i = 0; i < diskList.size(); i++) {
+			std::error_code ec;
+			std::filesystem::remove(overlayPath(path, recordSequence - 2, i), ec);
+		}
+	}
+
+	auto pauseTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - timeStart).count();
+	PERF_COUNT(checkpoint, take)
+	PERF_ADD(checkpoint, page, pageList.size())
+	PERF_ADD(checkpoint, map_chunk, chunkList.size())
+	PERF_RECORD(checkpoint, pause_time, pauseTime)
+	logger.info("checkpoint %4d  pause %6d us  page %6d  map chunk %3d  %s bytes",
+		recordSequence, (int)pauseTime, (int)pageList.size(), (int)chunkList.size(), formatWithCommas(recordSize));
+	return true;
+}
+
+}
@@ -0,0 +1,149 @@
+/*******************************************************************************
+ * Copyright (c) 2025, Yasuhiro Hasegawa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+
+//
+// checkpoint.h
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MesaBasic.h"
+#include "memory.h"
+#include "snapshot.h"
+
+#include "../util/DiskOverlay.h"
+
+// Incremental checkpoint of running machine
+//   Writer::take copies real pages written since last checkpoint and changed chunk of memory::Map while processor is paused.
+//   Background thread appends the copy to log as one record. First record after open has every page.
+//   Record ends with trailer, so torn record at end of log is ignored.
+//
+//   offset           contents
+//   0                FileHeader
+//   FileHeader size  record 0, record 1, ...
+//
+//   record           RecordHeader, real page numbers, map chunk numbers, PendingReceive, snapshot::Disk,
+//                    real pages, map chunks, RecordTrailer
+//
+//   Disk must be overlay. Pages in disk overlay is saved with each record in separate overlay file. see overlayPath.
+//   Overlay file is synced before record, so complete record always has its overlay file.
+//   Overlay file of record before previous record is removed.
+namespace checkpoint {
+
+constexpr uint32_t VERSION        = 2;
+constexpr char     MAGIC[8]       = {'M', 'E', 'S', 'A', 'C', 'K', 'P', '1'};
+// number of memory::Map in one chunk
+constexpr uint32_t MAP_CHUNK_SIZE = 1024;
+
+struct Record {
+	uint32_t sequence;
+	uint64_t offset;
+	uint64_t size;
+	uint32_t pageCount;
+	uint32_t mapChunkCount;
+	uint32_t receiveCount;
+	uint32_t diskCount;
+	CARD16   MP;
+	memory::Config::Display display;
+};
+
+struct Log {
+	uint32_t            vpSize;
+	uint32_t            rpSize;
+	uint64_t            validSize; // size of log without torn record
+	std::vector<Record> recordList;
+};
+
+// path of overlay file of disk of index saved with record of sequence of log of path
+std::string overlayPath(const std::string& path, uint32_t sequence, int index);
+
+// true if path is checkpoint log
+bool  isLog(const std::string& path);
+
+// complete record of log
+Log   scan(const std::string& path);
+
+// restore memory to latest record and return state. call instead of memory::initialize.
+// caller restores state.values after variable::initialize, and disk from overlayPath of latest record
+snapshot::State restore(const std::string& path);
+
+// write latest state of path to outputPath as log of one record. overlay file of the record is copied also
+void  compact(const std::string& path, const std::string& outputPath);
+
+class Writer {
+public:
+	Writer() : file(0), sequence(0), skipZeroPage(false), stopThread(false), busy(false) {}
+	~Writer() {
+		close();
+	}
+
+	// append to log of path if it has same memory configuration. otherwise create new log
+	// overlay of each disk in diskList is saved with each record
+	void open(const std::string& path, const std::vector<DiskOverlay*>& diskList = {});
+	// write pending record and close log
+	void close();
+	bool isOpen() const {
+		return file != 0;
+	}
+
+	// call from processor thread between instructions. copy changed memory and queue record for background thread.
+	// returns false if previous record is not written yet. page written since last record is kept for next take
+	bool take(const variable::Values& values, const std::vector<AgentNetwork::PendingReceive>& pendingReceive);
+
+private:
+	std::string              path;
+	FILE*                    file;
+	uint32_t                 sequence;
+	// true for first record of new log. memory of restored log starts with zero
+	bool                     skipZeroPage;
+	// maps of last record
+	std::vector<memory::Map> shadowMaps;
+	std::vector<DiskOverlay*> diskList;
+	// record being written and overlay file of the record. owned by background thread while busy is true
+	std::vector<uint8_t>     record;
+	std::vector<std::string> recordOverlayList;
+
+	std::thread              thread;
+	std::mutex               mutex;
+	std::condition_variable  cv;
+	bool                     stopThread; // guarded by mutex
+	bool                     busy;       // guarded by mutex
+
+	void run();
+};
+
+}
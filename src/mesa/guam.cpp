@@ -33,10 +33,17 @@
 // guam.cpp
 //
 
+#include <condition_variable>
 #include <csignal>
 #include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
 #include <thread>
 
+#include <sys/wait.h>
+#include <unistd.h>
+
 #include "../util/Util.h"
 static const Logger logger(__FILE__);
 
@@ -68,19 +75,30 @@ static const Logger logger(__FILE__);
 #include "../opcode/opcode.h"
 
 #include "../util/DiskFile.h"
+#include "../util/DiskOverlay.h"
 #include "../util/net.h"
+#include "../util/PacketCapture.h"
 #include "../util/ThreadControl.h"
+#include "../util/VirtualSwitch.h"
+#include "../util/tsc_clock.h"
 #include "../util/watchdog.h"
 
+#include "checkpoint.h"
 #include "guam.h"
+#include "snapshot.h"
 
 namespace guam {
 
 Config         config;
 
-DiskFile       diskFile;
+std::deque<DiskFile> diskFileList; // index is deviceIndex of AgentDisk
 DiskFile       floppyFile;
 net::Driver*   netDriver;
+PacketCapture  netCapture;
+checkpoint::Writer checkpointWriter;
+
+static constexpr int DEFAULT_CHECKPOINT_INTERVAL = 10'000; // in millisecond
+static constexpr std::chrono::seconds CLONE_REPORT_INTERVAL{10};
 
 // agent
 AgentDisk      disk;
@@ -176,7 +194,7 @@ static void setBootRequestPV(Boot::Request* request, CARD16 deviceOrdinal = 0) {
 	request->location.deviceType    = Device::T_anyPilotDisk;
 	request->location.deviceOrdinal = deviceOrdinal;
 }
-static void setBootRequestEther(Boot::Request* request, CARD16 deviceOrdinal = 0) {
+void setBootRequestEther(Boot::Request* request, CARD16 deviceOrdinal) {
 	request->requestBasicVersion    = Boot::currentRequestBasicVersion;
 	request->action                 = Boot::A_inLoad;
 	request->location.deviceType    = Device::T_ethernet;
@@ -198,6 +216,94 @@ static void setBootRequestStream(Boot::Request* request) {
 	request->location.deviceOrdinal = 0;
 }
 
+// overlayPath returns path of overlay file of disk of index saved with snapshot or checkpoint
+static void restoreDisk(const std::vector<snapshot::Disk>& list, std::function<std::string(int)> overlayPath) {
+	if (list.size() != diskFileList.size()) {
+		logger.fatal("disk count of snapshot  %d  %d", (int)list.size(), (int)diskFileList.size());
+		ERROR();
+	}
+	for(size_t i = 0; i < list.size(); i++) {
+		auto& diskFile = diskFileList[i];
+		if (list[i].pageSize != diskFile.getPageSize()) {
+			logger.fatal("disk size of snapshot  %d  %d  %d", (int)i, list[i].pageSize, diskFile.getPageSize());
+			ERROR();
+		}
+		// flat disk has moved on since save, and can not be rewound to time of snapshot
+		if (!list[i].overlay || !diskFile.isOverlay()) {
+			logger.fatal("disk of snapshot is not overlay  %s", diskFile.getPath());
+			ERROR();
+		}
+		// rewind overlay to time of snapshot
+		diskFile.getOverlay().load(overlayPath(i));
+	}
+}
+// overlay of each disk saved with each checkpoint record
+static std::vector<DiskOverlay*> getOverlayList() {
+	std::vector<DiskOverlay*> list;
+	for(auto& diskFile: diskFileList) list.push_back(&diskFile.getOverlay());
+	return list;
+}
+// snapshot and checkpoint rewind disk overlay to time of save. flat disk can not be rewound
+static void checkOverlay(const char* name) {
+	for(auto& diskFile: diskFileList) {
+		if (diskFile.isOverlay()) continue;
+		logger.fatal("%s needs overlay disk. create overlay by disk-image overlay  %s", name, diskFile.getPath());
+		ERROR();
+	}
+}
+static void saveSnapshot() {
+	const auto& path = config.snapshotSavePath;
+	// request in flight is lost with thread
+	if (AgentDisk::isPending() || AgentFloppy::isPending() || AgentNetwork::TransmitThread::isPending()) {
+		logger.error("snapshot is not saved because of pending io  %s", path);
+		return;
+	}
+
+	snapshot::State state;
+	state.values.set();
+	{
+		auto lock = network.lockReceive();
+		state.pendingReceive = network.getPendingReceive();
+	}
+	for(size_t i = 0; i < diskFileList.size(); i++) {
+		auto& diskFile = diskFileList[i];
+		if (!diskFile.isOverlay()) {
+			logger.error("snapshot is not saved because disk is not overlay  %s", diskFile.getPath());
+			return;
+		}
+		snapshot::Disk disk;
+		disk.pageSize = diskFile.getPageSize();
+		disk.overlay  = 1;
+		diskFile.getOverlay().save(snapshot::overlayPath(path, i));
+		state.diskList.push_back(disk);
+	}
+	snapshot::save(path, state);
+}
+
+// called from processor thread when no io is pending
+static void takeCheckpoint() {
+	// agent writes FCB through pointer without marking dirty
+	CARD32 ioRegion = agent::ioRegionPage * PageSize;
+	memory::markDirty(ioRegion, agent::getIORegion() - ioRegion);
+
+	variable::Values values;
+	values.set();
+	auto lock = network.lockReceive();
+	checkpointWriter.take(values, network.getPendingReceive());
+}
+
+static void openNetwork(const std::string& interface_, const std::string& capturePath) {
+	auto interface = interface_;
+	// port of virtual switch uses networkAddress unless address is specified
+	if (VirtualSwitch::isVirtual(interface) && interface.find(",address=") == std::string::npos) {
+		interface += ",address=" + config.networkAddress;
+	}
+	auto device = net::getDevice(interface);
+	netDriver = net::getDriver(device);
+	netDriver->open();
+	if (!capturePath.empty()) netCapture.open(capturePath, interface);
+}
+
 static std::map<std::string, CARD16> displayTypeMap = {
 	{"monochrome", DisplayIOFaceGuam::T_monochrome},
 	{"fourBitPlaneColor", DisplayIOFaceGuam::T_fourBitPlaneColor},
@@ -209,25 +315,62 @@ static void initialize() {
 	setSignalHandler(SIGHUP);
 	setSignalHandler(SIGSEGV);
 
+	// calibrate before starting threads that use tsc_clock
+	tsc_clock::calibrate();
+
 	logger.info("diskFilePath      %s", config.diskFilePath);
+	for(const auto& e: config.extraDiskFilePathList) {
+		logger.info("extraDiskFilePath %s", e);
+	}
+	logger.info("diskBackend       %s", config.diskBackend);
+	logger.info("diskFlush         %s", config.diskFlush);
 	logger.info("germFilePath      %s", config.germFilePath);
 	logger.info("bootFilePath      %s", config.bootFilePath);
 	logger.info("floppyFilePath    %s", config.floppyFilePath);
 	logger.info("networkInterface  %s", config.networkInterface);
 	logger.info("networkAddress    %s", config.networkAddress);
+	logger.info("networkCapture    %s", config.networkCapture);
 	logger.info("bootSwitch        %s", config.bootSwitch);
 	logger.info("bootDevice        %s", config.bootDevice);
 	logger.info("displayType       %s", config.displayType);
+	logger.info("snapshotLoadPath  %s", config.snapshotLoadPath);
+	logger.info("snapshotSavePath  %s", config.snapshotSavePath);
+	logger.info("checkpointPath    %s", config.checkpointPath);
+	logger.info("cpuProcessor      %s", config.cpuProcessor);
+	logger.info("cpuTimer          %s", config.cpuTimer);
+	logger.info("cpuDisk           %s", config.cpuDisk);
+	logger.info("cpuNetwork        %s", config.cpuNetwork);
+	logger.info("cloneCount     %4d", config.cloneCount);
 
 	logger.info("displayWidth   %4d", config.displayWidth);
 	logger.info("displayHeight  %4d", config.displayHeight);
 	logger.info("vmBits         %4d", config.vmBits);
 	logger.info("rmBits         %4d", config.rmBits);
+	logger.info("diskWorker     %4d", config.diskWorkerCount);
+	logger.info("diskFlushInterval %4d", config.diskFlushInterval);
+	logger.info("checkpointInterval %4d", config.checkpointInterval);
+	logger.info("memoryNode     %4d", config.memoryNode);
+
+	// memory policy is inherited by threads started after here. real memory is allocated on first touch
+	if (0 <= config.memoryNode) Util::setMemoryNode(config.memoryNode);
+
+	const bool restore = !config.snapshotLoadPath.empty();
+	const bool restoreCheckpoint = restore && checkpoint::isLog(config.snapshotLoadPath);
+	const auto timeStart = std::chrono::steady_clock::now();
+	snapshot::State snapshotState;
 
 	// start initialize
-	memory::initialize(config.vmBits, config.rmBits, agent::ioRegionPage);
+	if (restoreCheckpoint) {
+		snapshotState = checkpoint::restore(config.snapshotLoadPath);
+	} else if (restore) {
+		// memory of snapshot is read on demand
+		snapshotState = snapshot::restore(config.snapshotLoadPath);
+	} else {
+		memory::initialize(config.vmBits, config.rmBits, agent::ioRegionPage);
+	}
 	opcode::initialize();
 	variable::initialize();
+	if (restore) snapshotState.values.restore();
 	agent::initialize();
 
 	// after variable initialize, set PID from config.networkAddress
@@ -249,18 +392,21 @@ static void initialize() {
 	}
 	const display::Config& displayConfig = display::getConfig();
 
-	{
-		auto device = net::getDevice(config.networkInterface);
-		netDriver = net::getDriver(device);
-		netDriver->open();
-	}
+	openNetwork(config.networkInterface, config.networkCapture);
 
 	//
 	// Setup Agents
 	//
 	// AgentDisplay
-	// Reserve real memory for display
-	memory::reserveDisplayPage(displayConfig.pageSize);
+	// Reserve real memory for display. memory of snapshot has display already
+	if (restore) {
+		if (memoryConfig.display.pageSize != displayConfig.pageSize) {
+			logger.fatal("display page size of snapshot  %d  %d", memoryConfig.display.pageSize, displayConfig.pageSize);
+			ERROR();
+		}
+	} else {
+		memory::reserveDisplayPage(displayConfig.pageSize);
+	}
 	// configure AgentDisplay
 	display.setDisplayType(displayConfig.type);
 	display.setDisplayWidth(displayConfig.width);
@@ -268,13 +414,31 @@ static void initialize() {
 	display.setDisplayMemoryAddress(memoryConfig.display.rp);
 
 	// AgentDisk
-	diskFile.attach(config.diskFilePath);
-	disk.addDiskFile(&diskFile);
+	{
+		// first disk is deviceIndex 0
+		std::vector<std::string> pathList = {config.diskFilePath};
+		pathList.insert(pathList.end(), config.extraDiskFilePathList.begin(), config.extraDiskFilePathList.end());
+		disk.clearDiskFile();
+		for(const auto& path: pathList) {
+			auto& diskFile = diskFileList.emplace_back();
+			if (config.diskFlushInterval) diskFile.setFlushInterval(std::chrono::milliseconds(config.diskFlushInterval));
+			diskFile.attach(path, DiskFile::toBackend(config.diskBackend), DiskFile::toFlush(config.diskFlush));
+			disk.addDiskFile(&diskFile);
+		}
+		disk.setWorkerCount(config.diskWorkerCount);
+	}
+	if (restoreCheckpoint) {
+		const auto sequence = checkpoint::scan(config.snapshotLoadPath).recordList.back().sequence;
+		restoreDisk(snapshotState.diskList, [sequence](int i){ return checkpoint::overlayPath(config.snapshotLoadPath, sequence, i); });
+	} else if (restore) {
+		restoreDisk(snapshotState.diskList, [](int i){ return snapshot::overlayPath(config.snapshotLoadPath, i); });
+	}
 	// AgentFloppy
 	floppyFile.attach(config.floppyFilePath);
 	floppy.addDiskFile(&floppyFile);
 	// AgentNetwork use net::Driver
 	network.setDriver(netDriver);
+	network.setCapture(&netCapture);
 	// AgentProcessor::Initialize using PID[]
 	// set PID to AgentProcessor
 	processor.setProcessorID(PID[1], PID[2], PID[3]);
@@ -284,6 +448,14 @@ static void initialize() {
 	// bootFilePath
 	// Enable Agents
 
+	// Enable initializes FCB. keep FCB of restored memory
+	const CARD32 ioRegionStart = agent::ioRegionPage * PageSize;
+	const CARD32 ioRegionStop  = 256 * PageSize;
+	std::vector<CARD16> ioRegionSave;
+	if (restore) {
+		for(CARD32 va = ioRegionStart; va < ioRegionStop; va++) ioRegionSave.push_back(*memory::peek(va));
+	}
+
 	//
 	// Initialize Agents
 	//
@@ -321,6 +493,17 @@ static void initialize() {
 		// TODO do initialize like UserTerminalHeadGuam.mesa
 	}
 
+	if (restore) {
+		// write back FCB of restored memory
+		for(CARD32 va = ioRegionStart; va < agent::getIORegion(); va++) *memory::peek(va) = ioRegionSave[va - ioRegionStart];
+		network.setPendingReceive(snapshotState.pendingReceive);
+		processor::resume();
+
+		auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - timeStart).count();
+		logger.info("restore took %d ms", (int)duration);
+		return;
+	}
+
 	// load germ file into vm
 	loadGerm(config.germFilePath);
 
@@ -351,19 +534,34 @@ static void boot() {
 
 	std::function<void()> f1 = std::bind(&AgentNetwork::ReceiveThread::run, &network.receiveThread);
 	std::function<void()> f2 = std::bind(&AgentNetwork::TransmitThread::run, &network.transmitThread);
-	std::function<void()> f3 = std::bind(&AgentDisk::IOThread::run, &disk.ioThread);
+	std::function<void()> f3 = std::bind(&AgentFloppy::IOThread::run, &floppy.ioThread);
 	std::function<void()> f4 = std::function<void()>(processor::run_timer);
 	std::function<void()> f5 = std::function<void()>(processor::run_processor);
 
 	ThreadControl t1("receive", f1);
 	ThreadControl t2("transmit", f2);
-	ThreadControl t3("disk", f3);
+	ThreadControl t3("floppy", f3);
 	ThreadControl t4("timer", f4);
 	ThreadControl t5("processor", f5);
+	t1.setAffinity(config.cpuNetwork);
+	t2.setAffinity(config.cpuNetwork);
+	t3.setAffinity(config.cpuDisk);
+	t4.setAffinity(config.cpuTimer);
+	t5.setAffinity(config.cpuProcessor);
 
 //	t1.start();
 	t1.start();
 	t2.start();
+	// one thread for each disk worker of each disk device
+	std::deque<ThreadControl> diskThreads;
+	for(auto& device: disk.deviceList) {
+		for(uint32_t i = 0; i < device.ioThreads.size(); i++) {
+			auto name = std_sprintf("disk%d-%d", device.deviceIndex, i);
+			diskThreads.emplace_back(name.c_str(), std::bind(&AgentDisk::IOThread::run, &device.ioThreads[i]));
+			diskThreads.back().setAffinity(config.cpuDisk);
+			diskThreads.back().start();
+		}
+	}
 	t3.start();
 	t4.start();
 	t5.start();
@@ -375,6 +573,7 @@ static void boot() {
 	
 	t1.join();
 	t2.join();
+	for(auto& e: diskThreads) e.join();
 	t3.join();
 	t4.join();
 	t5.join();
@@ -382,22 +581,178 @@ static void boot() {
 	watchdog::disable();
 
 	logger.info("boot STOP");
+
+	checkpointWriter.close();
+
+	if (!config.snapshotSavePath.empty()) saveSnapshot();
+}
+
+//
+// Clone
+//
+// Fork child after processor stopped at quiescent point such as MP 8000.
+// Real memory is shared copy-on-write. Each child has own disk overlay, network driver and threads.
+// Guest of every child keeps processor ID of parent.
+// So children can not share one virtual switch. Source address of every child is same, and the switch can not
+// tell which port is the destination. Network interface of virtual switch needs %d to give each child own switch.
+static std::string clonePath(const std::string& path, int index) {
+	return std_sprintf("%s.clone%d", path, index);
+}
+static std::string cloneInterface(const std::string& interface_, int index) {
+	auto interface = interface_;
+	auto pos = interface.find("%d");
+	if (pos != std::string::npos) interface.replace(pos, 2, std::to_string(index));
+	return interface;
+}
+
+// child process of clone. prepare for next boot
+static void setupClone(int index, const std::vector<std::string>& diskPathList) {
+	logger.info("clone %d  pid %d", index, (int)getpid());
+	watchdog::afterFork();
+	perf::clear();
+
+	for(size_t i = 0; i < diskFileList.size(); i++) {
+		diskFileList[i].attach(clonePath(diskPathList[i], index));
+	}
+	floppyFile.attach(config.floppyFilePath);
+	openNetwork(cloneInterface(config.networkInterface, index), config.networkCapture.empty() ? "" : clonePath(config.networkCapture, index));
+	network.changeDriver(netDriver);
+	if (!config.checkpointPath.empty()) checkpointWriter.open(clonePath(config.checkpointPath, index), getOverlayList());
+	config.snapshotSavePath.clear();
+
+	// continue from stop point
+	processor::removeStopAtMP(MP);
+	processor::resume();
+}
+
+static void reportClone(const std::vector<std::pair<int, pid_t>>& cloneList) {
+	uint64_t totalPrivate = 0;
+	uint64_t totalShared  = 0;
+	for(const auto& [index, pid]: cloneList) {
+		Util::MemoryUsage usage;
+		if (!Util::getMemoryUsage(pid, usage)) continue;
+		logger.info("clone %2d  pid %6d  rss %s KB  private %s KB  shared %s KB", index, (int)pid,
+			formatWithCommas(usage.rss / 1024), formatWithCommas(usage.privateSize / 1024), formatWithCommas(usage.shared / 1024));
+		totalPrivate += usage.privateSize;
+		totalShared  += usage.shared;
+	}
+	logger.info("clone total  private %s KB  shared %s KB", formatWithCommas(totalPrivate / 1024), formatWithCommas(totalShared / 1024));
+}
+
+// returns index of clone in child process. returns -1 in parent process after all child exited
+static int cloneMachine() {
+	// request in flight is lost with thread
+	if (AgentDisk::isPending() || AgentFloppy::isPending() || AgentNetwork::TransmitThread::isPending()) {
+		logger.error("clone is not possible because of pending io");
+		return -1;
+	}
+
+	// overlay of each child. parent overlay is copied, flat disk becomes base of overlay
+	// overlay supports only mmap backend without flush
+	if (DiskFile::toBackend(config.diskBackend) != DiskFile::Backend::mmap || DiskFile::toFlush(config.diskFlush) != DiskFile::Flush::none) {
+		logger.warn("clone overlay ignores diskBackend %s and diskFlush %s. clone uses mmap backend and no flush",
+			config.diskBackend, config.diskFlush);
+	}
+	std::vector<std::string> diskPathList;
+	for(auto& diskFile: diskFileList) {
+		const auto path = diskFile.getPath();
+		if (!diskFile.isOverlay()) diskFile.flush();
+		for(int i = 0; i < config.cloneCount; i++) {
+			if (diskFile.isOverlay()) {
+				diskFile.getOverlay().save(clonePath(path, i));
+			} else {
+				DiskOverlay::create(clonePath(path, i), path);
+			}
+		}
+		diskPathList.push_back(path);
+	}
+	// no thread of parent other than this can touch file and device after fork
+	for(auto& diskFile: diskFileList) diskFile.detach();
+	floppyFile.detach();
+	netDriver->close();
+	netDriver = 0;
+	netCapture.close();
+
+	std::vector<std::pair<int, pid_t>> cloneList;
+	for(int i = 0; i < config.cloneCount; i++) {
+		pid_t pid;
+		CHECK_SYSCALL(pid, fork())
+		if (pid == 0) {
+			setupClone(i, diskPathList);
+			return i;
+		}
+		logger.info("clone %d  pid %d  started", i, (int)pid);
+		cloneList.emplace_back(i, pid);
+	}
+
+	// report memory usage of clone while waiting exit of clone
+	std::mutex              cloneMutex;
+	std::condition_variable cloneCV;
+	std::thread reporter([&]{
+		std::unique_lock<std::mutex> lock(cloneMutex);
+		while(!cloneList.empty()) {
+			if (cloneCV.wait_for(lock, CLONE_REPORT_INTERVAL) == std::cv_status::timeout) reportClone(cloneList);
+		}
+	});
+	for(;;) {
+		{
+			std::unique_lock<std::mutex> lock(cloneMutex);
+			if (cloneList.empty()) break;
+		}
+		int status;
+		pid_t pid = waitpid(-1, &status, 0);
+		if (pid < 0) {
+			if (errno == EINTR) continue;
+			LOG_ERRNO(errno)
+			std::unique_lock<std::mutex> lock(cloneMutex);
+			cloneList.clear();
+			break;
+		}
+		std::unique_lock<std::mutex> lock(cloneMutex);
+		auto i = std::find_if(cloneList.begin(), cloneList.end(), [pid](const auto& e) { return e.second == pid; });
+		if (i == cloneList.end()) continue;
+		if (WIFEXITED(status)) {
+			logger.info("clone %d  pid %d  exit %d", i->first, (int)pid, WEXITSTATUS(status));
+		} else {
+			logger.warn("clone %d  pid %d  status %X", i->first, (int)pid, status);
+		}
+		cloneList.erase(i);
+	}
+	cloneCV.notify_all();
+	reporter.join();
+	return -1;
 }
 
 static void finalize() {
 	// detach file or device
-	diskFile.detach();
+	for(auto& diskFile: diskFileList) diskFile.detach();
+	diskFileList.clear();
 	floppyFile.detach();
 
-	netDriver->close();
+	// parent of clone closed driver before fork
+	if (netDriver) netDriver->close();
 	netDriver = 0;
+	netCapture.close();
 
 	memory::finalize();
 }
 
 void run() {
+	// see Clone
+	if (1 < config.cloneCount && VirtualSwitch::isVirtual(config.networkInterface) && config.networkInterface.find("%d") == std::string::npos) {
+		logger.fatal("clone of virtual switch needs %%d in networkInterface  %s", config.networkInterface);
+		ERROR();
+	}
 	initialize();
+	if (!config.snapshotSavePath.empty()) checkOverlay("snapshot");
+	if (!config.checkpointPath.empty()) {
+		checkOverlay("checkpoint");
+		checkpointWriter.open(config.checkpointPath, getOverlayList());
+		int interval = config.checkpointInterval ? config.checkpointInterval : DEFAULT_CHECKPOINT_INTERVAL;
+		processor::setCheckpoint(std::chrono::milliseconds(interval), takeCheckpoint);
+	}
 	boot();
+	if (config.cloneCount && 0 <= cloneMachine()) boot();
 	finalize();
 }
 
@@ -411,4 +766,5 @@ void setPosition(int x, int y) {
 	mouse.setPosition(x, y);
 }
 
+
 }
\ No newline at end of file
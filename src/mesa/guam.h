@@ -36,6 +36,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include "Pilot.h"
 
@@ -43,21 +44,41 @@ namespace guam {
 
 struct Config {
     std::string diskFilePath;
+    std::vector<std::string> extraDiskFilePathList; // additional disk. deviceIndex is 1, 2, ...
+    std::string diskBackend;   // mmap io_uring io_uring_direct
+    std::string diskFlush;     // none periodic idle journal
     std::string germFilePath;
     std::string bootFilePath;
     std::string floppyFilePath;
     std::string networkInterface;
     std::string networkAddress;
+    std::string networkCapture; // path of pcapng file. empty for no capture
     std::string bootSwitch;
     std::string bootDevice;
     std::string displayType;
+    std::string snapshotLoadPath; // restore machine from snapshot or latest record of checkpoint log instead of boot. empty for boot
+    std::string snapshotSavePath; // save snapshot after processor stopped. empty for no snapshot. disk must be overlay
+    std::string checkpointPath;   // append incremental checkpoint to log. empty for no checkpoint. disk must be overlay
+    // cpu list such as "0-3,8" for each thread. empty for any cpu
+    std::string cpuProcessor;
+    std::string cpuTimer;
+    std::string cpuDisk;       // disk and floppy
+    std::string cpuNetwork;    // receive and transmit
+    // after processor stopped, fork cloneCount child that continue from there with own disk overlay and network.
+    // %d in networkInterface is replaced with index of clone. virtual switch needs %d when cloneCount > 1
+    // disk overlay of clone uses mmap backend without flush. diskBackend and diskFlush are ignored with warning
+    int cloneCount;
 
     int displayWidth;
     int displayHeight;
     int vmBits;
     int rmBits;
+    int diskWorkerCount;       // 0 for default
+    int diskFlushInterval;     // in millisecond. 0 for default
+    int checkpointInterval;    // in millisecond. 0 for default
+    int memoryNode;            // NUMA node of real memory. -1 for any node
 
-    Config() : displayWidth(0), displayHeight(0), vmBits(0), rmBits(0) {}
+    Config() : cloneCount(0), displayWidth(0), displayHeight(0), vmBits(0), rmBits(0), diskWorkerCount(0), diskFlushInterval(0), checkpointInterval(0), memoryNode(-1) {}
 };
 
 void setConfig(const Config& config);
@@ -65,6 +86,9 @@ void getConfig(Config& config);
 
 void run(); // don't return until all child thread stopped
 
+// boot request of bootDevice ETHER. germ sends simple boot request of bfn to address of ethernetRequest
+void setBootRequestEther(Boot::Request* request, CARD16 deviceOrdinal = 0);
+
 void keyPress   (LevelVKeys::KeyName keyName);
 void keyRelease (LevelVKeys::KeyName keyName);
 void setPosition(int x, int y);
@@ -57,6 +57,11 @@ void from_json(const json& j, guam_config::Entry::File& p) {
 	simple(germ)
 	simple(boot)
 	simple(floppy)
+	if (j.contains("diskbackend")) simple(diskbackend)
+	if (j.contains("diskworkers")) simple(diskworkers)
+	if (j.contains("diskflush"))   simple(diskflush)
+	if (j.contains("diskflushinterval")) simple(diskflushinterval)
+	if (j.contains("extradisks"))  p.extradisks = j.at("extradisks").get<std::vector<std::string>>();
 }
 void from_json(const json& j, guam_config::Entry::Boot& p) {
 	p.switch_ = j.at("switch");
@@ -65,10 +70,18 @@ void from_json(const json& j, guam_config::Entry::Boot& p) {
 void from_json(const json& j, guam_config::Entry::Memory& p) {
 	simple(vmbits)
 	simple(rmbits)
+	if (j.contains("node")) simple(node)
 }
 void from_json(const json& j, guam_config::Entry::Network& p) {
 	simple(interface)
 	simple(address)
+	if (j.contains("capture")) simple(capture)
+}
+void from_json(const json& j, guam_config::Entry::CPU& p) {
+	if (j.contains("processor")) simple(processor)
+	if (j.contains("timer"))     simple(timer)
+	if (j.contains("disk"))      simple(disk)
+	if (j.contains("network"))   simple(network)
 }
 void from_json(const json& j, guam_config::Entry& p) {
 	simple(name)
@@ -77,6 +90,7 @@ void from_json(const json& j, guam_config::Entry& p) {
 	simple(boot)
 	simple(memory)
 	simple(network)
+	if (j.contains("cpu")) simple(cpu)
 }
 
 
@@ -109,3 +123,32 @@ bool guam_config::containsEntry(const std::string& name) {
 	}
 	return false;
 }
+
+guam::Config guam_config::toConfig(const Entry& entry) {
+	guam::Config config;
+	config.diskFilePath      = entry.file.disk;
+	config.extraDiskFilePathList = entry.file.extradisks;
+	config.diskBackend       = entry.file.diskbackend;
+	config.diskFlush         = entry.file.diskflush;
+	config.diskWorkerCount   = entry.file.diskworkers;
+	config.diskFlushInterval = entry.file.diskflushinterval;
+	config.germFilePath      = entry.file.germ;
+	config.bootFilePath      = entry.file.boot;
+	config.floppyFilePath    = entry.file.floppy;
+	config.networkInterface  = entry.network.interface;
+	config.networkAddress    = entry.network.address;
+	config.networkCapture    = entry.network.capture;
+	config.bootSwitch        = entry.boot.switch_;
+	config.bootDevice        = entry.boot.device;
+	config.displayType       = entry.display.type;
+	config.displayWidth      = entry.display.width;
+	config.displayHeight     = entry.display.height;
+	config.vmBits            = entry.memory.vmbits;
+	config.rmBits            = entry.memory.rmbits;
+	config.memoryNode        = entry.memory.node;
+	config.cpuProcessor      = entry.cpu.processor;
+	config.cpuTimer          = entry.cpu.timer;
+	config.cpuDisk           = entry.cpu.disk;
+	config.cpuNetwork        = entry.cpu.network;
+	return config;
+}
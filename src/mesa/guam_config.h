@@ -37,6 +37,9 @@
 
 #include <string>
 #include <deque>
+#include <vector>
+
+#include "guam.h"
 
 class guam_config {
 public:
@@ -57,8 +60,13 @@ public:
 			std::string germ;
 			std::string boot;
 			std::string floppy;
+			std::string diskbackend; // optional. mmap io_uring io_uring_direct
+			int         diskworkers; // optional. number of disk io thread
+			std::string diskflush;   // optional. none periodic idle journal
+			int         diskflushinterval; // optional. in millisecond
+			std::vector<std::string> extradisks; // optional. additional disk
 
-			File() : disk(""), germ(""), boot(""), floppy("") {}
+			File() : disk(""), germ(""), boot(""), floppy(""), diskbackend(""), diskworkers(0), diskflush(""), diskflushinterval(0) {}
 		};
 
 		class Boot {
@@ -73,16 +81,29 @@ public:
 		public:
 			int vmbits;
 			int rmbits;
+			int node;   // optional. NUMA node of real memory. -1 for any node
 
-			Memory() : vmbits(0), rmbits(0) {}
+			Memory() : vmbits(0), rmbits(0), node(-1) {}
 		};
 
 		class Network {
 		public:
 			std::string interface;
   			std::string address;
+			std::string capture; // optional. path of pcapng file
 
-			Network() : interface(""), address("") {}
+			Network() : interface(""), address(""), capture("") {}
+		};
+
+		// optional. cpu list such as "0-3,8" for each thread. empty for any cpu
+		class CPU {
+		public:
+			std::string processor;
+			std::string timer;
+			std::string disk;
+			std::string network;
+
+			CPU() : processor(""), timer(""), disk(""), network("") {}
 		};
 
 		std::string name;
@@ -91,8 +112,9 @@ public:
 		Boot    boot;
 		Memory  memory;
 		Network network;
+		CPU     cpu;
 
-		Entry() : name(""), display(), file(), boot(), memory(), network() {}
+		Entry() : name(""), display(), file(), boot(), memory(), network(), cpu() {}
 	};
 
 	std::deque<guam_config::Entry>  entryList;
@@ -107,4 +129,7 @@ public:
 	
 	Entry getEntry(const std::string& name);
 	bool containsEntry(const std::string& name);
+
+	// guam::Config of entry. field not in entry, such as snapshot and checkpoint, has default value
+	static guam::Config toConfig(const Entry& entry);
 };
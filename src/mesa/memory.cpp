@@ -33,6 +33,11 @@
 // memory.cpp
 //
 
+#include <atomic>
+#include <vector>
+
+#include <sys/mman.h>
+
 #include "../util/Util.h"
 static const Logger logger(__FILE__);
 
@@ -51,18 +56,46 @@ const Config& getConfig() {
 constexpr int MAX_REALMEMORY_PAGE_SIZE = RealMemoryImplGuam::largestArraySize * WordSize;
 constexpr int VMBITS_MIN               = 20;
 constexpr int VMBITS_MAX               = 25;
+constexpr size_t PAGES_ALIGNMENT        = 4096;
 
 Map*    maps      = 0;
 CARD16* pages     = 0;
 Page**  realPage  = 0;
+// true if pages is mapped from snapshot
+bool    pagesMapped = false;
+// bit of real page written since last clearDirty
+std::vector<uint64_t> dirty;
 
 static void initializeVariables() {
 	maps     = 0;
 	pages    = 0;
 	realPage = 0;
+	pagesMapped = false;
+	dirty.clear();
 	config.clear();
 }
 
+static void markDirtyRealPage(CARD32 rp) {
+	std::atomic_ref<uint64_t> word(dirty[rp / 64]);
+	const uint64_t bit = 1ULL << (rp % 64);
+	// avoid write of shared cache line when bit is already set
+	if ((word.load(std::memory_order_relaxed) & bit) == 0) word.fetch_or(bit, std::memory_order_relaxed);
+}
+static void setupDirty() {
+	// first checkpoint contains every page
+	dirty.assign((config.rpSize + 63) / 64, ~0ULL);
+}
+
+static size_t pagesByteSize() {
+	return sizeof(CARD16) * config.rpSize * PageSize;
+}
+static void setupRealPage() {
+	realPage = new Page*[config.rpSize];
+	for(CARD32 i = 0; i < config.rpSize; i++) {
+		realPage[i] = (Page *)(pages + i * PageSize);
+	}
+}
+
 //  From APilot/15.3/Pilot/Private/GermOpsImpl.mesa
 //	The BOOTING ACTION defined by the Principles of Operation should include:
 //	   1. Put real memory behind any special processor pages (I/O pages);
@@ -91,16 +124,14 @@ void initialize(int vmBits, int rmBits, CARD16 ioRegionPage) {
 //	logger.info("vmBist = %d  vpSize = %6d  %4X", vmBits, vpSize, vpSize);
 //	logger.info("rmBist = %d  rpSize = %6d  %4X", rmBits, rpSize, rpSize);
 
-	// allocate pages.
-	pages = new CARD16[config.rpSize * PageSize];
+	// allocate pages. align to host page for O_DIRECT disk io
+	pages = new (std::align_val_t(PAGES_ALIGNMENT)) CARD16[config.rpSize * PageSize];
 	// initialize for valgrind
 	memset(pages, 0, sizeof(CARD16) * config.rpSize * PageSize);
 
 	// allocate realPage and assign their values.
-	realPage = new Page*[config.rpSize];
-	for(CARD32 i = 0; i < config.rpSize; i++) {
-		realPage[i] = (Page *)(pages + i * PageSize);
-	}
+	setupRealPage();
+	setupDirty();
 
 	MapFlags vacant = {6};
 	MapFlags clear = {0};
@@ -137,11 +168,75 @@ void initialize(int vmBits, int rmBits, CARD16 ioRegionPage) {
 void finalize() {
 	delete[] maps;
 	delete[] realPage;
-	delete[] pages;
+	if (pagesMapped) {
+		int ret;
+		CHECK_SYSCALL(ret, munmap(pages, pagesByteSize()))
+	} else {
+		::operator delete[](pages, std::align_val_t(PAGES_ALIGNMENT));
+	}
 
 	initializeVariables();
 }
 
+const Map* getMaps() {
+	return maps;
+}
+CARD16* getPages() {
+	return pages;
+}
+
+void restore(const Config& config_, const Map* maps_, int fd, uint64_t pagesOffset) {
+	if (config.vpSize) ERROR();
+	if (pagesOffset % PAGES_ALIGNMENT) ERROR();
+
+	initializeVariables();
+	config = config_;
+
+	// private mapping. write of guest never goes back to snapshot file
+	void* page = (fd < 0) ?
+		mmap(nullptr, pagesByteSize(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) :
+		mmap(nullptr, pagesByteSize(), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, (off_t)pagesOffset);
+	if (page == MAP_FAILED) {
+		int errNo = errno;
+		logger.fatal("mmap failed  offset = %lu  size = %lu", (unsigned long)pagesOffset, (unsigned long)pagesByteSize());
+		LOG_ERRNO(errNo)
+		ERROR();
+	}
+	pages       = (CARD16*)page;
+	pagesMapped = true;
+	setupRealPage();
+	setupDirty();
+
+	maps = new Map[config.vpSize];
+	std::copy(maps_, maps_ + config.vpSize, maps);
+
+	if (config.display.pageSize) config.display.bitmap = realPage[config.display.rp]->word;
+
+	cache::initialize();
+	logger.info("%s  vpSize = %X  rpSize = %X", __FUNCTION__, config.vpSize, config.rpSize);
+}
+
+void markDirty(CARD32 va, CARD32 size) {
+	if (size == 0) return;
+	const CARD32 vpStart = va / PageSize;
+	const CARD32 vpStop  = (va + size - 1) / PageSize;
+	if (config.vpSize <= vpStop) ERROR();
+	for(CARD32 vp = vpStart; vp <= vpStop; vp++) {
+		Map map = maps[vp];
+		if (!map.mf.isVacant()) markDirtyRealPage(map.rp);
+	}
+}
+const uint64_t* getDirty() {
+	return dirty.data();
+}
+void clearDirty() {
+	std::fill(dirty.begin(), dirty.end(), 0);
+	// next store through cache goes to storeMaintainFlag and marks page again
+	for(CARD32 i = 0; i < cache::N_ENTRY; i++) {
+		cache::entry[i].flagStore = 0;
+	}
+}
+
 void reserveDisplayPage(int displayPageSize) {
 	config.display.pageSize = displayPageSize;
 
@@ -232,6 +327,7 @@ CARD16* StorePage(CARD32 vp) {
 	}
 	Page* page = realPage[map.rp];
 	if (page == 0) ERROR();
+	markDirtyRealPage(map.rp);
 	//
 	return page->word ;
 }
@@ -268,6 +364,7 @@ void setReferencedDirtyFlag(CARD32 vp) {
 	Map *p = maps + vp;
 	p->mf.referenced = 1;
 	p->mf.dirty      = 1;
+	markDirtyRealPage(p->rp);
 }
 
 Map ReadMap(CARD32 vp) {
@@ -291,6 +388,7 @@ namespace cache {
 	uint64_t  missConflict = 0;
 	uint64_t  missEmpty    = 0;
 	uint64_t  hit          = 0;
+	uint64_t  storeCount   = 0;
 	Entry     entry[N_ENTRY];
 
 	void initialize() {
@@ -300,6 +398,7 @@ namespace cache {
 		hit          = 0;
 		missEmpty    = 0;
 		missConflict = 0;
+		storeCount   = 0;
 	}
 	void invalidate(CARD32 vp_) {
 		Entry *p = getEntry(vp_);
@@ -309,11 +408,15 @@ namespace cache {
 			p->page = 0;
 		}
 	}
-	void stats() {
+	int getUsedCount() {
 		int used = 0;
 		for(CARD32 i = 0; i < N_ENTRY; i++) {
 			if (entry[i].vpno) used++;
 		}
+		return used;
+	}
+	void stats() {
+		int used = getUsedCount();
 
 		if (PERF_ENABLE) {
 			uint64_t total = (missEmpty + missConflict) + hit;
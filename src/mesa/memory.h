@@ -110,6 +110,22 @@ CARD16* StorePage(CARD32 vp);
 void    initialize(int vmBits, int rmBits, CARD16 ioRegionPage);
 void    finalize();
 
+// for snapshot. maps has config.vpSize entries and pages has config.rpSize pages
+const Map*    getMaps();
+CARD16*       getPages();
+// initialize from snapshot instead of initialize.
+// pages are mapped copy-on-write from fd at pagesOffset, so each host page is read when touched first.
+// pages are zero filled if fd is negative
+void    restore(const Config& config, const Map* maps, int fd, uint64_t pagesOffset);
+
+// for checkpoint. bitmap of real page that can be written since last clearDirty.
+// all bits are set after initialize and restore.
+// peek doesn't mark page. agent that writes guest memory through pointer of peek calls markDirty. size is in word.
+// markDirty can be called from any thread. clearDirty must be called from processor thread
+void            markDirty(CARD32 va, CARD32 size);
+const uint64_t* getDirty();
+void            clearDirty();
+
 CARD16* peek(CARD32 va);
 bool    isVacant(CARD32 va); // not virtual page but virtual address
 //
@@ -165,6 +181,10 @@ extern uint64_t   hit;
 extern uint64_t   missConflict;
 extern uint64_t   missEmpty;
 extern Entry      entry[N_ENTRY];
+// number of store through cache. processor use this value to detect spin loop without store
+//   STORE_COUNT_ENABLE false removes count from store and disables idle detection of processor
+static const bool STORE_COUNT_ENABLE = true;
+extern uint64_t   storeCount;
 
 inline Entry* getEntry(CARD32 vp_) {
 	return entry + hash(vp_);
@@ -173,6 +193,7 @@ inline Entry* getEntry(CARD32 vp_) {
 void initialize();
 void invalidate(CARD32 vp_);
 void stats();
+int  getUsedCount(); // number of entry that has page
 
 void fetchSetup(Entry *p, CARD32 vp);
 void fetchMaintainFlag(Entry *p, CARD32 vp);
@@ -191,6 +212,7 @@ inline CARD16* fetch(CARD32 va) {
 void storeSetup(Entry *p, CARD32 vp);
 void storeMaintainFlag(Entry *p, CARD32 vp);
 inline CARD16* store(CARD32 va) {
+	if (STORE_COUNT_ENABLE) storeCount++;
 	const CARD32 vp = va / PageSize;
 	Entry *p = getEntry(vp);
 	if (p->vpno != vp) {
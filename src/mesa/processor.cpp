@@ -36,6 +36,7 @@
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <map>
 #include <mutex>
 #include <set>
 #include <thread>
@@ -46,14 +47,18 @@
 static const Logger logger(__FILE__);
 
 #include "../agent/AgentDisk.h"
+#include "../agent/AgentFloppy.h"
 #include "../agent/AgentNetwork.h"
 
 #include "../opcode/opcode.h"
 
+#include "memory.h"
 #include "processor.h"
 #include "Variable.h"
 
+#include "../util/guest_clock.h"
 #include "../util/Perf.h"
+#include "../util/tsc_clock.h"
 #include "../util/trace.h"
 #include "../util/watchdog.h"
 
@@ -62,10 +67,20 @@ namespace processor {
 
 bool                    stopThread;
 std::set<CARD16>        stopAtMPSet;
+static bool             resumeFlag = false;
+
+static std::chrono::milliseconds             checkpointInterval;
+static std::function<void()>                 checkpointAction;
+static std::chrono::steady_clock::time_point checkpointTime;
 
 static std::chrono::steady_clock::time_point NO_TIME = std::chrono::steady_clock::time_point::min();
 static std::chrono::steady_clock::time_point time_0900 = NO_TIME;
 static std::chrono::steady_clock::time_point time_8000 = NO_TIME;
+// guest clock time at MP 0900 and 8000
+static std::chrono::steady_clock::time_point guest_0900 = NO_TIME;
+static std::chrono::steady_clock::time_point guest_8000 = NO_TIME;
+// time when MP is shown first time
+static std::map<CARD16, std::chrono::steady_clock::time_point> mpTimeMap;
 
 void stop() {
 	logger.info("processor::stop");
@@ -73,17 +88,37 @@ void stop() {
     stopThread = true;
 }
 
+void resume() {
+	resumeFlag = true;
+}
+
+void setCheckpoint(std::chrono::milliseconds interval, std::function<void()> action) {
+	checkpointInterval = interval;
+	checkpointAction   = action;
+}
+
 void stopAtMP(CARD16 mp) {
     stopAtMPSet.insert(mp);
 	logger.info("stopAtMP %4d", mp);
 }
+void removeStopAtMP(CARD16 mp) {
+    stopAtMPSet.erase(mp);
+	logger.info("removeStopAtMP %4d", mp);
+}
 void mp_observer(CARD16 mp) {
+	if (!mpTimeMap.contains(mp)) mpTimeMap[mp] = std::chrono::steady_clock::now();
     if (stopAtMPSet.contains(mp)) {
 		logger.info("stop at MP %4d", mp);
 		stop();
 	}
-	if (mp ==  900) time_0900 = std::chrono::steady_clock::now();
-	if (mp == 8000) time_8000 = std::chrono::steady_clock::now();
+	if (mp ==  900) {
+		time_0900  = std::chrono::steady_clock::now();
+		guest_0900 = guest_clock::now();
+	}
+	if (mp == 8000) {
+		time_8000  = std::chrono::steady_clock::now();
+		guest_8000 = guest_clock::now();
+	}
 }
 
 std::string getBootTime() {
@@ -108,8 +143,18 @@ std::string getBootTime() {
 		bootDuration = std_sprintf("%d.%03d", seconds, milliSeconds);
 	}
 	auto ret = std_sprintf("Boot started at %s  It took %s seconds", bootAt, bootDuration);
+	if (guest_clock::isEnabled()) {
+		auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(guest_8000 - guest_0900).count();
+		auto seconds = duration / 1'000;
+		auto milliSeconds = duration % 1'000;
+		ret += std_sprintf("  guest time %d.%03d seconds", seconds, milliSeconds);
+	}
 	return ret;
 }
+std::chrono::steady_clock::time_point getMPTime(CARD16 mp) {
+	auto i = mpTimeMap.find(mp);
+	return i == mpTimeMap.end() ? NO_TIME : i->second;
+}
 std::string getElapsedTime() {
 	if (time_0900 == NO_TIME) return "Before boot";
 	auto milliSeconds = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - time_0900).count();
@@ -150,24 +195,133 @@ std::condition_variable rescheduleCV;
 std::atomic_bool        timeoutFlag;
 std::atomic_bool        interruptFlag;
 
+// wakeupCount and wakeupTime are guarded by reschuduleMutex
+static uint64_t                              wakeupCount;
+static std::chrono::steady_clock::time_point wakeupTime;
+
+static void notifyWakeup() {
+	wakeupCount++;
+	if (PERF_ENABLE) wakeupTime = tsc_clock::now();
+	rescheduleCV.notify_one();
+}
+
+//
+// Virtual time mode
+//
+// When processor has nothing to do and there is no pending disk or network transmit request,
+// nothing can happen until next timer tick. So advance guest clock to next timer tick instead of waiting.
+// Don't hold timerMutex while acquiring reschuduleMutex to avoid dead lock.
+static std::mutex                            timerMutex;
+static std::condition_variable               timerCV;
+static std::chrono::steady_clock::time_point timerNextTime; // guarded by timerMutex
+
+static bool pendingIO() {
+	return AgentDisk::isPending() || AgentFloppy::isPending() || AgentNetwork::TransmitThread::isPending();
+}
+// request in flight is not part of checkpoint. try again at next timer tick
+static void checkpoint() {
+	auto now = std::chrono::steady_clock::now();
+	if (now < checkpointTime) return;
+	if (pendingIO()) return;
+	checkpointAction();
+	checkpointTime = std::chrono::steady_clock::now() + checkpointInterval;
+}
+// caller must hold reschuduleMutex
+static void fastForward() {
+	if (!guest_clock::isEnabled()) return;
+	if (timeoutFlag || interruptFlag) return;
+	if (pendingIO()) return;
+
+	std::unique_lock<std::mutex> lock(timerMutex);
+	auto duration = std::chrono::duration_cast<std::chrono::microseconds>(timerNextTime - guest_clock::now());
+	if (duration.count() <= 0) return;
+	PERF_COUNT(processor, fastForward)
+	PERF_ADD(processor, fastForward_time, duration.count())
+	guest_clock::advance(duration);
+	timerCV.notify_one();
+}
+
+//
+// Idle detection
+//
+// idle detection needs store count of page cache
+static constexpr bool IDLE_ENABLE = memory::cache::STORE_COUNT_ENABLE;
+
+bool SpinDetector::check() {
+	if (savedPC < PC) return false; // not a backward branch
+
+	CARD32 cb_ = CB;
+	if (cb_ == cb && PC == pc && memory::cache::storeCount == storeCount && IT.getReadCount() == readCount) {
+		if (++count < IDLE_SPIN_THRESHOLD) return false;
+		count = 0;
+		return true;
+	}
+	cb         = cb_;
+	pc         = PC;
+	storeCount = memory::cache::storeCount;
+	readCount  = IT.getReadCount();
+	count      = 0;
+	return false;
+}
+
+static void idle() {
+	auto time_start = tsc_clock::now();
+	std::chrono::steady_clock::time_point time_wakeup;
+	{
+		std::unique_lock<std::mutex> lock(reschuduleMutex);
+		// don't park when there is pending request
+		if ((timeoutFlag || interruptFlag) && InterruptsEnabled()) return;
+
+		PERF_COUNT(processor, idle)
+		TRACE_REC_(processor, idle)
+
+		auto count = wakeupCount;
+		while(count == wakeupCount) {
+			if (stopThread) break;
+			fastForward();
+			rescheduleCV.wait_for(lock, Util::ONE_SECOND);
+		}
+		time_wakeup = wakeupTime;
+	}
+	if (PERF_ENABLE) {
+		auto time_stop = tsc_clock::now();
+		PERF_ADD(processor, idle_time, std::chrono::duration_cast<std::chrono::microseconds>(time_stop - time_start).count())
+		if (time_start < time_wakeup) {
+			PERF_ADD(processor, idle_wakeup_time, std::chrono::duration_cast<std::chrono::microseconds>(time_stop - time_wakeup).count())
+		}
+	}
+}
+
 void run_processor() {
 	logger.info("processor::run START");
 	stopThread              = false;
 	time_0900               = NO_TIME;
 	time_8000               = NO_TIME;
 
-	TaggedControlLink bootLink = {SD + OFFSET_SD(sBoot)};
-	XFER(bootLink.u, 0, XferType::call, 0);
-	logger.info("bootLink  data  %04X   tag  %d", bootLink.data + 0, bootLink.tag + 0);
+	if (resumeFlag) {
+		resumeFlag = false;
+		logger.info("resume  MP  %4d", (CARD16)MP);
+		// observer of MP sees restored value as if it is just written
+		mp_observer(MP);
+	} else {
+		TaggedControlLink bootLink = {SD + OFFSET_SD(sBoot)};
+		XFER(bootLink.u, 0, XferType::call, 0);
+		logger.info("bootLink  data  %04X   tag  %d", bootLink.data + 0, bootLink.tag + 0);
+	}
 	logger.info("GFI = %04X  CB  = %08X  GF  = %08X", GFI, CB, GF);
 	logger.info("LF  = %04X  PC  = %04X      MDS = %08X", LF, PC, MDS);
 
 	watchdog::Watchdog watchdog("processor", std::chrono::milliseconds(cTick * 2), watchdogAction);
 	watchdog::insert(&watchdog);
 
-	interruptFlag = false;
+	// restored machine can have pending interrupt
+	interruptFlag = WP.pending();
 	timeoutFlag = false;
 
+	SpinDetector spinDetector;
+
+	checkpointTime = std::chrono::steady_clock::now() + checkpointInterval;
+
 	running.timeStart();
 	try {
 		if ((timeoutFlag || interruptFlag) && InterruptsEnabled()) goto reschedule;
@@ -196,6 +350,7 @@ reschedule_continue:
 				PTC++;
 				if (PTC == 0) PTC++;
 				timeout = TimeoutScan();
+				if (checkpointAction) checkpoint();
 			}
 			if (interrupt || timeout) {
 				PERF_COUNT(processor, reschedule_YES)
@@ -219,6 +374,7 @@ execute_continue:
 		} catch (Abort& e) {
 			PERF_COUNT(processor, abort)
 		}
+		if (IDLE_ENABLE && spinDetector.check()) idle();
 		if ((timeoutFlag || interruptFlag) && InterruptsEnabled()) goto reschedule;
 		if (running) goto execute_continue;
 		else goto wait;
@@ -230,6 +386,7 @@ wait_continue:
 		if (stopThread) goto exitLoop;
 		{
 			std::unique_lock<std::mutex> lock(reschuduleMutex);
+			fastForward();
 			rescheduleCV.wait_for(lock, Util::ONE_SECOND);
 		}
 		if ((timeoutFlag || interruptFlag) && InterruptsEnabled()) goto reschedule;
@@ -247,27 +404,44 @@ exitLoop:
 	running.timeStop();
 	watchdog::remove(&watchdog);
 
+	if (PERF_ENABLE && perf::processor::idle) {
+		auto idleTime = perf::processor::idle_time / 1000;
+		auto latency  = perf::processor::idle_wakeup_time / perf::processor::idle;
+		logger.info("idle  %s times  %s ms  average wakeup latency %s us",
+			formatWithCommas(perf::processor::idle), formatWithCommas(idleTime), formatWithCommas(latency));
+	}
+
 	// stop relevant thread
 	AgentNetwork::ReceiveThread::stop();
 	AgentNetwork::TransmitThread::stop();
 	AgentDisk::IOThread::stop();
+	AgentFloppy::IOThread::stop();
 
 	logger.info("processor::run STOP");
 }
 
 void run_timer() {
 	auto tick = std::chrono::milliseconds(cTick);
-	auto time = std::chrono::steady_clock::now();
+	auto time = guest_clock::now();
 
 	for(;;) {
 		if (stopThread) break;
 		auto nextTime = time + tick;
-		std::this_thread::sleep_until(nextTime);
+		{
+			// wait until guest clock reaches nextTime. fastForward() can advance guest clock while waiting.
+			std::unique_lock<std::mutex> lock(timerMutex);
+			timerNextTime = nextTime;
+			for(;;) {
+				auto now = guest_clock::now();
+				if (nextTime <= now || stopThread) break;
+				timerCV.wait_for(lock, nextTime - now);
+			}
+		}
 		time = nextTime;
 		std::unique_lock<std::mutex> lock(reschuduleMutex);
 		PERF_COUNT(processor, timeoutRequest)
 		timeoutFlag = true;
-		rescheduleCV.notify_one();
+		notifyWakeup();
 	}
 }
 
@@ -276,7 +450,7 @@ void notifyInterrupt(CARD16 value) {
     WP |= value;
 	std::unique_lock<std::mutex> lock(reschuduleMutex);
 	interruptFlag = true;
-	rescheduleCV.notify_one();
+	notifyWakeup();
 }
 
 }
\ No newline at end of file
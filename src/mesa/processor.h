@@ -35,6 +35,8 @@
 
 #pragma once
 
+#include <chrono>
+#include <functional>
 #include <string>
 
 #include "MesaBasic.h"
@@ -44,14 +46,42 @@ namespace processor {
 void stop();
 
 void stopAtMP(CARD16 mp);
+void removeStopAtMP(CARD16 mp);
 void mp_observer(CARD16 mp);
 
 std::string getBootTime();     // time between 0900 and 8000
 std::string getElapsedTime();  // elaplsed time from 0900
+// steady clock time when mp is shown first time. time_point::min() if mp is not shown yet
+std::chrono::steady_clock::time_point getMPTime(CARD16 mp);
+
+// next run_processor continues from restored registers instead of boot link
+void resume();
+
+// call action from processor thread between instructions every interval when no io is pending
+void setCheckpoint(std::chrono::milliseconds interval, std::function<void()> action);
 
 void run_processor();
 void run_timer();
 
 void notifyInterrupt(CARD16 value);
 
+// Pilot can spin in a short loop that jumps backward to same PC without any store to memory.
+// Nothing can change the outcome of such loop until next timer tick or interrupt.
+// So processor thread parks until next timer tick or notifyInterrupt.
+// Loop that reads IT with RRIT is busy wait for short time, such as delay of device. It is not parked.
+static constexpr uint32_t IDLE_SPIN_THRESHOLD = 50'000;
+
+class SpinDetector {
+	CARD32   cb;
+	CARD16   pc;
+	uint64_t storeCount;
+	uint64_t readCount; // read of IT by guest
+	uint32_t count;
+public:
+	SpinDetector() : cb(0), pc(0), storeCount(0), readCount(0), count(0) {}
+
+	// call after each instruction. return true when processor is spinning
+	bool check();
+};
+
 }
\ No newline at end of file
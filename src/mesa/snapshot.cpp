@@ -0,0 +1,241 @@
+/*******************************************************************************
+ * Copyright (c) 2025, Yasuhiro Hasegawa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+
+//
+// snapshot.cpp
+//
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../util/Util.h"
+static const Logger logger(__FILE__);
+
+#include "memory.h"
+#include "snapshot.h"
+
+namespace snapshot {
+
+struct Header {
+	char      magic[8];
+	uint32_t  version;
+	uint32_t  headerSize;
+	// memory::Config
+	uint32_t  vpSize;
+	uint32_t  rpSize;
+	int32_t   displayPageSize;
+	int32_t   displayVP;
+	int32_t   displayRP;
+	uint32_t  receiveCount;
+	uint32_t  diskCount;
+	uint32_t  reserved;
+	uint64_t  mapsOffset;
+	uint64_t  receiveOffset;
+	uint64_t  diskOffset;
+	uint64_t  pagesOffset;
+	Registers registers;
+};
+
+Registers toRegisters(const variable::Values& values) {
+	Registers registers;
+	registers.MP  = values.MP;
+	registers.WP  = values.WP;
+	registers.WDC = values.WDC;
+	registers.PTC = values.PTC;
+	registers.XTS = values.XTS;
+	registers.PSB = values.PSB;
+	registers.MDS = values.MDS;
+	registers.LF  = values.LF;
+	registers.GF  = values.GF;
+	registers.CB  = values.CB;
+	registers.GFI = values.GFI;
+	registers.PC  = values.PC;
+	registers.SP  = values.SP;
+	registers.savedPC = values.savedPC;
+	registers.savedSP = values.savedSP;
+	for(int i = 0; i < StackDepth; i++) registers.stack[i] = values.stack[i];
+	registers.breakByte = values.breakByte;
+	registers.running   = values.running;
+	return registers;
+}
+variable::Values toValues(const Registers& registers) {
+	variable::Values values;
+	values.MP  = registers.MP;
+	values.WP  = registers.WP;
+	values.WDC = registers.WDC;
+	values.PTC = registers.PTC;
+	values.XTS = registers.XTS;
+	values.PSB = registers.PSB;
+	values.MDS = registers.MDS;
+	values.LF  = registers.LF;
+	values.GF  = registers.GF;
+	values.CB  = registers.CB;
+	values.GFI = registers.GFI;
+	values.PC  = registers.PC;
+	values.SP  = registers.SP;
+	values.savedPC = registers.savedPC;
+	values.savedSP = registers.savedSP;
+	for(int i = 0; i < StackDepth; i++) values.stack[i] = registers.stack[i];
+	values.breakByte = registers.breakByte;
+	values.running   = registers.running;
+	return values;
+}
+
+static uint64_t roundUp(uint64_t value, uint64_t unit) {
+	return ((value + unit - 1) / unit) * unit;
+}
+
+static Header readHeader(std::ifstream& ifs, const std::string& path) {
+	Header header;
+	if (!ifs.read((char*)&header, sizeof(header))) {
+		logger.error("cannot read header  %s", path);
+		ERROR();
+	}
+	if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+		logger.error("not snapshot  %s", path);
+		ERROR();
+	}
+	if (header.version != VERSION || header.headerSize != sizeof(Header)) {
+		logger.error("unexpected version  %d  %d", header.version, header.headerSize);
+		ERROR();
+	}
+	return header;
+}
+
+std::string overlayPath(const std::string& path, int index) {
+	return std_sprintf("%s.disk%d", path, index);
+}
+
+bool isSnapshot(const std::string& path) {
+	std::ifstream ifs(path, std::ios::in | std::ios::binary);
+	char magic[sizeof(MAGIC)];
+	if (!ifs.read(magic, sizeof(magic))) return false;
+	return memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+void save(const std::string& path, const State& state) {
+	const auto& config = memory::getConfig();
+	if (config.vpSize == 0) ERROR();
+
+	Header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version         = VERSION;
+	header.headerSize      = sizeof(Header);
+	header.vpSize          = config.vpSize;
+	header.rpSize          = config.rpSize;
+	header.displayPageSize = config.display.pageSize;
+	header.displayVP       = config.display.vp;
+	header.displayRP       = config.display.rp;
+	header.receiveCount    = state.pendingReceive.size();
+	header.diskCount       = state.diskList.size();
+	header.mapsOffset      = sizeof(Header);
+	header.receiveOffset   = header.mapsOffset    + sizeof(memory::Map) * header.vpSize;
+	header.diskOffset      = header.receiveOffset + sizeof(AgentNetwork::PendingReceive) * header.receiveCount;
+	header.pagesOffset     = roundUp(header.diskOffset + sizeof(Disk) * header.diskCount, PAGES_ALIGNMENT);
+	header.registers       = toRegisters(state.values);
+
+	const uint64_t pagesByteSize = sizeof(CARD16) * (uint64_t)config.rpSize * PageSize;
+	{
+		std::ofstream ofs(path, std::ios::out | std::ios::binary | std::ios::trunc);
+		ofs.write((const char*)&header, sizeof(header));
+		ofs.write((const char*)memory::getMaps(), sizeof(memory::Map) * header.vpSize);
+		ofs.write((const char*)state.pendingReceive.data(), sizeof(AgentNetwork::PendingReceive) * header.receiveCount);
+		ofs.write((const char*)state.diskList.data(), sizeof(Disk) * header.diskCount);
+		ofs.seekp(header.pagesOffset);
+
+		// skip all-zero host page to make file sparse
+		const uint32_t BLOCK_SIZE = 4096;
+		const uint8_t* pages = (const uint8_t*)memory::getPages();
+		for(uint64_t offset = 0; offset < pagesByteSize; offset += BLOCK_SIZE) {
+			if (Util::isZero(pages + offset, BLOCK_SIZE)) {
+				ofs.seekp(BLOCK_SIZE, std::ios::cur);
+			} else {
+				ofs.write((const char*)pages + offset, BLOCK_SIZE);
+			}
+		}
+		if (!ofs) {
+			logger.error("write failed  %s", path);
+			ERROR();
+		}
+	}
+	// extend file for trailing zero pages
+	std::filesystem::resize_file(path, header.pagesOffset + pagesByteSize);
+
+	logger.info("snapshot::save  %s  MP %4d  receive %d  disk %d", path, header.registers.MP, header.receiveCount, header.diskCount);
+}
+
+State restore(const std::string& path) {
+	std::ifstream ifs(path, std::ios::in | std::ios::binary);
+	auto header = readHeader(ifs, path);
+
+	memory::Config config;
+	config.vpSize           = header.vpSize;
+	config.rpSize           = header.rpSize;
+	config.display.pageSize = header.displayPageSize;
+	config.display.vp       = header.displayVP;
+	config.display.rp       = header.displayRP;
+
+	std::vector<memory::Map> maps(header.vpSize);
+	State state;
+	state.pendingReceive.resize(header.receiveCount);
+	state.diskList.resize(header.diskCount);
+
+	ifs.seekg(header.mapsOffset);
+	ifs.read((char*)maps.data(), sizeof(memory::Map) * header.vpSize);
+	ifs.seekg(header.receiveOffset);
+	ifs.read((char*)state.pendingReceive.data(), sizeof(AgentNetwork::PendingReceive) * header.receiveCount);
+	ifs.seekg(header.diskOffset);
+	ifs.read((char*)state.diskList.data(), sizeof(Disk) * header.diskCount);
+	if (!ifs) {
+		logger.error("read failed  %s", path);
+		ERROR();
+	}
+
+	{
+		int fd;
+		CHECK_SYSCALL(fd, ::open(path.c_str(), O_RDONLY))
+		memory::restore(config, maps.data(), fd, header.pagesOffset);
+		// mapping keeps reference of file
+		::close(fd);
+	}
+
+	state.values = toValues(header.registers);
+
+	logger.info("snapshot::restore  %s  MP %4d  receive %d  disk %d", path, header.registers.MP, header.receiveCount, header.diskCount);
+	return state;
+}
+
+}
@@ -0,0 +1,115 @@
+/*******************************************************************************
+ * Copyright (c) 2025, Yasuhiro Hasegawa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+
+//
+// snapshot.h
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "MesaBasic.h"
+#include "Variable.h"
+
+#include "../agent/AgentNetwork.h"
+
+// Snapshot of whole machine
+//   Save after processor thread is stopped and restore before processor thread is started.
+//   Real memory pages are placed at end of file aligned to PAGES_ALIGNMENT. restore maps them copy-on-write,
+//   so each host page is read from file when it is touched first time and snapshot file is never modified.
+//   All-zero host page is written as hole.
+//
+//   offset                  contents
+//   0                       Header
+//   Header.mapsOffset       memory::Map of each virtual page
+//   Header.receiveOffset    AgentNetwork::PendingReceive
+//   Header.diskOffset       Disk
+//   Header.pagesOffset      real memory pages
+//
+//   Disk must be overlay. Pages in disk overlay is saved in separate overlay file. see overlayPath.
+namespace snapshot {
+
+constexpr uint32_t VERSION          = 1;
+constexpr char     MAGIC[8]         = {'M', 'E', 'S', 'A', 'S', 'N', 'P', '1'};
+// multiple of host page size of all supported host
+constexpr uint64_t PAGES_ALIGNMENT  = 65536;
+
+// variable::Values without PID and lastOpcode. layout in file
+struct Registers {
+	CARD16 MP;
+	CARD16 WP;
+	CARD16 WDC;
+	CARD16 PTC;
+	CARD16 XTS;
+	CARD16 PSB;
+	CARD32 MDS;
+	CARD16 LF;
+	CARD32 GF;
+	CARD32 CB;
+	CARD16 GFI;
+	CARD16 PC;
+	CARD16 SP;
+	CARD16 savedPC;
+	CARD16 savedSP;
+	CARD16 stack[StackDepth];
+	CARD8  breakByte;
+	CARD8  running;
+};
+Registers toRegisters(const variable::Values& values);
+variable::Values toValues(const Registers& registers);
+
+struct Disk {
+	uint32_t pageSize;
+	uint32_t overlay;  // 1 if pages in overlay is saved in overlayPath. restore refuses 0
+};
+
+struct State {
+	variable::Values                          values;
+	std::vector<AgentNetwork::PendingReceive> pendingReceive;
+	std::vector<Disk>                         diskList;
+};
+
+// path of overlay file of disk of index saved with snapshot of path
+std::string overlayPath(const std::string& path, int index);
+
+// true if path is snapshot file
+bool  isSnapshot(const std::string& path);
+
+// save memory, state.values and other state. processor must be stopped
+void  save(const std::string& path, const State& state);
+
+// restore memory from path and return state. call instead of memory::initialize.
+// caller restores state.values after variable::initialize
+State restore(const std::string& path);
+
+}
@@ -50,10 +50,23 @@ static const Logger logger(__FILE__);
 #include "tclMesa.h"
  
 
-// mesa::boot
-// 0
+// mesa::boot ?-snapshot-load PATH? ?-snapshot-save PATH?
+// 0           1              2     3              4
 int MesaBoot(ClientData cdata, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
-    if (objc == 1) {
+    if (objc % 2 == 1) {
+        for(int i = 1; i < objc; i += 2) {
+            std::string option = Tcl_GetString(objv[i]);
+            std::string value  = Tcl_GetString(objv[i + 1]);
+            if (option == "-snapshot-load") {
+                // restore machine from snapshot or checkpoint log instead of boot
+                config.snapshotLoadPath = value;
+            } else if (option == "-snapshot-save") {
+                // save snapshot of machine when processor stops
+                config.snapshotSavePath = value;
+            } else {
+                return invalidCommand(cdata, interp, objc, objv);
+            }
+        }
         guam::setConfig(config);
 
         // stop at MP 8000
@@ -67,4 +80,4 @@ int MesaBoot(ClientData cdata, Tcl_Interp *interp, int objc, Tcl_Obj *const objv
     }
 
     return invalidCommand(cdata, interp, objc, objv);
-}
\ No newline at end of file
+}
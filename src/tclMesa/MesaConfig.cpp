@@ -59,19 +59,33 @@ int MesaConfig(ClientData cdata, Tcl_Interp *interp, int objc, Tcl_Obj *const ob
         auto dict = Tcl_NewDictObj();
         
         PUT_STRING(diskFilePath)
+        {
+            auto list = Tcl_NewListObj(0, 0);
+            for(const auto& e: config.extraDiskFilePathList) {
+                Tcl_ListObjAppendElement(interp, list, Tcl_NewStringObj(e.c_str(), e.length()));
+            }
+            put(interp, dict, "extraDiskFilePathList", list);
+        }
+        PUT_STRING(diskBackend)
+        PUT_STRING(diskFlush)
         PUT_STRING(germFilePath)
         PUT_STRING(bootFilePath)
         PUT_STRING(floppyFilePath)
         PUT_STRING(networkInterface)
         PUT_STRING(networkAddress)
+        PUT_STRING(networkCapture)
         PUT_STRING(bootSwitch)
         PUT_STRING(bootDevice)
         PUT_STRING(displayType)
+        PUT_STRING(snapshotLoadPath)
+        PUT_STRING(snapshotSavePath)
 
         PUT_INT(displayWidth)
         PUT_INT(displayHeight)
         PUT_INT(vmBits)
         PUT_INT(rmBits)
+        PUT_INT(diskWorkerCount)
+        PUT_INT(diskFlushInterval)
 
         Tcl_SetObjResult(interp, dict);
         return TCL_OK;
@@ -88,21 +102,29 @@ int MesaConfig(ClientData cdata, Tcl_Interp *interp, int objc, Tcl_Obj *const ob
         }
 
         auto entry   = guamConfig.getEntry(entryName);
-        config.diskFilePath     = entry.file.disk;
-        config.germFilePath     = entry.file.germ;
-        config.bootFilePath     = entry.file.boot;
-        config.floppyFilePath   = entry.file.floppy;
-        config.networkInterface = entry.network.interface;
-        config.networkAddress   = entry.network.address;
-        config.bootSwitch       = entry.boot.switch_;
-        config.bootDevice       = entry.boot.device;
-        config.displayType      = entry.display.type;
-        config.displayWidth     = entry.display.width;
-        config.displayHeight    = entry.display.height;
-        config.vmBits           = entry.memory.vmbits;
-        config.rmBits           = entry.memory.rmbits;
+        // keep snapshot path set by mesa::config snapshotLoadPath and snapshotSavePath
+        auto snapshotLoadPath = config.snapshotLoadPath;
+        auto snapshotSavePath = config.snapshotSavePath;
+        config = guam_config::toConfig(entry);
+        config.snapshotLoadPath = snapshotLoadPath;
+        config.snapshotSavePath = snapshotSavePath;
         return TCL_OK;
     }
+    // mesa::config snapshotLoadPath PATH
+    // mesa::config snapshotSavePath PATH
+    // 0            1                2
+    if (objc == 3) {
+        std::string name  = Tcl_GetString(objv[1]);
+        std::string value = Tcl_GetString(objv[2]);
+        if (name == "snapshotLoadPath") {
+            config.snapshotLoadPath = value;
+            return TCL_OK;
+        }
+        if (name == "snapshotSavePath") {
+            config.snapshotSavePath = value;
+            return TCL_OK;
+        }
+    }
 
     return invalidCommand(cdata, interp, objc, objv);
 }
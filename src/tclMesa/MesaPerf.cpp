@@ -54,6 +54,29 @@ static const Logger logger(__FILE__);
 // 0          1
 // mesa::perf dump group
 // 0          1    2
+// mesa::perf histogram
+// 0          1
+// mesa::perf histogram group
+// 0          1         2
+//   histogram is dict of name and dict of count sum max p50 p90 p99
+
+static Tcl_Obj* toHistogramDict(Tcl_Interp *interp, const std::string& group) {
+    auto dict = Tcl_NewDictObj();
+
+    for(const auto& e: perf::allHistogram) {
+        if (!group.empty() && e.group != group) continue;
+        auto value = Tcl_NewDictObj();
+        putUINT64(interp, value, "count", e.value.count);
+        putUINT64(interp, value, "sum",   e.value.sum);
+        putUINT64(interp, value, "max",   e.value.max);
+        putUINT64(interp, value, "p50",   e.value.percentile(50));
+        putUINT64(interp, value, "p90",   e.value.percentile(90));
+        putUINT64(interp, value, "p99",   e.value.percentile(99));
+        put(interp, dict, e.name.c_str(), value);
+    }
+    return dict;
+}
+
 int MesaPerf(ClientData cdata, Tcl_Interp *interp, int objc, Tcl_Obj *const objv[]) {
     if (objc == 1) {
         // mesa::perf
@@ -80,6 +103,10 @@ int MesaPerf(ClientData cdata, Tcl_Interp *interp, int objc, Tcl_Obj *const objv
             perf::clear();
             return TCL_OK;
         }
+        if (group == "histogram") {
+            Tcl_SetObjResult(interp, toHistogramDict(interp, ""));
+            return TCL_OK;
+        }
 
         auto dict = Tcl_NewDictObj();
 
@@ -100,6 +127,10 @@ int MesaPerf(ClientData cdata, Tcl_Interp *interp, int objc, Tcl_Obj *const objv
             perf::dump(group);
             return TCL_OK;
         }
+        if (subCommand == "histogram") {
+            Tcl_SetObjResult(interp, toHistogramDict(interp, group));
+            return TCL_OK;
+        }
     }
 
     return invalidCommand(cdata, interp, objc, objv);
@@ -0,0 +1,468 @@
+/*******************************************************************************
+ * Copyright (c) 2025, Yasuhiro Hasegawa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+
+//
+// testDisk.cpp
+//
+
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../util/Util.h"
+static const Logger logger(__FILE__);
+
+#include "../util/DiskFile.h"
+#include "../util/DiskOverlay.h"
+#include "../util/Perf.h"
+
+#include "testBase.h"
+
+class testDisk : public testBase {
+
+	CPPUNIT_TEST_SUITE(testDisk);
+
+	CPPUNIT_TEST(testDiskOverlay);
+	CPPUNIT_TEST(testDiskFileSparse);
+	CPPUNIT_TEST(testDiskFileJournal);
+	CPPUNIT_TEST(testDiskFileJournalGroupCommit);
+	CPPUNIT_TEST(testDiskFileCopy);
+#if defined(__linux__)
+	CPPUNIT_TEST(testDiskFileIOUring);
+#endif
+
+	CPPUNIT_TEST_SUITE_END();
+
+
+public:
+	void testDiskOverlay() {
+		const uint32_t PAGE_COUNT = 64;
+
+		auto dir         = std::filesystem::temp_directory_path();
+		auto basePath    = (dir / "testDiskOverlay.dsk").string();
+		auto overlayPath = (dir / "testDiskOverlay.ovl").string();
+
+		std::vector<uint16_t> source(PAGE_COUNT * DiskFile::PAGE_SIZE);
+		for(uint32_t i = 0; i < source.size(); i++) source[i] = (uint16_t)i;
+		{
+			std::ofstream ofs(basePath, std::ios::out | std::ios::binary | std::ios::trunc);
+			ofs.write((const char*)source.data(), source.size() * sizeof(uint16_t));
+		}
+		// make sure that commit changes modification time of base
+		std::filesystem::last_write_time(basePath, std::filesystem::last_write_time(basePath) - std::chrono::hours(1));
+		DiskOverlay::create(overlayPath, basePath);
+		CPPUNIT_ASSERT(DiskOverlay::isOverlay(overlayPath));
+
+		DiskFile::PageData page;
+		for(auto& e: page) e = 0xCAFE;
+		{
+			DiskFile diskFile;
+			diskFile.attach(overlayPath);
+			CPPUNIT_ASSERT(diskFile.isOverlay());
+			CPPUNIT_ASSERT_EQUAL(PAGE_COUNT, diskFile.getPageSize());
+
+			diskFile.writePage(3, page);
+			CPPUNIT_ASSERT_EQUAL(0, diskFile.verifyPage(3, page));
+			CPPUNIT_ASSERT_EQUAL(0, diskFile.verifyPage(4, source.data() + 4 * DiskFile::PAGE_SIZE));
+			diskFile.detach();
+		}
+		// base image is not changed
+		{
+			DiskFile diskFile;
+			diskFile.attach(basePath);
+			CPPUNIT_ASSERT_EQUAL(0, diskFile.verifyPage(3, source.data() + 3 * DiskFile::PAGE_SIZE));
+			diskFile.detach();
+		}
+		// load rewinds overlay to contents of save
+		{
+			auto savePath = (dir / "testDiskOverlay.save").string();
+			DiskOverlay overlay;
+			overlay.attach(overlayPath);
+			overlay.save(savePath);
+			overlay.writePage(5, page);
+			CPPUNIT_ASSERT_EQUAL(2U, overlay.countPage());
+			overlay.load(savePath);
+			CPPUNIT_ASSERT_EQUAL(1U, overlay.countPage());
+			CPPUNIT_ASSERT(overlay.contains(3));
+			CPPUNIT_ASSERT(!overlay.contains(5));
+			CPPUNIT_ASSERT(memcmp(overlay.readPage(3), page, DiskOverlay::PAGE_SIZE_IN_BYTE) == 0);
+			overlay.detach();
+			std::filesystem::remove(savePath);
+		}
+		// commit writes overlay page to base image
+		auto otherPath = (dir / "testDiskOverlay.other").string();
+		DiskOverlay::create(otherPath, basePath);
+		{
+			auto otherList = DiskOverlay::findOther(overlayPath);
+			CPPUNIT_ASSERT_EQUAL((size_t)1, otherList.size());
+			CPPUNIT_ASSERT(std::filesystem::equivalent(otherPath, otherList[0]));
+
+			DiskOverlay overlay;
+			overlay.attach(overlayPath, false);
+			CPPUNIT_ASSERT_EQUAL(1U, overlay.countPage());
+			overlay.commit();
+			CPPUNIT_ASSERT_EQUAL(0U, overlay.countPage());
+			overlay.detach();
+
+			DiskFile diskFile;
+			diskFile.attach(basePath);
+			CPPUNIT_ASSERT_EQUAL(0, diskFile.verifyPage(3, page));
+			diskFile.detach();
+		}
+		// overlay of committed base can be attached, other overlay of changed base can not
+		{
+			DiskOverlay overlay;
+			overlay.attach(overlayPath);
+			overlay.detach();
+
+			int catchException = 0;
+			try {
+				DiskOverlay other;
+				other.attach(otherPath);
+			} catch (ErrorError&) {
+				catchException = 1;
+			}
+			CPPUNIT_ASSERT_EQUAL(1, catchException);
+		}
+		// overlay of interrupted commit can be attached only for commit
+		{
+			{
+				std::fstream fs(overlayPath, std::ios::in | std::ios::out | std::ios::binary);
+				uint32_t committing = 1;
+				fs.seekp(offsetof(DiskOverlay::Header, committing));
+				fs.write((const char*)&committing, sizeof(committing));
+			}
+			int catchException = 0;
+			try {
+				DiskOverlay overlay;
+				overlay.attach(overlayPath);
+			} catch (ErrorError&) {
+				catchException = 1;
+			}
+			CPPUNIT_ASSERT_EQUAL(1, catchException);
+
+			DiskOverlay overlay;
+			overlay.attach(overlayPath, false);
+			overlay.commit();
+			overlay.detach();
+			overlay.attach(overlayPath);
+			overlay.detach();
+		}
+		std::filesystem::remove(otherPath);
+		std::filesystem::remove(overlayPath);
+		std::filesystem::remove(basePath);
+	}
+
+
+	void testDiskFileSparse() {
+		const uint32_t PAGE_COUNT = 256;
+		const uint32_t BLOCK_PAGE = DiskFile::SPARSE_BLOCK_PAGE;
+
+		auto path = (std::filesystem::temp_directory_path() / "testDiskFileSparse.dsk").string();
+		std::filesystem::remove(path);
+		DiskFile::create(path, PAGE_COUNT);
+		CPPUNIT_ASSERT_EQUAL((uint64_t)PAGE_COUNT * DiskFile::PAGE_SIZE_IN_BYTE, (uint64_t)std::filesystem::file_size(path));
+
+		std::vector<uint16_t> data(BLOCK_PAGE * 4 * DiskFile::PAGE_SIZE);
+		for(uint32_t i = 0; i < data.size(); i++) data[i] = (uint16_t)(i | 1);
+		std::vector<uint16_t> zero(data.size(), 0);
+		std::vector<uint16_t*> dataBuffers;
+		std::vector<uint16_t*> zeroBuffers;
+		for(uint32_t i = 0; i < BLOCK_PAGE * 4; i++) {
+			dataBuffers.push_back(data.data() + i * DiskFile::PAGE_SIZE);
+			zeroBuffers.push_back(zero.data() + i * DiskFile::PAGE_SIZE);
+		}
+
+		DiskFile::PageData page;
+		{
+			DiskFile diskFile;
+			diskFile.attach(path);
+			// new image is hole
+			CPPUNIT_ASSERT(diskFile.isHole(0));
+			CPPUNIT_ASSERT(diskFile.isHole(PAGE_COUNT - 1));
+
+			diskFile.writePages(0, dataBuffers);
+			CPPUNIT_ASSERT(!diskFile.isHole(0));
+			diskFile.readPage(1, page);
+			CPPUNIT_ASSERT_EQUAL(0, memcmp(page, dataBuffers[1], DiskFile::PAGE_SIZE_IN_BYTE));
+
+			// all-zero block becomes hole. partial block is written
+			std::vector<uint16_t*> buffers(zeroBuffers.begin(), zeroBuffers.begin() + BLOCK_PAGE * 2 + 1);
+			diskFile.writePages(BLOCK_PAGE, buffers);
+			CPPUNIT_ASSERT(!diskFile.isHole(0));
+			CPPUNIT_ASSERT(diskFile.isHole(BLOCK_PAGE));
+			CPPUNIT_ASSERT(diskFile.isHole(BLOCK_PAGE * 2));
+			CPPUNIT_ASSERT(!diskFile.isHole(BLOCK_PAGE * 3));
+			diskFile.readPage(BLOCK_PAGE, page);
+			CPPUNIT_ASSERT_EQUAL(0, memcmp(page, zeroBuffers[0], DiskFile::PAGE_SIZE_IN_BYTE));
+			diskFile.readPage(BLOCK_PAGE * 3 + 1, page);
+			CPPUNIT_ASSERT_EQUAL(0, memcmp(page, dataBuffers[BLOCK_PAGE * 3 + 1], DiskFile::PAGE_SIZE_IN_BYTE));
+			CPPUNIT_ASSERT_EQUAL(0, diskFile.verifyPage(BLOCK_PAGE, zeroBuffers[0]));
+			CPPUNIT_ASSERT(diskFile.verifyPage(BLOCK_PAGE, dataBuffers[0]) != 0);
+
+			// non-zero write to hole
+			diskFile.writePage(PAGE_COUNT - 1, dataBuffers[0]);
+			CPPUNIT_ASSERT(!diskFile.isHole(PAGE_COUNT - 1));
+			diskFile.readPage(PAGE_COUNT - 1, page);
+			CPPUNIT_ASSERT_EQUAL(0, memcmp(page, dataBuffers[0], DiskFile::PAGE_SIZE_IN_BYTE));
+			diskFile.detach();
+		}
+		// compact keeps contents
+		DiskFile::compact(path);
+		{
+			DiskFile diskFile;
+			diskFile.attach(path);
+			CPPUNIT_ASSERT(diskFile.isHole(BLOCK_PAGE));
+			CPPUNIT_ASSERT_EQUAL(0, diskFile.verifyPage(0, dataBuffers[0]));
+			CPPUNIT_ASSERT_EQUAL(0, diskFile.verifyPage(BLOCK_PAGE * 3 + 1, dataBuffers[BLOCK_PAGE * 3 + 1]));
+			CPPUNIT_ASSERT_EQUAL(0, diskFile.verifyPage(PAGE_COUNT - 1, dataBuffers[0]));
+			diskFile.detach();
+		}
+		std::filesystem::remove(path);
+	}
+
+
+	void testDiskFileCopy() {
+		const uint32_t PAGE_COUNT = 256;
+		const uint32_t BLOCK_PAGE = DiskFile::SPARSE_BLOCK_PAGE;
+
+		auto source = (std::filesystem::temp_directory_path() / "testDiskFileCopy.dsk").string();
+		auto dest   = (std::filesystem::temp_directory_path() / "testDiskFileCopy.copy.dsk").string();
+		std::filesystem::remove(source);
+		DiskFile::remove(dest);
+		DiskFile::create(source, PAGE_COUNT);
+
+		std::vector<uint16_t> data(DiskFile::PAGE_SIZE);
+		for(uint32_t i = 0; i < data.size(); i++) data[i] = (uint16_t)(i | 1);
+		{
+			DiskFile diskFile;
+			diskFile.attach(source);
+			diskFile.writePage(BLOCK_PAGE, data.data());
+			diskFile.detach();
+		}
+
+		DiskFile::copy(source, dest);
+		CPPUNIT_ASSERT_EQUAL(std::filesystem::file_size(source), std::filesystem::file_size(dest));
+		{
+			// copy has same contents and hole
+			DiskFile diskFile;
+			diskFile.attach(dest);
+			CPPUNIT_ASSERT(diskFile.isHole(0));
+			CPPUNIT_ASSERT_EQUAL(0, diskFile.verifyPage(BLOCK_PAGE, data.data()));
+			// write to copy doesn't change source
+			diskFile.writePage(0, data.data());
+			diskFile.detach();
+		}
+		{
+			DiskFile diskFile;
+			diskFile.attach(source);
+			CPPUNIT_ASSERT(diskFile.isHole(0));
+			diskFile.detach();
+		}
+		DiskFile::remove(dest);
+		CPPUNIT_ASSERT(!std::filesystem::exists(dest));
+		std::filesystem::remove(source);
+	}
+
+
+	void testDiskFileJournal() {
+		const uint32_t PAGE_COUNT = 64;
+
+		auto path        = (std::filesystem::temp_directory_path() / "testDiskFileJournal.dsk").string();
+		auto journalPath = path + ".journal";
+		std::filesystem::remove(path);
+		std::filesystem::remove(journalPath);
+		DiskFile::create(path, PAGE_COUNT);
+
+		DiskFile::PageData page;
+		for(auto& e: page) e = 0xCAFE;
+		{
+			DiskFile diskFile;
+			diskFile.attach(path, DiskFile::Backend::mmap, DiskFile::Flush::journal);
+			CPPUNIT_ASSERT(std::filesystem::exists(journalPath));
+
+			diskFile.writePage(3, page);
+			CPPUNIT_ASSERT(0 < std::filesystem::file_size(journalPath));
+			CPPUNIT_ASSERT_EQUAL(0, diskFile.verifyPage(3, page));
+			// flush writes back image and truncates journal
+			diskFile.flush();
+			CPPUNIT_ASSERT_EQUAL((uintmax_t)0, std::filesystem::file_size(journalPath));
+
+			diskFile.writePage(4, page);
+			diskFile.detach();
+			CPPUNIT_ASSERT(!std::filesystem::exists(journalPath));
+		}
+		{
+			DiskFile diskFile;
+			diskFile.attach(path);
+			CPPUNIT_ASSERT_EQUAL(0, diskFile.verifyPage(3, page));
+			CPPUNIT_ASSERT_EQUAL(0, diskFile.verifyPage(4, page));
+			diskFile.detach();
+		}
+		std::filesystem::remove(path);
+	}
+
+	void testDiskFileJournalGroupCommit() {
+		const uint32_t THREAD_COUNT = 8;
+		const uint32_t WRITE_COUNT  = 32;
+
+		auto path = (std::filesystem::temp_directory_path() / "testDiskFileJournalGroupCommit.dsk").string();
+		DiskFile::remove(path);
+		DiskFile::create(path, THREAD_COUNT * WRITE_COUNT);
+		{
+			DiskFile diskFile;
+			diskFile.attach(path, DiskFile::Backend::mmap, DiskFile::Flush::journal);
+
+			const uint64_t syncCount = perf::disk::journal_sync;
+			auto start = std::chrono::steady_clock::now();
+			std::vector<std::thread> threadList;
+			for(uint32_t i = 0; i < THREAD_COUNT; i++) {
+				threadList.emplace_back([&diskFile, i]() {
+					DiskFile::PageData page;
+					for(uint32_t j = 0; j < WRITE_COUNT; j++) {
+						for(auto& e: page) e = (uint16_t)(i * WRITE_COUNT + j);
+						diskFile.writePage(i * WRITE_COUNT + j, page);
+					}
+				});
+			}
+			for(auto& e: threadList) e.join();
+			auto elapsed = std::chrono::steady_clock::now() - start;
+
+			// fdatasync starts at most once per interval
+			const uint64_t syncDelta = perf::disk::journal_sync - syncCount;
+			const uint64_t syncLimit = elapsed / DiskFile::JOURNAL_SYNC_INTERVAL + 1;
+			CPPUNIT_ASSERT(syncDelta <= syncLimit);
+
+			DiskFile::PageData page;
+			for(uint32_t i = 0; i < THREAD_COUNT * WRITE_COUNT; i++) {
+				for(auto& e: page) e = (uint16_t)i;
+				CPPUNIT_ASSERT_EQUAL(0, diskFile.verifyPage(i, page));
+			}
+			diskFile.detach();
+		}
+		DiskFile::remove(path);
+	}
+
+
+#if defined(__linux__)
+	void testDiskFileIOUring() {
+		auto path = (std::filesystem::temp_directory_path() / "testDiskFileIOUring.dsk").string();
+		testDiskFileIOUring(path, DiskFile::Backend::io_uring);
+		// O_DIRECT is not supported by some file system such as old tmpfs
+		{
+			std::ofstream(path).close();
+			int fd = open(path.c_str(), O_RDWR | O_DIRECT);
+			if (0 <= fd) close(fd);
+			std::filesystem::remove(path);
+			if (fd < 0) {
+				logger.info("testDiskFileIOUring  skip io_uring_direct");
+				return;
+			}
+		}
+		testDiskFileIOUring(path, DiskFile::Backend::io_uring_direct);
+	}
+
+	void testDiskFileIOUring(const std::string& path, DiskFile::Backend backend) {
+		const uint32_t PAGE_COUNT = 64;
+		const uint32_t PAGE_SIZE  = DiskFile::PAGE_SIZE;
+
+		std::ofstream(path).close();
+		std::filesystem::resize_file(path, PAGE_COUNT * DiskFile::PAGE_SIZE_IN_BYTE);
+
+		// buffer of guest is aligned to page only. offset 1 page makes buffer unaligned for O_DIRECT
+		std::vector<uint16_t> sourceData((PAGE_COUNT + 1) * PAGE_SIZE);
+		std::vector<uint16_t> targetData((PAGE_COUNT + 1) * PAGE_SIZE);
+		uint16_t* source = sourceData.data() + PAGE_SIZE;
+		uint16_t* target = targetData.data() + PAGE_SIZE;
+		for(uint32_t i = 0; i < PAGE_COUNT * PAGE_SIZE; i++) source[i] = (uint16_t)(i * 7);
+
+		DiskFile diskFile;
+		diskFile.attach(path, backend);
+		CPPUNIT_ASSERT_EQUAL(PAGE_COUNT, diskFile.getPageSize());
+
+		std::mutex              mutex;
+		std::condition_variable cv;
+		uint32_t                doneCount = 0;
+		std::vector<int>        results(PAGE_COUNT);
+		diskFile.setCompletion([&](void* context, int result) {
+			std::unique_lock<std::mutex> lock(mutex);
+			results[(uintptr_t)context] = result;
+			doneCount++;
+			cv.notify_one();
+		});
+		// 8 pages for each request
+		auto run = [&](DiskFile::Operation operation, uint16_t* memory, uint32_t first, uint32_t count) {
+			std::vector<DiskFile::Request> requestList;
+			for(uint32_t i = first; i < first + count; i++) {
+				DiskFile::Request request{operation, i * 8, {}, (void*)(uintptr_t)i};
+				for(uint32_t j = 0; j < 8; j++) request.buffers.push_back(memory + (i * 8 + j) * PAGE_SIZE);
+				requestList.push_back(request);
+			}
+			doneCount = 0;
+			diskFile.submit(requestList);
+			std::unique_lock<std::mutex> lock(mutex);
+			cv.wait(lock, [&]{ return doneCount == count; });
+		};
+
+		run(DiskFile::Operation::write, source, 0, PAGE_COUNT / 8);
+		run(DiskFile::Operation::read,  target, 0, PAGE_COUNT / 8);
+		CPPUNIT_ASSERT(sourceData == targetData);
+		for(uint32_t i = 0; i < PAGE_COUNT / 8; i++) CPPUNIT_ASSERT_EQUAL(0, results[i]);
+
+		target[PAGE_SIZE * 9] ^= 1;
+		run(DiskFile::Operation::verify, target, 0, 2);
+		CPPUNIT_ASSERT_EQUAL(0, results[0]);
+		CPPUNIT_ASSERT_EQUAL(1, results[1]);
+
+		// all-zero write punches hole and sets hole of block
+		std::fill(source + 16 * PAGE_SIZE, source + 24 * PAGE_SIZE, 0);
+		run(DiskFile::Operation::write, source, 2, 1);
+		CPPUNIT_ASSERT_EQUAL(0, results[2]);
+		if (diskFile.isHole(16)) {
+			CPPUNIT_ASSERT(diskFile.isHole(23));
+			CPPUNIT_ASSERT(!diskFile.isHole(24));
+		}
+		run(DiskFile::Operation::read, target, 0, PAGE_COUNT / 8);
+		CPPUNIT_ASSERT(sourceData == targetData);
+		CPPUNIT_ASSERT(!DiskFile::isAsyncPending());
+
+		diskFile.detach();
+		std::filesystem::remove(path);
+	}
+#endif
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(testDisk);
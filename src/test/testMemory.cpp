@@ -38,7 +38,13 @@ static const Logger logger(__FILE__);
 
 #include "testBase.h"
 
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include "../mesa/checkpoint.h"
 #include "../mesa/memory.h"
+#include "../mesa/snapshot.h"
 
 class testMemory : public testBase {
 
@@ -47,6 +53,9 @@ class testMemory : public testBase {
 	CPPUNIT_TEST(testStack);
 	CPPUNIT_TEST(testReadDbl);
 	CPPUNIT_TEST(testGetCodeByte);
+	CPPUNIT_TEST(testSnapshot);
+	CPPUNIT_TEST(testCheckpoint);
+	CPPUNIT_TEST(testCheckpointDirty);
 	CPPUNIT_TEST_SUITE_END();
 
 
@@ -104,6 +113,183 @@ public:
     	CPPUNIT_ASSERT_EQUAL((CARD16)0x1234, page_MDS[0x1000 + 1]);
     }
 
+	void testSnapshot() {
+		auto path = (std::filesystem::temp_directory_path() / "testSnapshot.snapshot").string();
+
+		page_MDS[0x1000] = 0x1234;
+		Push(0xBEEF);
+		MP = (CARD16)8000;
+		const CARD16 pc = PC;
+		const memory::Config config = memory::getConfig();
+		std::vector<memory::Map> maps(memory::getMaps(), memory::getMaps() + config.vpSize);
+
+		snapshot::State state;
+		state.values.set();
+		state.pendingReceive.push_back({0x12340, 4});
+		state.diskList.push_back({1000, 0});
+		snapshot::save(path, state);
+		CPPUNIT_ASSERT(snapshot::isSnapshot(path));
+
+		memory::finalize();
+		variable::initialize();
+		page_MDS = 0;
+
+		auto restored = snapshot::restore(path);
+		restored.values.restore();
+		CPPUNIT_ASSERT_EQUAL(config.vpSize, memory::getConfig().vpSize);
+		CPPUNIT_ASSERT_EQUAL(config.rpSize, memory::getConfig().rpSize);
+		CPPUNIT_ASSERT(memcmp(maps.data(), memory::getMaps(), sizeof(memory::Map) * config.vpSize) == 0);
+		CPPUNIT_ASSERT_EQUAL(pc, PC);
+		CPPUNIT_ASSERT_EQUAL((CARD16)8000, (CARD16)MP);
+		CPPUNIT_ASSERT_EQUAL((CARD16)0xBEEF, Pop());
+		CPPUNIT_ASSERT_EQUAL((size_t)1, restored.pendingReceive.size());
+		CPPUNIT_ASSERT_EQUAL((CARD32)0x12340, restored.pendingReceive[0].iocbAddress);
+		CPPUNIT_ASSERT_EQUAL((uint32_t)1000, restored.diskList[0].pageSize);
+		CPPUNIT_ASSERT_EQUAL((CARD16)0x1234, *Fetch(MDS + 0x1000));
+		CPPUNIT_ASSERT_EQUAL((CARD16)0x3000, *Fetch(0x00030000));
+
+		// write to memory doesn't change snapshot
+		*Store(MDS + 0x1000) = 0x5678;
+		memory::finalize();
+		snapshot::restore(path);
+		CPPUNIT_ASSERT_EQUAL((CARD16)0x1234, *Fetch(MDS + 0x1000));
+
+		std::filesystem::remove(path);
+	}
+
+	void testCheckpoint() {
+		auto path       = (std::filesystem::temp_directory_path() / "testCheckpoint.log").string();
+		auto outputPath = (std::filesystem::temp_directory_path() / "testCheckpoint.compact").string();
+		auto basePath   = (std::filesystem::temp_directory_path() / "testCheckpoint.dsk").string();
+		auto diskPath   = (std::filesystem::temp_directory_path() / "testCheckpoint.ovl").string();
+		std::filesystem::remove(path);
+
+		// overlay of disk is saved with each record
+		{
+			std::ofstream ofs(basePath, std::ios::out | std::ios::binary | std::ios::trunc);
+			std::vector<char> zero(DiskOverlay::PAGE_SIZE_IN_BYTE * 4);
+			ofs.write(zero.data(), zero.size());
+		}
+		DiskOverlay::create(diskPath, basePath);
+		DiskOverlay overlay;
+		overlay.attach(diskPath);
+		std::vector<uint8_t> diskPage(DiskOverlay::PAGE_SIZE_IN_BYTE, 0xAB);
+
+		checkpoint::Writer writer;
+		writer.open(path, {&overlay});
+		variable::Values values;
+
+		// first record has every page
+		page_MDS[0x1000] = 0x1111;
+		MP = (CARD16)100;
+		values.set();
+		overlay.writePage(1, diskPage.data());
+		CPPUNIT_ASSERT(writer.take(values, {}));
+
+		// second record has only written page
+		*Store(MDS + 0x1000) = 0x2222;
+		MP = (CARD16)200;
+		overlay.writePage(2, diskPage.data());
+		values.set();
+		while(!writer.take(values, {{0x12340, 4}})) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		writer.close();
+
+		// torn record at end of log is ignored
+		{
+			std::ofstream ofs(path, std::ios::out | std::ios::binary | std::ios::app);
+			ofs << "MESACKR1 torn record";
+		}
+		auto log = checkpoint::scan(path);
+		CPPUNIT_ASSERT_EQUAL((size_t)2, log.recordList.size());
+		CPPUNIT_ASSERT(log.validSize < std::filesystem::file_size(path));
+		CPPUNIT_ASSERT_EQUAL((uint32_t)1, log.recordList[1].pageCount);
+		// store set referenced and dirty flag of map
+		CPPUNIT_ASSERT_EQUAL((uint32_t)1, log.recordList[1].mapChunkCount);
+		CPPUNIT_ASSERT_EQUAL((CARD16)200, log.recordList[1].MP);
+		CPPUNIT_ASSERT_EQUAL((uint32_t)1, log.recordList[1].diskCount);
+
+		checkpoint::compact(path, outputPath);
+		auto compacted = checkpoint::scan(outputPath);
+		CPPUNIT_ASSERT_EQUAL((size_t)1, compacted.recordList.size());
+		CPPUNIT_ASSERT_EQUAL((uint32_t)1, compacted.recordList[0].sequence);
+
+		// disk written after record is rewound to time of record
+		overlay.writePage(3, diskPage.data());
+		overlay.load(checkpoint::overlayPath(outputPath, 1, 0));
+		CPPUNIT_ASSERT(overlay.contains(1));
+		CPPUNIT_ASSERT(overlay.contains(2));
+		CPPUNIT_ASSERT(!overlay.contains(3));
+		overlay.detach();
+
+		const memory::Config config = memory::getConfig();
+		std::vector<memory::Map> maps(memory::getMaps(), memory::getMaps() + config.vpSize);
+		memory::finalize();
+		variable::initialize();
+		page_MDS = 0;
+
+		auto restored = checkpoint::restore(outputPath);
+		restored.values.restore();
+		CPPUNIT_ASSERT_EQUAL(config.rpSize, memory::getConfig().rpSize);
+		CPPUNIT_ASSERT(memcmp(maps.data(), memory::getMaps(), sizeof(memory::Map) * config.vpSize) == 0);
+		CPPUNIT_ASSERT_EQUAL((CARD16)200, (CARD16)MP);
+		CPPUNIT_ASSERT_EQUAL((size_t)1, restored.pendingReceive.size());
+		CPPUNIT_ASSERT_EQUAL((CARD16)0x2222, *Fetch(MDS + 0x1000));
+		CPPUNIT_ASSERT_EQUAL((CARD16)0x3000, *Fetch(0x00030000));
+		CPPUNIT_ASSERT_EQUAL((size_t)1, restored.diskList.size());
+
+		for(uint32_t sequence = 0; sequence < 2; sequence++) std::filesystem::remove(checkpoint::overlayPath(path, sequence, 0));
+		std::filesystem::remove(checkpoint::overlayPath(outputPath, 1, 0));
+		std::filesystem::remove(path);
+		std::filesystem::remove(outputPath);
+		std::filesystem::remove(diskPath);
+		std::filesystem::remove(basePath);
+	}
+
+	void testCheckpointDirty() {
+		auto path = (std::filesystem::temp_directory_path() / "testCheckpointDirty.log").string();
+		std::filesystem::remove(path);
+
+		checkpoint::Writer writer;
+		writer.open(path);
+		variable::Values values;
+		values.set();
+		auto take = [&]() {
+			while(!writer.take(values, {})) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		};
+		// first record has every page
+		take();
+
+		// peek doesn't mark page
+		CARD16 word = *memory::peek(MDS + 0x2000);
+		(void)word;
+		take();
+		// agent that writes through pointer of peek marks page
+		*memory::peek(MDS + 0x2000) = 0x2222;
+		memory::markDirty(MDS + 0x2000, 1);
+		take();
+
+		// dirty flag of map set by guest selects page
+		const CARD32 vp = (MDS + 0x3000) / PageSize;
+		memory::Map map = memory::ReadMap(vp);
+		map.mf.dirty = 0;
+		memory::WriteMap(vp, map);
+		take();
+		map.mf.dirty = 1;
+		memory::WriteMap(vp, map);
+		take();
+		writer.close();
+
+		auto log = checkpoint::scan(path);
+		CPPUNIT_ASSERT_EQUAL((size_t)5, log.recordList.size());
+		CPPUNIT_ASSERT_EQUAL((uint32_t)0, log.recordList[1].pageCount);
+		CPPUNIT_ASSERT_EQUAL((uint32_t)1, log.recordList[2].pageCount);
+		CPPUNIT_ASSERT_EQUAL((uint32_t)0, log.recordList[3].pageCount);
+		CPPUNIT_ASSERT_EQUAL((uint32_t)1, log.recordList[4].pageCount);
+		CPPUNIT_ASSERT_EQUAL((uint32_t)1, log.recordList[4].mapChunkCount);
+
+		std::filesystem::remove(path);
+	}
+
     void testGetCodeByte() {
     	//logger.debug("testGetCodeByte   CB = %8X  PC = %04X", CodeCache::CB(), PC);
 		CARD8* p = (CARD8*)page_CB;
@@ -0,0 +1,436 @@
+/*******************************************************************************
+ * Copyright (c) 2025, Yasuhiro Hasegawa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+
+//
+// testNetwork.cpp
+//
+
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../util/Util.h"
+static const Logger logger(__FILE__);
+
+#include "../util/net.h"
+#include "../util/PacketCapture.h"
+#include "../util/PacketRing.h"
+#include "../util/VirtualSwitch.h"
+#include "../util/XNSServer.h"
+
+#include "../mesa/guam.h"
+
+#include "testBase.h"
+
+class testNetwork : public testBase {
+
+	CPPUNIT_TEST_SUITE(testNetwork);
+
+	CPPUNIT_TEST(testVirtualSwitch);
+	CPPUNIT_TEST(testPacketCapture);
+	CPPUNIT_TEST(testXNSServer);
+	CPPUNIT_TEST(testXNSServerBootEther);
+#if defined(__linux__)
+	CPPUNIT_TEST(testPacketRing);
+#endif
+
+	CPPUNIT_TEST_SUITE_END();
+
+
+public:
+	void testVirtualSwitch() {
+		auto configA = VirtualSwitch::parse("vswitch:testVirtualSwitch");
+		auto configB = VirtualSwitch::parse("vswitch:testVirtualSwitch");
+		auto configC = VirtualSwitch::parse("vswitch:testVirtualSwitch,loss=100");
+		CPPUNIT_ASSERT(configA.address != configB.address);
+
+		VirtualSwitch a;
+		VirtualSwitch b;
+		VirtualSwitch c;
+		a.open(configA);
+		b.open(configB);
+		c.open(configC);
+
+		auto setAddress = [](uint8_t* p, uint64_t address) {
+			for(int i = 0; i < 6; i++) p[i] = (uint8_t)(address >> (40 - i * 8));
+		};
+		const auto timeout = std::chrono::microseconds(100'000);
+		std::span<uint8_t> data;
+
+		// broadcast from a reaches b. c loses all packet
+		uint8_t frameA[60] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+		setAddress(frameA + 6, configA.address);
+		std::span<uint8_t> spanA{frameA, sizeof(frameA)};
+		CPPUNIT_ASSERT_EQUAL((int)sizeof(frameA), a.transmit(spanA));
+		CPPUNIT_ASSERT_EQUAL((int)sizeof(frameA), b.receive(data, timeout));
+		CPPUNIT_ASSERT(std::equal(data.begin(), data.end(), frameA));
+		CPPUNIT_ASSERT_EQUAL(0, c.receive(data, std::chrono::microseconds(10'000)));
+
+		// b learned address of a. unicast from b reaches a only
+		uint8_t frameB[60] = {};
+		setAddress(frameB + 0, configA.address);
+		setAddress(frameB + 6, configB.address);
+		std::span<uint8_t> spanB{frameB, sizeof(frameB)};
+		CPPUNIT_ASSERT_EQUAL((int)sizeof(frameB), b.transmit(spanB));
+		CPPUNIT_ASSERT_EQUAL((int)sizeof(frameB), a.receive(data, timeout));
+		CPPUNIT_ASSERT(std::equal(data.begin(), data.end(), frameB));
+		CPPUNIT_ASSERT_EQUAL(0, a.receive(data, std::chrono::microseconds(10'000)));
+
+		// address of live port is refused, and port of a is kept
+		{
+			int catchException = 0;
+			try {
+				VirtualSwitch d;
+				d.open(configA);
+			} catch (ErrorError&) {
+				catchException = 1;
+			}
+			CPPUNIT_ASSERT_EQUAL(1, catchException);
+			CPPUNIT_ASSERT(std::filesystem::exists(a.path));
+		}
+		// stale socket left by previous run is replaced
+		{
+			auto path = a.path;
+			a.close();
+			CPPUNIT_ASSERT(!std::filesystem::exists(path));
+			sockaddr_un addr;
+			memset(&addr, 0, sizeof(addr));
+			addr.sun_family = AF_UNIX;
+			strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+			int stale = ::socket(AF_UNIX, SOCK_DGRAM, 0);
+			CPPUNIT_ASSERT_EQUAL(0, ::bind(stale, (sockaddr*)&addr, sizeof(addr)));
+			::close(stale);
+			a.open(configA);
+		}
+		// transmit to stale socket drops the port but leaves the file to open of same address
+		{
+			auto stalePath = (std::filesystem::path(a.path).parent_path() / "stale").string();
+			sockaddr_un addr;
+			memset(&addr, 0, sizeof(addr));
+			addr.sun_family = AF_UNIX;
+			strncpy(addr.sun_path, stalePath.c_str(), sizeof(addr.sun_path) - 1);
+			int stale = ::socket(AF_UNIX, SOCK_DGRAM, 0);
+			CPPUNIT_ASSERT_EQUAL(0, ::bind(stale, (sockaddr*)&addr, sizeof(addr)));
+			::close(stale);
+			uint8_t frameC[60] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+			setAddress(frameC + 6, configB.address);
+			std::span<uint8_t> spanC{frameC, sizeof(frameC)};
+			CPPUNIT_ASSERT_EQUAL((int)sizeof(frameC), b.transmit(spanC));
+			CPPUNIT_ASSERT_EQUAL((int)sizeof(frameC), a.receive(data, timeout));
+			CPPUNIT_ASSERT(std::filesystem::exists(stalePath));
+			std::filesystem::remove(stalePath);
+		}
+
+		c.close();
+		b.close();
+		a.close();
+	}
+
+
+	void testPacketCapture() {
+		auto path = (std::filesystem::temp_directory_path() / "testPacketCapture.pcapng").string();
+
+		uint8_t frame[61] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+		std::span<uint8_t> span{frame, sizeof(frame)};
+		// longer than snap length
+		std::vector<uint8_t> longFrame(net::PACKET_SIZE + 100, 0xFF);
+		std::span<uint8_t> longSpan{longFrame};
+		{
+			PacketCapture capture;
+			capture.open(path, "test");
+			// transmit packet is older than second receive packet
+			capture.capture(PacketCapture::Direction::receive,  std::chrono::microseconds(1000), span);
+			capture.capture(PacketCapture::Direction::receive,  std::chrono::microseconds(3000), span);
+			capture.capture(PacketCapture::Direction::transmit, std::chrono::microseconds(2000), span);
+			capture.capture(PacketCapture::Direction::transmit, std::chrono::microseconds(4000), longSpan);
+			capture.close();
+		}
+
+		std::ifstream in(path, std::ios::binary);
+		std::vector<uint8_t> data{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+		auto get32 = [&](size_t offset) {
+			uint32_t value;
+			memcpy(&value, data.data() + offset, sizeof(value));
+			return value;
+		};
+
+		std::vector<uint32_t> typeList;
+		std::vector<uint32_t> timeList;
+		std::vector<uint32_t> flagList;
+		std::vector<uint32_t> capturedList;
+		std::vector<uint32_t> originalList;
+		for(size_t offset = 0; offset < data.size(); ) {
+			auto type   = get32(offset);
+			auto length = get32(offset + 4);
+			CPPUNIT_ASSERT_EQUAL(0U, length % 4);
+			CPPUNIT_ASSERT_EQUAL(length, get32(offset + length - 4));
+			typeList.push_back(type);
+			if (type == 6) {
+				timeList.push_back(get32(offset + 16));
+				auto captured = get32(offset + 20);
+				capturedList.push_back(captured);
+				originalList.push_back(get32(offset + 24));
+				// epb_flags follows packet data padded to 4 bytes
+				flagList.push_back(get32(offset + 28 + ((captured + 3) & ~3U) + 4));
+			}
+			offset += length;
+		}
+		CPPUNIT_ASSERT((std::vector<uint32_t>{0x0A0D0D0A, 1, 6, 6, 6, 6}) == typeList);
+		CPPUNIT_ASSERT((std::vector<uint32_t>{1000, 2000, 3000, 4000}) == timeList);
+		CPPUNIT_ASSERT((std::vector<uint32_t>{1, 2, 1, 2}) == flagList);
+		// long packet is clipped to snap length and keeps original length
+		const uint32_t size = sizeof(frame);
+		CPPUNIT_ASSERT((std::vector<uint32_t>{size, size, size, (uint32_t)net::PACKET_SIZE}) == capturedList);
+		CPPUNIT_ASSERT((std::vector<uint32_t>{size, size, size, (uint32_t)longFrame.size()}) == originalList);
+
+		std::filesystem::remove(path);
+	}
+
+
+	void testXNSServer() {
+		const uint64_t BFN  = 0x0000'aa00'0e60;
+		const uint32_t SIZE = 1300;
+		auto path = (std::filesystem::temp_directory_path() / "testXNSServer.boot").string();
+		{
+			std::ofstream out(path, std::ios::binary);
+			for(uint32_t i = 0; i < SIZE; i++) out.put((char)i);
+		}
+
+		auto serverDriver = net::getDriver(net::getDevice("vswitch:testXNSServer"));
+		auto clientDriver = net::getDriver(net::getDevice("vswitch:testXNSServer"));
+		serverDriver->open();
+		clientDriver->open();
+		xns::Server server(serverDriver);
+		server.addBootFile(BFN, path);
+		std::thread thread([&]{ server.run(); });
+
+		const auto timeout = std::chrono::microseconds(500'000);
+		xns::Packet request;
+		request.etherDestination = 0xFFFF'FFFF'FFFF;
+		request.etherSource      = clientDriver->device.address;
+		request.packetType       = xns::PT_ECHO;
+		request.destination      = {0, 0xFFFF'FFFF'FFFF, xns::SOCKET_ECHO};
+		request.source           = {0, clientDriver->device.address, 0x1234};
+		request.data             = {0, xns::ECHO_REQUEST, 0xAB, 0xCD, 7};
+		std::vector<uint8_t> frame;
+		request.build(frame);
+		std::span<uint8_t> span{frame};
+		clientDriver->transmit(span);
+
+		std::array<uint8_t, 1514> buffer;
+		std::span<uint8_t> receiveSpan{buffer};
+		xns::Packet reply;
+		int length = clientDriver->receive(receiveSpan, timeout);
+		CPPUNIT_ASSERT(0 < length);
+		CPPUNIT_ASSERT(reply.parse(receiveSpan.first(length)));
+		CPPUNIT_ASSERT_EQUAL(serverDriver->device.address, reply.source.host);
+		CPPUNIT_ASSERT_EQUAL((uint16_t)0x1234, reply.destination.socket);
+		CPPUNIT_ASSERT((std::vector<uint8_t>{0, xns::ECHO_REPLY, 0xAB, 0xCD, 7}) == reply.data);
+
+		// simple request of whole boot file
+		request.packetType         = xns::PT_BOOT;
+		request.destination.socket = xns::SOCKET_BOOT;
+		request.data               = {0, xns::BOOT_SIMPLE_REQUEST, 0x00, 0x00, 0xAA, 0x00, 0x0E, 0x60};
+		request.build(frame);
+		span = std::span<uint8_t>{frame};
+		clientDriver->transmit(span);
+
+		std::vector<uint8_t> file;
+		for(uint32_t packetNumber = 1;; packetNumber++) {
+			length = clientDriver->receive(receiveSpan, timeout);
+			CPPUNIT_ASSERT(0 < length);
+			CPPUNIT_ASSERT(reply.parse(receiveSpan.first(length)));
+			CPPUNIT_ASSERT_EQUAL((uint8_t)xns::BOOT_SIMPLE_DATA, reply.data[1]);
+			CPPUNIT_ASSERT_EQUAL(packetNumber, (uint32_t)((reply.data[8] << 8) | reply.data[9]));
+			// packet without data is end of file
+			if (reply.data.size() == 10) break;
+			file.insert(file.end(), reply.data.begin() + 10, reply.data.end());
+		}
+		CPPUNIT_ASSERT_EQUAL(SIZE, (uint32_t)file.size());
+		for(uint32_t i = 0; i < SIZE; i++) CPPUNIT_ASSERT_EQUAL((uint8_t)i, file[i]);
+
+		server.stop();
+		thread.join();
+
+		// stop before thread reaches run is not lost
+		{
+			xns::Server stopped(serverDriver);
+			stopped.stop();
+			std::thread stoppedThread([&]{ stopped.run(); });
+			stoppedThread.join();
+		}
+
+		clientDriver->close();
+		serverDriver->close();
+		delete clientDriver;
+		delete serverDriver;
+		std::filesystem::remove(path);
+	}
+
+	// boot request of bootDevice ETHER is sent by germ as simple request. guest can not run here
+	void testXNSServerBootEther() {
+		Boot::Request bootRequest;
+		memset(&bootRequest, 0, sizeof(bootRequest));
+		guam::setBootRequestEther(&bootRequest);
+		CPPUNIT_ASSERT_EQUAL(Device::T_ethernet, bootRequest.location.deviceType);
+		const auto& ethernetRequest = bootRequest.location.ethernetRequest;
+		auto toHost = [](const System::HostNumber& host) {
+			return ((uint64_t)host.word[0] << 32) | ((uint64_t)host.word[1] << 16) | host.word[2];
+		};
+		const uint64_t BFN  = toHost(ethernetRequest.bfn);
+		// more packets than receive ring of guest
+		const uint32_t SIZE = 100 * xns::BOOT_DATA_SIZE + 100;
+		auto path = (std::filesystem::temp_directory_path() / "testXNSServerBootEther.boot").string();
+		{
+			std::ofstream out(path, std::ios::binary);
+			for(uint32_t i = 0; i < SIZE; i++) out.put((char)(i * 7));
+		}
+
+		auto serverDriver = net::getDriver(net::getDevice("vswitch:testXNSServerBootEther"));
+		auto clientDriver = net::getDriver(net::getDevice("vswitch:testXNSServerBootEther"));
+		serverDriver->open();
+		clientDriver->open();
+		xns::Server server(serverDriver);
+		server.addBootFile(BFN, path);
+
+		// frame of germ. simpleRequest and bfn to address of ethernetRequest
+		xns::Packet request;
+		request.etherDestination   = toHost(ethernetRequest.address.host);
+		request.etherSource        = clientDriver->device.address;
+		request.packetType         = xns::PT_BOOT;
+		request.destination.net    = ((uint32_t)ethernetRequest.address.net.word[0] << 16) | ethernetRequest.address.net.word[1];
+		request.destination.host   = toHost(ethernetRequest.address.host);
+		request.destination.socket = ethernetRequest.address.socket.word[0];
+		request.source             = {0, clientDriver->device.address, xns::SOCKET_BOOT};
+		request.data.clear();
+		for(CARD16 word: {xns::BOOT_SIMPLE_REQUEST, ethernetRequest.bfn.word[0], ethernetRequest.bfn.word[1], ethernetRequest.bfn.word[2]}) {
+			request.data.push_back((uint8_t)(word >> 8));
+			request.data.push_back((uint8_t)word);
+		}
+		CPPUNIT_ASSERT_EQUAL(xns::SOCKET_BOOT, request.destination.socket);
+		std::vector<uint8_t> frame;
+		request.build(frame);
+		std::span<uint8_t> span{frame};
+
+		auto start = std::chrono::steady_clock::now();
+		bool processed = false;
+		std::thread thread([&]{ processed = server.process(span); });
+
+		const auto timeout = std::chrono::microseconds(500'000);
+		std::array<uint8_t, 1514> buffer;
+		std::span<uint8_t> receiveSpan{buffer};
+		xns::Packet reply;
+		std::vector<uint8_t> file;
+		uint32_t packetNumber = 1;
+		for(;; packetNumber++) {
+			int length = clientDriver->receive(receiveSpan, timeout);
+			CPPUNIT_ASSERT(0 < length);
+			CPPUNIT_ASSERT(reply.parse(receiveSpan.first(length)));
+			CPPUNIT_ASSERT_EQUAL((uint8_t)xns::BOOT_SIMPLE_DATA, reply.data[1]);
+			// no packet is lost
+			CPPUNIT_ASSERT_EQUAL(packetNumber, (uint32_t)((reply.data[8] << 8) | reply.data[9]));
+			if (reply.data.size() == 10) break;
+			file.insert(file.end(), reply.data.begin() + 10, reply.data.end());
+		}
+		auto elapsed = std::chrono::steady_clock::now() - start;
+		thread.join();
+		CPPUNIT_ASSERT(processed);
+		CPPUNIT_ASSERT_EQUAL(SIZE, (uint32_t)file.size());
+		for(uint32_t i = 0; i < SIZE; i++) CPPUNIT_ASSERT_EQUAL((uint8_t)(i * 7), file[i]);
+		// burst is paced by interval
+		const uint32_t burstCount = (packetNumber + xns::BOOT_BURST_SIZE - 1) / xns::BOOT_BURST_SIZE;
+		CPPUNIT_ASSERT(xns::DEFAULT_INTERVAL * (burstCount - 1) <= elapsed);
+
+		clientDriver->close();
+		serverDriver->close();
+		delete clientDriver;
+		delete serverDriver;
+		std::filesystem::remove(path);
+	}
+
+
+#if defined(__linux__)
+	// needs root and veth pair. For example
+	//   ip link add vtA type veth peer name vtB; ip link set vtA up; ip link set vtB up
+	//   MESA_TEST_VETH=vtA:vtB build/test/test
+	void testPacketRing() {
+		const char* env = getenv("MESA_TEST_VETH");
+		if (env == 0) {
+			logger.info("testPacketRing  skip  MESA_TEST_VETH is not set");
+			return;
+		}
+		std::string names(env);
+		auto pos = names.find(':');
+		CPPUNIT_ASSERT(pos != std::string::npos);
+
+		PacketRing a;
+		PacketRing b;
+		a.open(names.substr(0, pos));
+		b.open(names.substr(pos + 1));
+
+		// more than TX_FRAME_COUNT to wrap TX ring. every 10th packet is IPv4 and filtered out
+		const int COUNT = 300;
+		uint8_t frame[60] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01, 0x06, 0x00};
+		for(int i = 0; i < COUNT; i++) {
+			frame[12] = (i % 10 == 9) ? 0x08 : 0x06;
+			frame[20] = (uint8_t)i;
+			std::span<uint8_t> span{frame, sizeof(frame)};
+			CPPUNIT_ASSERT_EQUAL((int)sizeof(frame), a.transmit(span));
+		}
+
+		int count = 0;
+		for(;;) {
+			std::span<uint8_t> span;
+			if (b.receive(span, std::chrono::microseconds(200'000)) == 0) break;
+			CPPUNIT_ASSERT_EQUAL((uint8_t)0x06, span[12]);
+			count++;
+		}
+		CPPUNIT_ASSERT_EQUAL(COUNT - COUNT / 10, count);
+
+		// sender don't see own packet
+		std::span<uint8_t> span;
+		CPPUNIT_ASSERT_EQUAL(0, a.receive(span, std::chrono::microseconds(10'000)));
+
+		a.close();
+		b.close();
+	}
+#endif
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(testNetwork);
@@ -41,6 +41,7 @@ static const Logger logger(__FILE__);
 #include "../opcode/opcode.h"
 
 #include "../mesa/Variable.h"
+#include "../mesa/processor.h"
 
 class testOpcode_esc : public testBase {
 	CPPUNIT_TEST_SUITE(testOpcode_esc);
@@ -178,6 +179,7 @@ class testOpcode_esc : public testBase {
 //	CPPUNIT_TEST(testRRPTC); // 0174
 //	CPPUNIT_TEST(testRRIT);  // 0175
 	CPPUNIT_TEST(testRRXTS); // 0176
+	CPPUNIT_TEST(testRRIT_idle);
 //  CPPUNIT_TEST(testA117);  // 0117
 
 //	CPPUNIT_TEST(testOpcodeTrap);
@@ -1561,6 +1563,38 @@ class testOpcode_esc : public testBase {
 		CPPUNIT_ASSERT_EQUAL(1, (int)SP);
 		CPPUNIT_ASSERT_EQUAL(XTS, stack[0]);
 	}
+	// loop that polls IT is not parked by idle detection
+	void testRRIT_idle() {
+		const CARD16 loopPC = PC;
+		page_CB[(loopPC / 2) + 0] = zESC << 8 | aRRIT;
+
+		// backward branch to same PC without store
+		{
+			processor::SpinDetector detector;
+			uint32_t count = 0;
+			for(;;) {
+				savedPC = loopPC + 2;
+				PC      = loopPC;
+				count++;
+				if (detector.check()) break;
+				CPPUNIT_ASSERT(count <= processor::IDLE_SPIN_THRESHOLD + 1);
+			}
+		}
+		// same loop with RRIT
+		{
+			processor::SpinDetector detector;
+			for(uint32_t i = 0; i <= processor::IDLE_SPIN_THRESHOLD * 2; i++) {
+				PC = loopPC;
+				SP = 0;
+				Execute();
+				CPPUNIT_ASSERT_EQUAL(loopPC + 2, (int)PC);
+				// jump back to loopPC
+				savedPC = loopPC + 2;
+				PC      = loopPC;
+				CPPUNIT_ASSERT(!detector.check());
+			}
+		}
+	}
 
 //	void testOpcodeTrap() {
 //		page_CB[(PC / 2) + 0] = (CARD8)0376 << 8 | 0x00;
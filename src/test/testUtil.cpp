@@ -29,16 +29,44 @@
  *******************************************************************************/
 
 
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include <sched.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 #include "../util/Util.h"
 static const Logger logger(__FILE__);
 
+#include "../util/ThreadQueue.h"
+#include "../util/Perf.h"
+#include "../util/tsc_clock.h"
+
 #include "testBase.h"
 
+class PendingQueue : public thread_queue::ThreadQueueProcessor<int> {
+public:
+	PendingQueue() : ThreadQueueProcessor("pending") {}
+	void process(const int&) {}
+};
+
 class testUtil : public testBase {
 
 	CPPUNIT_TEST_SUITE(testUtil);
 
 	CPPUNIT_TEST(testToIntMesaNumber);
+	CPPUNIT_TEST(testTSCClock);
+	CPPUNIT_TEST(testByteswap);
+	CPPUNIT_TEST(testHistogram);
+	CPPUNIT_TEST(testPerfMerge);
+	CPPUNIT_TEST(testCPUList);
+	CPPUNIT_TEST(testThreadQueuePending);
+	CPPUNIT_TEST(testMemoryUsage);
 
 	CPPUNIT_TEST_SUITE_END();
 
@@ -56,6 +84,175 @@ public:
 		CPPUNIT_ASSERT_EQUAL(16, toIntMesaNumber(std::string("16")));
 	}
 
+	void testTSCClock() {
+		tsc_clock::calibrate();
+		logger.info("tsc_clock  %s", tsc_clock::info());
+
+		// tsc_clock must be monotonic and close to steady_clock
+		auto prev = tsc_clock::now();
+		for(int i = 0; i < 100'000; i++) {
+			auto now = tsc_clock::now();
+			CPPUNIT_ASSERT(prev <= now);
+			prev = now;
+		}
+		// elapsed time of tsc_clock and steady_clock agree within 5 percent over 200 ms
+		{
+			auto tscStart    = tsc_clock::now();
+			auto steadyStart = std::chrono::steady_clock::now();
+			std::this_thread::sleep_for(std::chrono::milliseconds(200));
+			auto tscElapsed    = std::chrono::duration_cast<std::chrono::microseconds>(tsc_clock::now() - tscStart).count();
+			auto steadyElapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - steadyStart).count();
+			logger.info("tsc_clock  elapsed %ld us  steady_clock  elapsed %ld us", (long)tscElapsed, (long)steadyElapsed);
+			CPPUNIT_ASSERT(200'000 <= steadyElapsed);
+			CPPUNIT_ASSERT(std::abs(tscElapsed - steadyElapsed) * 20 < steadyElapsed);
+		}
+
+		// counter slightly behind baseCount must not wrap to far future
+		if (tsc_clock::enable) {
+			auto baseCount = tsc_clock::baseCount;
+			auto baseTime  = std::chrono::steady_clock::time_point(std::chrono::nanoseconds(tsc_clock::baseTime));
+			tsc_clock::baseCount = tsc_clock::readCounter() + 1'000'000;
+			auto now = tsc_clock::now();
+			tsc_clock::baseCount = baseCount;
+			CPPUNIT_ASSERT(now == baseTime);
+		}
+	}
+
+	void testMemoryUsage() {
+		Util::MemoryUsage usage;
+		// no smaps_rollup
+		if (!Util::getMemoryUsage(getpid(), usage)) return;
+		CPPUNIT_ASSERT(0 < usage.rss);
+
+		// page touched before fork is shared with child until it is written
+		std::vector<uint8_t> buffer(16 * 1024 * 1024, 1);
+		int fds[2];
+		CPPUNIT_ASSERT_EQUAL(0, pipe(fds));
+		pid_t pid = fork();
+		if (pid == 0) {
+			char c;
+			(void)!read(fds[0], &c, 1);
+			_exit(0);
+		}
+		Util::MemoryUsage child;
+		CPPUNIT_ASSERT(Util::getMemoryUsage(pid, child));
+		CPPUNIT_ASSERT_EQUAL((ssize_t)1, write(fds[1], "x", 1));
+		waitpid(pid, 0, 0);
+		close(fds[0]);
+		close(fds[1]);
+		CPPUNIT_ASSERT(buffer.size() <= child.shared);
+	}
+
+	void testByteswap() {
+		std::vector<uint16_t> source(1100);
+		for(size_t i = 0; i < source.size(); i++) source[i] = (uint16_t)(i * 0x0101 + 0x1234);
+
+		for(const auto& kernel: Util::getByteswapKernelList()) {
+			// cover vector body and scalar tail with unaligned pointer
+			for(int offset = 0; offset < 3; offset++) {
+				for(int size: {0, 1, 7, 8, 15, 16, 31, 32, 33, 759, 1024}) {
+					std::vector<uint16_t> dest(source.size(), 0xDEAD);
+					kernel.function(source.data() + offset, dest.data() + offset, size);
+					for(int i = 0; i < (int)dest.size(); i++) {
+						uint16_t expect = (offset <= i && i < offset + size) ? std::byteswap(source[i]) : (uint16_t)0xDEAD;
+						CPPUNIT_ASSERT_EQUAL(expect, dest[i]);
+					}
+				}
+			}
+			// in place
+			std::vector<uint16_t> data(source);
+			kernel.function(data.data(), data.data(), (int)data.size());
+			for(size_t i = 0; i < data.size(); i++) CPPUNIT_ASSERT_EQUAL(std::byteswap(source[i]), data[i]);
+		}
+	}
+
+	void testHistogram() {
+		perf::Histogram histogram;
+		CPPUNIT_ASSERT_EQUAL((uint64_t)0, histogram.percentile(50));
+
+		// 0 goes to bucket 0. 1..100 goes to bucket 1..7
+		for(uint64_t i = 0; i <= 100; i++) histogram.record(i);
+		CPPUNIT_ASSERT_EQUAL((uint64_t)101,  histogram.count.load());
+		CPPUNIT_ASSERT_EQUAL((uint64_t)5050, histogram.sum.load());
+		CPPUNIT_ASSERT_EQUAL((uint64_t)100,  histogram.max.load());
+		CPPUNIT_ASSERT_EQUAL((uint64_t)1,    histogram.bucket[0].load());
+		CPPUNIT_ASSERT_EQUAL((uint64_t)37,   histogram.bucket[7].load());
+		// p50 is 50 and is in bucket [32, 64)
+		CPPUNIT_ASSERT_EQUAL((uint64_t)63,   histogram.percentile(50));
+		// upper bound of bucket [64, 128) is limited by max
+		CPPUNIT_ASSERT_EQUAL((uint64_t)100,  histogram.percentile(99));
+
+		histogram.record(UINT64_MAX);
+		CPPUNIT_ASSERT_EQUAL((uint64_t)1,    histogram.bucket[64].load());
+
+		histogram.clear();
+		CPPUNIT_ASSERT_EQUAL((uint64_t)0,    histogram.count.load());
+	}
+
+	void testPerfMerge() {
+		PERF_CLEAR()
+		perf::memory::Fetch = 100;
+		perf::checkpoint::pause_time.record(10);
+		perf::checkpoint::pause_time.record(1000);
+		auto text = perf::toText();
+
+		// merge of two process
+		PERF_CLEAR()
+		CPPUNIT_ASSERT(perf::merge(text));
+		CPPUNIT_ASSERT(perf::merge(text));
+		CPPUNIT_ASSERT_EQUAL((uint64_t)200,  perf::memory::Fetch);
+		CPPUNIT_ASSERT_EQUAL((uint64_t)4,    perf::checkpoint::pause_time.count.load());
+		CPPUNIT_ASSERT_EQUAL((uint64_t)2020, perf::checkpoint::pause_time.sum.load());
+		CPPUNIT_ASSERT_EQUAL((uint64_t)1000, perf::checkpoint::pause_time.max.load());
+		CPPUNIT_ASSERT_EQUAL((uint64_t)2,    perf::checkpoint::pause_time.bucket[4].load());
+
+		CPPUNIT_ASSERT(!perf::merge("X memory Fetch 1\n"));
+		CPPUNIT_ASSERT(!perf::merge("C memory Fetch\n"));
+		PERF_CLEAR()
+	}
+
+	void testCPUList() {
+		CPPUNIT_ASSERT((std::vector<int>{3}) == Util::toCPUList("3"));
+		CPPUNIT_ASSERT((std::vector<int>{0, 1, 2, 3, 8}) == Util::toCPUList("0-3,8"));
+		CPPUNIT_ASSERT(Util::toCPUList("").empty());
+		CPPUNIT_ASSERT(Util::toCPUList("3-1").empty());
+		CPPUNIT_ASSERT(Util::toCPUList("1-").empty());
+		CPPUNIT_ASSERT(Util::toCPUList("a").empty());
+#if defined(__linux__)
+		// pin to cpu that this thread can run
+		cpu_set_t cpuSet;
+		CPPUNIT_ASSERT_EQUAL(0, sched_getaffinity(0, sizeof(cpuSet), &cpuSet));
+		int cpu = 0;
+		while(!CPU_ISSET(cpu, &cpuSet)) cpu++;
+		std::atomic<bool> stop = false;
+		std::thread thread([&stop]{ while(!stop) std::this_thread::yield(); });
+		CPPUNIT_ASSERT(Util::setAffinity(thread, std::to_string(cpu)));
+		stop = true;
+		thread.join();
+#endif
+	}
+
+	void testThreadQueuePending() {
+		PendingQueue a;
+		PendingQueue b;
+		a.push(1);
+		a.push(2);
+		CPPUNIT_ASSERT(PendingQueue::isPending());
+
+		// run of other instance of same type keeps pending data of a
+		std::thread thread([&b]{ b.run(); });
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		CPPUNIT_ASSERT(PendingQueue::isPending());
+
+		a.erase_if([](const int& e){ return e == 1; });
+		CPPUNIT_ASSERT(PendingQueue::isPending());
+		a.clear();
+		CPPUNIT_ASSERT(!PendingQueue::isPending());
+
+		PendingQueue::stop();
+		thread.join();
+	}
+
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(testUtil);
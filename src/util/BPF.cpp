@@ -33,6 +33,8 @@
 // BPF.cpp
 //
 
+#if defined(__APPLE__)
+
 #include <chrono>
 #include <cstring>
 #include <deque>
@@ -344,3 +346,4 @@ void BPF::setNonBlockingIO(int value) {
 	CHECK_SYSCALL(ret, ::ioctl(fd, FIONBIO, &value))
 }
 
+#endif
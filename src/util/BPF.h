@@ -35,6 +35,10 @@
 
 #pragma once
 
+// Berkeley Packet Filter. Available only on macOS.
+
+#if defined(__APPLE__)
+
 #include <chrono>
 #include <deque>
 #include <string>
@@ -250,3 +254,5 @@ struct BPF {
 	//   Gets the process or process group
 
 };
+
+#endif
@@ -33,12 +33,69 @@
 // DiskFile.cpp
 //
 
+#include <algorithm>
 #include <bit>
+#include <cerrno>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/fs.h>
+#endif
 
 #include "Util.h"
 static const Logger logger(__FILE__);
 
 #include "DiskFile.h"
+#include "IOUring.h"
+#include "Perf.h"
+#include "tsc_clock.h"
+
+DiskFile::Backend DiskFile::toBackend(const std::string& string) {
+	if (string.empty())              return Backend::mmap;
+	if (string == "mmap")            return Backend::mmap;
+	if (string == "io_uring")        return Backend::io_uring;
+	if (string == "io_uring_direct") return Backend::io_uring_direct;
+	logger.fatal("Unexpected backend  %s", string);
+	ERROR();
+}
+const char* DiskFile::toString(Backend value) {
+	switch(value) {
+	case Backend::mmap:            return "mmap";
+	case Backend::io_uring:        return "io_uring";
+	case Backend::io_uring_direct: return "io_uring_direct";
+	default:
+		ERROR();
+	}
+}
+
+DiskFile::Flush DiskFile::toFlush(const std::string& string) {
+	if (string.empty())       return Flush::none;
+	if (string == "none")     return Flush::none;
+	if (string == "periodic") return Flush::periodic;
+	if (string == "idle")     return Flush::idle;
+	if (string == "journal")  return Flush::journal;
+	logger.fatal("Unexpected flush  %s", string);
+	ERROR();
+}
+const char* DiskFile::toString(Flush value) {
+	switch(value) {
+	case Flush::none:     return "none";
+	case Flush::periodic: return "periodic";
+	case Flush::idle:     return "idle";
+	case Flush::journal:  return "journal";
+	default:
+		ERROR();
+	}
+}
 
 ByteBuffer& DiskFile::Page::read(ByteBuffer& bb) {
 	for(auto& e: data) {
@@ -58,51 +115,992 @@ void DiskFile::Page::byteswap() {
 	}
 }
 
+// synchronous io for io_uring backend. use aligned buffer for O_DIRECT
+static void syncIO(int fd, bool write, uint32_t pageNo, uint16_t *buffer) {
+	alignas(4096) DiskFile::PageData temp;
+	off_t offset = (off_t)pageNo * DiskFile::PAGE_SIZE_IN_BYTE;
+	if (write) memcpy(temp, buffer, sizeof(temp));
+	auto ret = write ? pwrite(fd, temp, sizeof(temp), offset) : pread(fd, temp, sizeof(temp), offset);
+	if (ret != (ssize_t)sizeof(temp)) {
+		int errNo = errno;
+		logger.fatal("%s failed  pageNo = %d  ret = %d  errno = %d  %s", write ? "pwrite" : "pread", pageNo, (int)ret, errNo, strerror(errNo));
+		ERROR();
+	}
+	if (!write) memcpy(buffer, temp, sizeof(temp));
+}
+
 void DiskFile::readPage(uint32_t pageNo, uint16_t *buffer) {
 	if (pageSize <= pageNo) {
 		logger.fatal("pageNo = %d  pageSize = %d", pageNo, pageSize);
 		ERROR();
 	}
-	memcpy(buffer, pageData + pageNo, PAGE_SIZE_IN_BYTE);
+	if (isHole(pageNo)) {
+		PERF_COUNT(disk, sparse_read)
+		memset(buffer, 0, PAGE_SIZE_IN_BYTE);
+	} else if (pageData) {
+		memcpy(buffer, pageData + pageNo, PAGE_SIZE_IN_BYTE);
+	} else if (overlay.isAttached()) {
+		memcpy(buffer, overlay.readPage(pageNo), PAGE_SIZE_IN_BYTE);
+	} else {
+		syncIO(fd, false, pageNo, buffer);
+	}
 }
 void DiskFile::writePage(uint32_t pageNo, uint16_t *buffer) {
 	if (pageSize <= pageNo) {
 		logger.fatal("pageNo = %d  pageSize = %d", pageNo, pageSize);
 		ERROR();
 	}
-	memcpy(pageData + pageNo, buffer, PAGE_SIZE_IN_BYTE);
+	if (flushMode == Flush::journal) {
+		writeJournal(pageNo, {buffer});
+	} else {
+		writePageData(pageNo, buffer);
+	}
+}
+void DiskFile::writePageData(uint32_t pageNo, uint16_t *buffer) {
+	if (isHole(pageNo)) {
+		if (Util::isZero(buffer, PAGE_SIZE_IN_BYTE)) {
+			PERF_COUNT(disk, sparse_skip)
+			return;
+		}
+		// clear hole before write data
+		clearHole(pageNo, 1);
+	}
+	if (pageData) {
+		memcpy(pageData + pageNo, buffer, PAGE_SIZE_IN_BYTE);
+		// mark dirty after write data
+		markDirty(pageNo);
+	} else if (overlay.isAttached()) {
+		overlay.writePage(pageNo, buffer);
+	} else {
+		syncIO(fd, true, pageNo, buffer);
+	}
 }
 void DiskFile::zeroPage(uint32_t pageNo) {
 	PageData pageData;
 	bzero(pageData, sizeof pageData);
 	writePage(pageNo, pageData);
 }
+void DiskFile::writePages(uint32_t pageNo, const std::vector<uint16_t*>& buffers) {
+	uint32_t count = (uint32_t)buffers.size();
+	if (pageSize < pageNo + count) {
+		logger.fatal("pageNo = %d  count = %d  pageSize = %d", pageNo, count, pageSize);
+		ERROR();
+	}
+	// journal records zero page instead of punching hole, so that replay can't bring back old page
+	if (flushMode == Flush::journal) {
+		writeJournal(pageNo, buffers);
+		return;
+	}
+	auto isZeroBlock = [&](uint32_t i) {
+		for(uint32_t j = 0; j < SPARSE_BLOCK_PAGE; j++) {
+			if (!Util::isZero(buffers[i + j], PAGE_SIZE_IN_BYTE)) return false;
+		}
+		return true;
+	};
+
+	for(uint32_t i = 0; i < count;) {
+		uint32_t p = pageNo + i;
+		// punch run of all-zero SPARSE_BLOCK that starts from p
+		if (sparseEnable && !holeBitmap.empty() && (p % SPARSE_BLOCK_PAGE) == 0) {
+			uint32_t n = 0;
+			while(i + n + SPARSE_BLOCK_PAGE <= count && isZeroBlock(i + n)) n += SPARSE_BLOCK_PAGE;
+			if (n && punch(p / SPARSE_BLOCK_PAGE, n / SPARSE_BLOCK_PAGE)) {
+				i += n;
+				continue;
+			}
+			// write scanned pages normally
+			for(uint32_t j = 0; j < std::max(n, 1U); j++) writePageData(p + j, buffers[i + j]);
+			i += std::max(n, 1U);
+			continue;
+		}
+		writePageData(p, buffers[i]);
+		i++;
+	}
+}
 int DiskFile::verifyPage(uint32_t pageNo, uint16_t *buffer) {
 	if (pageSize <= pageNo) {
 		logger.fatal("pageNo = %d  pageSize = %d", pageNo, pageSize);
 		ERROR();
 	}
-	return memcmp(pageData + pageNo, buffer, PAGE_SIZE_IN_BYTE);
+	if (isHole(pageNo)) {
+		return Util::isZero(buffer, PAGE_SIZE_IN_BYTE) ? 0 : 1;
+	} else if (pageData) {
+		return memcmp(pageData + pageNo, buffer, PAGE_SIZE_IN_BYTE);
+	} else if (overlay.isAttached()) {
+		return memcmp(overlay.readPage(pageNo), buffer, PAGE_SIZE_IN_BYTE);
+	} else {
+		PageData temp;
+		syncIO(fd, false, pageNo, temp);
+		return memcmp(temp, buffer, PAGE_SIZE_IN_BYTE);
+	}
 }
 
-void DiskFile::attach(const std::string& path_) {
-	if (pageData != 0) ERROR();
-	path = path_;
-	logger.info("DiskFile::attach %s", path);
+void DiskFile::readAhead(uint32_t pageNo, uint32_t count) {
+	if (!readAheadEnable || count == 0) return;
+	if (backend == Backend::io_uring_direct) return;
 
-	auto [mapPage, mapSize] = Util::mapFile(path_);
-	pageData = (PageData*)mapPage;
-	byteSize = mapSize;
-	pageSize = byteSize / PAGE_SIZE_IN_BYTE;
+	uint32_t end = pageNo + count;
+	if (prefetchStart <= pageNo && end <= prefetchEnd) {
+		PERF_COUNT(disk, readahead_hit)
+	} else {
+		PERF_COUNT(disk, readahead_miss)
+	}
+
+	// grow window while read is sequential
+	if (pageNo == streamNext) {
+		streamWindow = (streamWindow == 0) ? READ_AHEAD_MIN_WINDOW : std::min(streamWindow * 2, READ_AHEAD_MAX_WINDOW);
+	} else {
+		streamWindow = 0;
+	}
+	streamNext = end;
+	if (streamWindow == 0) return;
+
+	// prefetch again when remaining prefetched pages becomes less than half of window
+	bool inPrefetch = prefetchStart <= end && end <= prefetchEnd;
+	if (inPrefetch && end + streamWindow / 2 <= prefetchEnd) return;
+
+	uint32_t start = inPrefetch ? prefetchEnd : end;
+	uint32_t stop  = std::min(end + streamWindow, pageSize);
+	if (stop <= start) return;
+
+	prefetch(start, stop - start);
+	if (!inPrefetch) prefetchStart = start;
+	prefetchEnd = stop;
+}
+
+void DiskFile::prefetch(uint32_t pageNo, uint32_t count) {
+	PERF_COUNT(disk, readahead_issue)
+	PERF_ADD(disk, readahead_page, count)
+
+	if (pageData) {
+		Util::willNeed(pageData, (uint64_t)pageNo * PAGE_SIZE_IN_BYTE, (uint64_t)count * PAGE_SIZE_IN_BYTE);
+	} else if (overlay.isAttached()) {
+		overlay.willNeed(pageNo, count);
+	} else {
+		prefetchRing(pageNo, count);
+	}
+}
+
+
+//
+// sparse image
+//
+void DiskFile::setHole(uint32_t blockNo) {
+	std::atomic_ref<uint64_t>(holeBitmap[blockNo / 64]).fetch_or(1ULL << (blockNo % 64), std::memory_order_release);
+}
+void DiskFile::clearHole(uint32_t pageNo, uint32_t count) {
+	if (holeBitmap.empty() || count == 0) return;
+	uint32_t first = pageNo / SPARSE_BLOCK_PAGE;
+	uint32_t last  = (pageNo + count - 1) / SPARSE_BLOCK_PAGE;
+	for(uint32_t blockNo = first; blockNo <= last; blockNo++) {
+		std::atomic_ref<uint64_t> word(holeBitmap[blockNo / 64]);
+		uint64_t mask = 1ULL << (blockNo % 64);
+		if (word.load(std::memory_order_relaxed) & mask) word.fetch_and(~mask, std::memory_order_acq_rel);
+	}
+}
+// return false if hole punching is not supported
+bool DiskFile::punch(uint32_t blockNo, uint32_t count) {
+	bool allHole = true;
+	for(uint32_t i = 0; i < count; i++) {
+		if (!isHole((blockNo + i) * SPARSE_BLOCK_PAGE)) allHole = false;
+	}
+	if (allHole) {
+		PERF_ADD(disk, sparse_skip, count * SPARSE_BLOCK_PAGE)
+		return true;
+	}
+	if (!Util::punchHole(fd, (uint64_t)blockNo * SPARSE_BLOCK, (uint64_t)count * SPARSE_BLOCK)) {
+		logger.warn("DiskFile disable sparse  %s", path);
+		sparseEnable = false;
+		return false;
+	}
+	// set hole after punch
+	for(uint32_t i = 0; i < count; i++) setHole(blockNo + i);
+	// hole is metadata of file. msync of range doesn't write back hole
+	syncPending = true;
+	PERF_ADD(disk, sparse_punch, count * SPARSE_BLOCK_PAGE)
+	return true;
+}
+
+void DiskFile::buildHoleBitmap() {
+	holeBitmap.clear();
+	if (!sparseEnable || fd < 0) return;
+#if defined(SEEK_HOLE) && defined(SEEK_DATA)
+	uint32_t blockSize = (byteSize + SPARSE_BLOCK - 1) / SPARSE_BLOCK;
+	holeBitmap.resize((blockSize + 63) / 64, 0);
+
+	uint32_t holeCount = 0;
+	off_t offset = 0;
+	while(offset < (off_t)byteSize) {
+		off_t hole = lseek(fd, offset, SEEK_HOLE);
+		if (hole < 0 || (off_t)byteSize <= hole) break;
+		off_t data = lseek(fd, hole, SEEK_DATA);
+		// ENXIO means no data after hole
+		if (data < 0) data = byteSize;
+		// SPARSE_BLOCK that is entirely in hole. last block can be partial
+		uint32_t first = (uint32_t)((hole + SPARSE_BLOCK - 1) / SPARSE_BLOCK);
+		uint32_t last  = ((off_t)byteSize <= data) ? blockSize : (uint32_t)(data / SPARSE_BLOCK);
+		for(uint32_t blockNo = first; blockNo < last; blockNo++) {
+			setHole(blockNo);
+			holeCount++;
+		}
+		offset = data;
+	}
+	logger.info("DiskFile sparse  hole %s / %s block", formatWithCommas(holeCount), formatWithCommas(blockSize));
+#endif
+}
+
+void DiskFile::create(const std::string& path, uint32_t pageSize) {
+	if (std::filesystem::exists(path)) {
+		logger.error("path already exists  %s", path);
+		ERROR();
+	}
+	{
+		std::ofstream ofs(path, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!ofs) ERROR();
+	}
+	// extend file without allocating disk block
+	std::filesystem::resize_file(path, (uint64_t)pageSize * PAGE_SIZE_IN_BYTE);
+	logger.info("DiskFile::create  %s  page %d", path, pageSize);
+}
+
+void DiskFile::copy(const std::string& source, const std::string& dest) {
+	int sourceFd;
+	int destFd;
+	int ret;
+	CHECK_SYSCALL(sourceFd, ::open(source.c_str(), O_RDONLY))
+	CHECK_SYSCALL(destFd, ::open(dest.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644))
+	off_t size = (off_t)std::filesystem::file_size(source);
+
+	bool reflink = false;
+#if defined(FICLONE)
+	// share disk block with source. block is copied when it is written
+	reflink = ioctl(destFd, FICLONE, sourceFd) == 0;
+#endif
+	if (!reflink) {
+		// copy data range only, so that hole of source stays hole
+		std::vector<uint8_t> buffer(1024 * 1024);
+		off_t offset = 0;
+		while(offset < size) {
+			off_t data = offset;
+			off_t hole = size;
+#if defined(SEEK_HOLE) && defined(SEEK_DATA)
+			data = lseek(sourceFd, offset, SEEK_DATA);
+			// ENXIO means no data after offset
+			if (data < 0) break;
+			hole = lseek(sourceFd, data, SEEK_HOLE);
+			if (hole < 0) hole = size;
+#endif
+			for(off_t pos = data; pos < hole;) {
+				ssize_t length;
+				CHECK_SYSCALL(length, pread(sourceFd, buffer.data(), std::min((off_t)buffer.size(), hole - pos), pos))
+				if (length == 0) break;
+				for(ssize_t done = 0; done < length;) {
+					ssize_t written;
+					CHECK_SYSCALL(written, pwrite(destFd, buffer.data() + done, length - done, pos + done))
+					done += written;
+				}
+				pos += length;
+			}
+			offset = hole;
+		}
+		CHECK_SYSCALL(ret, ftruncate(destFd, size))
+	}
+	CHECK_SYSCALL(ret, ::close(destFd))
+	CHECK_SYSCALL(ret, ::close(sourceFd))
+
+	// journal that is not replayed yet
+	auto journalPath = source + ".journal";
+	if (std::filesystem::exists(journalPath)) {
+		std::filesystem::copy_file(journalPath, dest + ".journal", std::filesystem::copy_options::overwrite_existing);
+	}
+	logger.info("DiskFile::copy  %s  %s  %s", source, dest, reflink ? "reflink" : "copy");
+}
+
+void DiskFile::remove(const std::string& path) {
+	std::filesystem::remove(path);
+	std::filesystem::remove(path + ".journal");
+}
+
+uint64_t DiskFile::getAllocatedSize(const std::string& path) {
+	struct stat statBuffer;
+	int ret;
+	CHECK_SYSCALL(ret, stat(path.c_str(), &statBuffer))
+	return (uint64_t)statBuffer.st_blocks * 512;
+}
+
+uint64_t DiskFile::compact(const std::string& path) {
+	static const constexpr uint32_t CHUNK_BLOCK = 256; // 1MB
+	auto before = getAllocatedSize(path);
+	auto size   = std::filesystem::file_size(path);
+
+	int fd_;
+	CHECK_SYSCALL(fd_, ::open(path.c_str(), O_RDWR))
+
+	std::vector<uint8_t> buffer(CHUNK_BLOCK * SPARSE_BLOCK);
+	uint64_t runStart  = 0; // start of all-zero run
+	uint64_t runLength = 0;
+	bool     supported = true;
+	auto flush = [&]() {
+		if (runLength && supported) supported = Util::punchHole(fd_, runStart, runLength);
+		runLength = 0;
+	};
+	for(uint64_t offset = 0; offset < size && supported; offset += buffer.size()) {
+		uint32_t length = (uint32_t)std::min((uint64_t)buffer.size(), size - offset);
+		auto ret = pread(fd_, buffer.data(), length, (off_t)offset);
+		if (ret != (ssize_t)length) {
+			int errNo = errno;
+			logger.fatal("pread failed  offset = %lu  ret = %d  errno = %d  %s", (unsigned long)offset, (int)ret, errNo, strerror(errNo));
+			ERROR();
+		}
+		for(uint32_t i = 0; i < length; i += SPARSE_BLOCK) {
+			uint32_t blockLength = std::min(SPARSE_BLOCK, length - i);
+			// partial last block is treated as zero if remaining bytes are zero
+			bool zero = (blockLength % 8) ? false : Util::isZero(buffer.data() + i, blockLength);
+			if (zero) {
+				if (runLength == 0) runStart = offset + i;
+				runLength += blockLength;
+			} else {
+				flush();
+			}
+		}
+	}
+	flush();
+	int ret;
+	CHECK_SYSCALL(ret, fsync(fd_))
+	CHECK_SYSCALL(ret, ::close(fd_))
+
+	if (!supported) logger.warn("DiskFile::compact  hole punching is not supported  %s", path);
+	auto after = getAllocatedSize(path);
+	logger.info("DiskFile::compact  %s  %s => %s", path, formatWithCommas(before), formatWithCommas(after));
+	return (after < before) ? (before - after) : 0;
+}
+
+void DiskFile::attach(const std::string& path_, Backend backend_, Flush flush_) {
+	if (pageData != 0 || 0 <= fd || overlay.isAttached()) ERROR();
+	path      = path_;
+	backend   = backend_;
+	flushMode = flush_;
+	logger.info("DiskFile::attach %s  %s  flush %s", path, toString(backend), toString(flushMode));
+
+	if (DiskOverlay::isOverlay(path)) {
+		if (backend != Backend::mmap) {
+			logger.fatal("overlay supports only mmap backend  %s", toString(backend));
+			ERROR();
+		}
+		if (flushMode != Flush::none) {
+			logger.fatal("overlay supports only none flush  %s", toString(flushMode));
+			ERROR();
+		}
+		overlay.attach(path);
+		pageSize = overlay.getPageSize();
+		byteSize = pageSize * PAGE_SIZE_IN_BYTE;
+	} else if (backend == Backend::mmap) {
+		auto [mapPage, mapSize] = Util::mapFile(path_);
+		pageData = (PageData*)mapPage;
+		byteSize = mapSize;
+		pageSize = byteSize / PAGE_SIZE_IN_BYTE;
+		CHECK_SYSCALL(fd, ::open(path.c_str(), O_RDWR))
+		replayJournal();
+		buildHoleBitmap();
+	} else {
+		if (flushMode == Flush::journal) {
+			logger.fatal("journal flush supports only mmap backend  %s", toString(backend));
+			ERROR();
+		}
+		attachRing();
+		buildHoleBitmap();
+	}
+	startFlush();
 }
 
 void DiskFile::detach() {
-	if (pageData == 0) return; // not attached
+	if (pageData == 0 && fd < 0 && !overlay.isAttached()) return; // not attached
 
 	logger.info("DiskFile::detach %s", path);
 
-	Util::unmapFile(pageData);
-	pageData = 0;
+	stopFlush();
+	if (pageData) {
+		Util::unmapFile(pageData);
+		pageData = 0;
+		::close(fd);
+		fd = -1;
+	} else if (overlay.isAttached()) {
+		overlay.detach();
+	} else {
+		detachRing();
+	}
 	byteSize = 0;
 	pageSize = 0;
+	backend  = Backend::mmap;
+	holeBitmap.clear();
+	flushMode = Flush::none;
+
+	streamNext    = 0;
+	streamWindow  = 0;
+	prefetchStart = 0;
+	prefetchEnd   = 0;
+}
+
+
+//
+// write-back
+//
+void DiskFile::flush() {
+	if (flushMode == Flush::journal) {
+		checkpoint();
+	} else {
+		flushDirty();
+	}
+}
+
+void DiskFile::notifyIdle() {
+	if (flushMode != Flush::idle) return;
+	{
+		std::unique_lock<std::mutex> lock(flushMutex);
+		flushRequest = true;
+	}
+	flushCV.notify_one();
+}
+
+void DiskFile::flushDirty() {
+	static const uint64_t hostPageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+	auto timeStart = tsc_clock::now();
+	int ret;
+
+	uint32_t flushPage = 0;
+	if (dirtyBitmap.empty()) {
+		// no dirty tracking. flush whole image
+		if (pageData) {
+			CHECK_SYSCALL(ret, msync(pageData, byteSize, MS_SYNC))
+		} else if (0 <= fd) {
+			CHECK_SYSCALL(ret, fdatasync(fd))
+		}
+		flushPage = pageSize;
+	} else {
+		auto sync = [&](uint32_t startBlock, uint32_t stopBlock) {
+			uint32_t startPage = startBlock * SPARSE_BLOCK_PAGE;
+			uint32_t stopPage  = std::min(stopBlock * SPARSE_BLOCK_PAGE, pageSize);
+			if (pageData) {
+				// address of msync must be aligned to host page
+				uint64_t start = ((uint64_t)startPage * PAGE_SIZE_IN_BYTE) & ~(hostPageSize - 1);
+				uint64_t stop  = (uint64_t)stopPage * PAGE_SIZE_IN_BYTE;
+				CHECK_SYSCALL(ret, msync((uint8_t*)pageData + start, stop - start, MS_SYNC))
+			}
+			flushPage += stopPage - startPage;
+		};
+		// coalesce contiguous dirty block. clear dirty before msync
+		uint32_t runStart = 0;
+		uint32_t runStop  = 0;
+		for(uint32_t i = 0; i < dirtyBitmap.size(); i++) {
+			uint64_t bits = std::atomic_ref<uint64_t>(dirtyBitmap[i]).exchange(0, std::memory_order_acq_rel);
+			for(; bits; bits &= bits - 1) {
+				uint32_t blockNo = i * 64 + std::countr_zero(bits);
+				if (blockNo != runStop) {
+					if (runStart != runStop) sync(runStart, runStop);
+					runStart = blockNo;
+				}
+				runStop = blockNo + 1;
+			}
+		}
+		if (runStart != runStop) sync(runStart, runStop);
+	}
+	bool needSync = syncPending.exchange(false);
+	if (needSync && 0 <= fd) CHECK_SYSCALL(ret, fdatasync(fd))
+	if (flushPage == 0 && !needSync) return;
+
+	PERF_COUNT(disk, flush)
+	PERF_ADD(disk, flush_page, flushPage)
+	if (PERF_ENABLE) {
+		auto duration = std::chrono::duration_cast<std::chrono::microseconds>(tsc_clock::now() - timeStart).count();
+		PERF_RECORD(disk, flush_time, duration)
+	}
+}
+
+void DiskFile::runFlush() {
+	logger.info("DiskFile flush start  %s  %s  %d ms", path, toString(flushMode), (int)flushInterval.count());
+
+	// avoid flush storm of frequent idle
+	auto minimumGap = flushInterval / 10;
+	auto lastFlush  = std::chrono::steady_clock::now();
+	for(;;) {
+		bool stop;
+		{
+			std::unique_lock<std::mutex> lock(flushMutex);
+			flushCV.wait_until(lock, lastFlush + flushInterval, [this]{ return flushStop || flushRequest; });
+			if (flushRequest && !flushStop) {
+				flushCV.wait_until(lock, lastFlush + minimumGap, [this]{ return flushStop; });
+			}
+			stop         = flushStop;
+			flushRequest = false;
+		}
+		flush();
+		lastFlush = std::chrono::steady_clock::now();
+		if (stop) break;
+	}
+
+	logger.info("DiskFile flush stop   %s", path);
+}
+
+void DiskFile::startFlush() {
+	if (flushMode == Flush::none) return;
+
+	uint32_t blockSize = (pageSize + SPARSE_BLOCK_PAGE - 1) / SPARSE_BLOCK_PAGE;
+	dirtyBitmap.assign((blockSize + 63) / 64, 0);
+	flushStop    = false;
+	flushRequest = false;
+	flushThread  = std::thread(&DiskFile::runFlush, this);
+}
+
+// flush thread flushes before stop
+void DiskFile::stopFlush() {
+	if (!flushThread.joinable()) return;
+	{
+		std::unique_lock<std::mutex> lock(flushMutex);
+		flushStop = true;
+	}
+	flushCV.notify_one();
+	flushThread.join();
+	dirtyBitmap.clear();
+
+	if (0 <= journalFd) {
+		// journal is empty after last checkpoint
+		::close(journalFd);
+		journalFd = -1;
+		std::filesystem::remove(getJournalPath());
+	}
+}
+
+
+//
+// journal
+//
+uint32_t DiskFile::JournalRecord::calculateChecksum() const {
+	// FNV-1a
+	uint32_t hash = 2166136261U;
+	auto add = [&](const void* p, uint32_t size) {
+		for(uint32_t i = 0; i < size; i++) {
+			hash ^= ((const uint8_t*)p)[i];
+			hash *= 16777619U;
+		}
+	};
+	add(&pageNo, sizeof(pageNo));
+	add(&sequence, sizeof(sequence));
+	add(data, sizeof(data));
+	return hash;
+}
+
+void DiskFile::replayJournal() {
+	auto journalPath = getJournalPath();
+	if (std::filesystem::exists(journalPath) && std::filesystem::file_size(journalPath) != 0) {
+		// record of unfinished write can be torn. skip invalid record and continue
+		std::vector<JournalRecord> records(std::filesystem::file_size(journalPath) / sizeof(JournalRecord));
+		{
+			std::ifstream ifs(journalPath, std::ios::in | std::ios::binary);
+			ifs.read((char*)records.data(), records.size() * sizeof(JournalRecord));
+			if (!ifs) ERROR();
+		}
+		std::vector<const JournalRecord*> validList;
+		for(const auto& record: records) {
+			if (record.magic != JournalRecord::MAGIC) continue;
+			if (pageSize <= record.pageNo) continue;
+			if (record.checksum != record.calculateChecksum()) continue;
+			validList.push_back(&record);
+		}
+		// apply in order of sequence
+		std::sort(validList.begin(), validList.end(), [](const JournalRecord* a, const JournalRecord* b) {
+			return a->sequence < b->sequence;
+		});
+		for(auto record: validList) {
+			memcpy(pageData + record->pageNo, record->data, PAGE_SIZE_IN_BYTE);
+		}
+		int ret;
+		CHECK_SYSCALL(ret, msync(pageData, byteSize, MS_SYNC))
+		logger.info("DiskFile replay journal  %s  record %d / %d", journalPath, validList.size(), records.size());
+	}
+
+	if (flushMode == Flush::journal) {
+		CHECK_SYSCALL(journalFd, ::open(journalPath.c_str(), O_RDWR | O_CREAT, 0644))
+		int ret;
+		CHECK_SYSCALL(ret, ftruncate(journalFd, 0))
+		CHECK_SYSCALL(ret, fdatasync(journalFd))
+		journalOffset   = 0;
+		journalSequence = 0;
+	} else if (std::filesystem::exists(journalPath)) {
+		std::filesystem::remove(journalPath);
+	}
+}
+
+void DiskFile::writeJournal(uint32_t pageNo, const std::vector<uint16_t*>& buffers) {
+	uint32_t count = (uint32_t)buffers.size();
+	if (count == 0) return;
+
+	std::vector<JournalRecord> records(count);
+	bool full;
+	{
+		std::shared_lock<std::shared_mutex> lock(checkpointMutex);
+
+		uint64_t sequence = journalSequence.fetch_add(count);
+		for(uint32_t i = 0; i < count; i++) {
+			auto& record = records[i];
+			record.magic    = JournalRecord::MAGIC;
+			record.pageNo   = pageNo + i;
+			record.sequence = sequence + i;
+			record.reserved = 0;
+			memcpy(record.data, buffers[i], PAGE_SIZE_IN_BYTE);
+			record.checksum = record.calculateChecksum();
+		}
+		uint64_t byteCount = (uint64_t)count * sizeof(JournalRecord);
+		uint64_t offset    = journalOffset.fetch_add(byteCount);
+		auto written = pwrite(journalFd, records.data(), byteCount, (off_t)offset);
+		if (written != (ssize_t)byteCount) {
+			int errNo = errno;
+			logger.fatal("pwrite failed  %s  ret = %d  errno = %d  %s", getJournalPath(), (int)written, errNo, strerror(errNo));
+			ERROR();
+		}
+		syncJournal();
+		PERF_ADD(disk, journal_page, count)
+
+		// journal is durable. write to image
+		for(uint32_t i = 0; i < count; i++) writePageData(pageNo + i, buffers[i]);
+		full = JOURNAL_MAX_BYTE <= journalOffset;
+	}
+	if (full) {
+		{
+			std::unique_lock<std::mutex> lock(flushMutex);
+			flushRequest = true;
+		}
+		flushCV.notify_one();
+	}
+}
+
+void DiskFile::syncJournal() {
+	std::unique_lock<std::mutex> lock(syncMutex);
+	// fdatasync that is not started yet covers record of caller
+	const uint64_t target = syncNext;
+	while(syncFinished < target) {
+		if (syncLeader) {
+			syncCV.wait(lock);
+			continue;
+		}
+		// become leader. gather writers until interval from last fdatasync is passed
+		syncLeader = true;
+		lock.unlock();
+		std::this_thread::sleep_until(syncTime + JOURNAL_SYNC_INTERVAL);
+		lock.lock();
+		// writer arriving after this point waits for next fdatasync
+		const uint64_t generation = syncNext++;
+		syncTime = std::chrono::steady_clock::now();
+		lock.unlock();
+
+		int ret;
+		CHECK_SYSCALL(ret, fdatasync(journalFd))
+		PERF_COUNT(disk, journal_sync)
+
+		lock.lock();
+		syncFinished = generation;
+		syncLeader   = false;
+		syncCV.notify_all();
+	}
+}
+
+void DiskFile::checkpoint() {
+	// stop writer while image is flushed and journal is truncated
+	std::unique_lock<std::shared_mutex> lock(checkpointMutex);
+	flushDirty();
+	if (journalOffset == 0) return;
+
+	int ret;
+	CHECK_SYSCALL(ret, ftruncate(journalFd, 0))
+	CHECK_SYSCALL(ret, fdatasync(journalFd))
+	journalOffset = 0;
+	PERF_COUNT(disk, checkpoint)
 }
+
+
+//
+// io_uring backend
+//
+#if defined(__linux__)
+
+class DiskFile::Ring {
+public:
+	static const constexpr uint32_t ENTRIES = 256;
+	// user_data of stop request and fadvise request
+	static const constexpr uint64_t USER_DATA_STOP   = 0;
+	static const constexpr uint64_t USER_DATA_ADVISE = 1;
+
+	// O_DIRECT needs buffer, file offset and length aligned to logical block size.
+	// Buffer of guest is aligned to PAGE_SIZE_IN_BYTE only, so direct io goes through buffer aligned to ALIGN.
+	// File offset and length are multiple of PAGE_SIZE_IN_BYTE only, so attachRing refuses
+	// io_uring_direct when logical block size of file is larger than PAGE_SIZE_IN_BYTE.
+	static const constexpr uint32_t ALIGN = 4096;
+
+	struct Inflight {
+		Request            request;
+		std::vector<iovec> iov;
+		uint8_t*           alignedBuffer; // contiguous buffer for verify and direct io. null for guest buffer
+		uint32_t           byteSize;
+		uint32_t           done;          // transferred bytes so far
+		bool               punch;         // all-zero write is done by punching hole
+		uint64_t           writeSequence; // writeSequence of Ring at submit of punch
+	};
+
+	IOUring          uring;
+	std::atomic<int> inflightCount = 0;
+	bool             stop          = false; // accessed only from completion thread
+	// incremented at submit of each write. punch that completes after other write doesn't set hole
+	std::atomic<uint64_t> writeSequence = 0;
+
+	// prepare sqe for remaining part of inflight
+	void prepare(int fd, Inflight* inflight) {
+		if (inflight->punch) {
+			uring.submit([&](io_uring_sqe& sqe) {
+				sqe.opcode    = IORING_OP_FALLOCATE;
+				sqe.fd        = fd;
+				sqe.off       = (uint64_t)inflight->request.pageNo * PAGE_SIZE_IN_BYTE;
+				sqe.addr      = inflight->byteSize; // length
+				sqe.len       = FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE; // mode
+				sqe.user_data = (uint64_t)inflight;
+				if (inflight->request.barrier) sqe.flags |= IOSQE_IO_DRAIN;
+			});
+			return;
+		}
+		// resubmit of short io starts from page boundary, so that offset keeps alignment of O_DIRECT.
+		// transfer of partial page again is harmless
+		inflight->done -= inflight->done % PAGE_SIZE_IN_BYTE;
+		inflight->iov.clear();
+		if (inflight->alignedBuffer) {
+			inflight->iov.push_back({inflight->alignedBuffer + inflight->done, inflight->byteSize - inflight->done});
+		} else {
+			for(uint32_t i = inflight->done / PAGE_SIZE_IN_BYTE; i < inflight->request.buffers.size(); i++) {
+				inflight->iov.push_back({inflight->request.buffers[i], PAGE_SIZE_IN_BYTE});
+			}
+		}
+		bool write = inflight->request.operation == Operation::write;
+		uint64_t offset = (uint64_t)inflight->request.pageNo * PAGE_SIZE_IN_BYTE + inflight->done;
+		uring.submit([&](io_uring_sqe& sqe) {
+			sqe.opcode    = write ? IORING_OP_WRITEV : IORING_OP_READV;
+			sqe.fd        = fd;
+			sqe.off       = offset;
+			sqe.addr      = (uint64_t)inflight->iov.data();
+			sqe.len       = (uint32_t)inflight->iov.size();
+			sqe.user_data = (uint64_t)inflight;
+			if (inflight->request.barrier) sqe.flags |= IOSQE_IO_DRAIN;
+		});
+	}
+};
+
+// alignment of file offset for O_DIRECT. 0 for unknown
+static uint32_t directAlign(int fd, const struct stat& statBuffer) {
+	if (S_ISBLK(statBuffer.st_mode)) {
+		int size = 0;
+		if (ioctl(fd, BLKSSZGET, &size) == 0) return (uint32_t)size;
+	}
+#if defined(STATX_DIOALIGN)
+	struct statx statxBuffer;
+	if (statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &statxBuffer) == 0 && (statxBuffer.stx_mask & STATX_DIOALIGN)) {
+		return statxBuffer.stx_dio_offset_align;
+	}
+#endif
+	// kernel doesn't report alignment. read one page at odd page offset
+	if (statBuffer.st_size < 2 * DiskFile::PAGE_SIZE_IN_BYTE) return 0;
+	alignas(4096) DiskFile::PageData temp;
+	if (pread(fd, temp, sizeof(temp), DiskFile::PAGE_SIZE_IN_BYTE) == (ssize_t)sizeof(temp)) return DiskFile::PAGE_SIZE_IN_BYTE;
+	// EINVAL means alignment is larger than page
+	return errno == EINVAL ? 2 * DiskFile::PAGE_SIZE_IN_BYTE : 0;
+}
+
+void DiskFile::attachRing() {
+	int flags = O_RDWR;
+	if (backend == Backend::io_uring_direct) flags |= O_DIRECT;
+	fd = ::open(path.c_str(), flags);
+	if (fd < 0) {
+		int errNo = errno;
+		logger.fatal("open failed  %s  errno = %d  %s", path, errNo, strerror(errNo));
+		ERROR();
+	}
+	struct stat statBuffer;
+	if (fstat(fd, &statBuffer)) ERROR();
+	byteSize = (uint32_t)statBuffer.st_size;
+	pageSize = byteSize / PAGE_SIZE_IN_BYTE;
+
+	if (backend == Backend::io_uring_direct) {
+		uint32_t align = directAlign(fd, statBuffer);
+		if (align == 0) {
+			logger.warn("DiskFile unknown alignment of direct io  %s", path);
+		} else if (PAGE_SIZE_IN_BYTE < align) {
+			logger.fatal("DiskFile alignment of direct io is larger than page  %s  align = %d", path, align);
+			logger.fatal("use io_uring backend instead of %s", toString(backend));
+			ERROR();
+		}
+	}
+
+	ring = new Ring;
+	ring->uring.open(Ring::ENTRIES);
+	completionThread = std::thread(&DiskFile::runCompletion, this);
+}
+
+void DiskFile::detachRing() {
+	// NOP with user_data 0 stops completion thread after all inflight request is completed
+	ring->uring.submit([](io_uring_sqe& sqe) {
+		sqe.opcode    = IORING_OP_NOP;
+		sqe.user_data = Ring::USER_DATA_STOP;
+	});
+	ring->uring.flush();
+	completionThread.join();
+	if (syncPending.exchange(false)) fdatasync(fd);
+
+	delete ring;
+	ring = 0;
+	::close(fd);
+	fd = -1;
+}
+
+// fadvise is submitted with next submit()
+void DiskFile::prefetchRing(uint32_t pageNo, uint32_t count) {
+	if (ring == 0) return;
+	ring->uring.submit([&](io_uring_sqe& sqe) {
+		sqe.opcode     = IORING_OP_FADVISE;
+		sqe.fd         = fd;
+		sqe.off        = (uint64_t)pageNo * PAGE_SIZE_IN_BYTE;
+		sqe.len        = count * PAGE_SIZE_IN_BYTE;
+		sqe.fadvise_advice = POSIX_FADV_WILLNEED;
+		sqe.user_data  = Ring::USER_DATA_ADVISE;
+	});
+}
+
+void DiskFile::submit(std::vector<Request>& requestList) {
+	if (ring == 0) ERROR();
+
+	for(auto& request: requestList) {
+		uint32_t count = (uint32_t)request.buffers.size();
+		if (pageSize < request.pageNo + count) {
+			logger.fatal("pageNo = %d  count = %d  pageSize = %d", request.pageNo, count, pageSize);
+			ERROR();
+		}
+		auto inflight = new Ring::Inflight{request, {}, 0, count * PAGE_SIZE_IN_BYTE, 0, false, 0};
+		if (request.operation == Operation::verify || backend == Backend::io_uring_direct) {
+			uint32_t size = (count * PAGE_SIZE_IN_BYTE + Ring::ALIGN - 1) / Ring::ALIGN * Ring::ALIGN;
+			inflight->alignedBuffer = (uint8_t*)std::aligned_alloc(Ring::ALIGN, size);
+		}
+		if (request.operation == Operation::write) {
+			// increment before clearHole. see completion of punch
+			inflight->writeSequence = ++ring->writeSequence;
+			clearHole(request.pageNo, count);
+			if (sparseEnable) {
+				inflight->punch = std::all_of(request.buffers.begin(), request.buffers.end(), [](uint16_t* buffer) {
+					return Util::isZero(buffer, PAGE_SIZE_IN_BYTE);
+				});
+			}
+			if (inflight->alignedBuffer) {
+				for(uint32_t i = 0; i < count; i++) {
+					memcpy(inflight->alignedBuffer + i * PAGE_SIZE_IN_BYTE, request.buffers[i], PAGE_SIZE_IN_BYTE);
+				}
+			}
+		}
+		asyncPendingCount++;
+		ring->inflightCount++;
+		ring->prepare(fd, inflight);
+	}
+	ring->uring.flush();
+}
+
+void DiskFile::runCompletion() {
+	logger.info("DiskFile completion start  %s", path);
+
+	auto finish = [this](Ring::Inflight* inflight, int result) {
+		if (result < 0) {
+			logger.error("DiskFile io error  %s  pageNo = %d  errno = %d  %s", path, inflight->request.pageNo, -result, strerror(-result));
+		} else if (inflight->request.operation == Operation::verify) {
+			for(uint32_t i = 0; i < inflight->request.buffers.size(); i++) {
+				if (memcmp(inflight->alignedBuffer + i * PAGE_SIZE_IN_BYTE, inflight->request.buffers[i], PAGE_SIZE_IN_BYTE)) result = 1;
+			}
+		} else if (inflight->request.operation == Operation::read && inflight->alignedBuffer) {
+			for(uint32_t i = 0; i < inflight->request.buffers.size(); i++) {
+				memcpy(inflight->request.buffers[i], inflight->alignedBuffer + i * PAGE_SIZE_IN_BYTE, PAGE_SIZE_IN_BYTE);
+			}
+		}
+		if (result == 0 && inflight->request.operation == Operation::write) {
+			for(uint32_t i = 0; i < inflight->request.buffers.size(); i++) markDirty(inflight->request.pageNo + i);
+			syncPending = true;
+		}
+		completion(inflight->request.context, result);
+
+		std::free(inflight->alignedBuffer);
+		delete inflight;
+		ring->inflightCount--;
+		asyncPendingCount--;
+	};
+
+	while(!(ring->stop && ring->inflightCount == 0)) {
+		bool resubmit = false;
+		ring->uring.wait([&](const io_uring_cqe& cqe) {
+			if (cqe.user_data == Ring::USER_DATA_STOP) {
+				ring->stop = true;
+				return;
+			}
+			if (cqe.user_data == Ring::USER_DATA_ADVISE) return;
+			auto inflight = (Ring::Inflight*)cqe.user_data;
+			if (inflight->punch) {
+				if (cqe.res < 0) {
+					// hole punching is not supported. write zero instead
+					logger.warn("DiskFile disable sparse  %s  errno = %d  %s", path, -cqe.res, strerror(-cqe.res));
+					sparseEnable    = false;
+					inflight->punch = false;
+					ring->prepare(fd, inflight);
+					resubmit = true;
+				} else {
+					PERF_ADD(disk, sparse_punch, inflight->request.buffers.size())
+					// set hole of SPARSE_BLOCK entirely in range, as writePages does.
+					// other write submitted after this punch can be in same block. then clear hole again,
+					// because its clearHole can run before setHole. missing hole is harmless
+					if (!holeBitmap.empty() && inflight->writeSequence == ring->writeSequence) {
+						uint32_t pageNo = inflight->request.pageNo;
+						uint32_t count  = (uint32_t)inflight->request.buffers.size();
+						uint32_t first  = (pageNo + SPARSE_BLOCK_PAGE - 1) / SPARSE_BLOCK_PAGE;
+						uint32_t last   = (pageNo + count) / SPARSE_BLOCK_PAGE;
+						for(uint32_t blockNo = first; blockNo < last; blockNo++) setHole(blockNo);
+						if (inflight->writeSequence != ring->writeSequence) clearHole(pageNo, count);
+					}
+					finish(inflight, 0);
+				}
+				return;
+			}
+			if (cqe.res < 0) {
+				finish(inflight, cqe.res);
+				return;
+			}
+			inflight->done += cqe.res;
+			if (inflight->done == inflight->byteSize) {
+				finish(inflight, 0);
+			} else if (cqe.res == 0) {
+				// unexpected end of file
+				finish(inflight, -EIO);
+			} else {
+				// short read or write. submit remaining part
+				ring->prepare(fd, inflight);
+				resubmit = true;
+			}
+		});
+		if (resubmit) ring->uring.flush();
+	}
+
+	logger.info("DiskFile completion stop   %s", path);
+}
+
+#else
+
+class DiskFile::Ring {};
+
+void DiskFile::attachRing() {
+	logger.fatal("io_uring backend is not supported on this platform  %s", toString(backend));
+	ERROR();
+}
+void DiskFile::detachRing() {}
+void DiskFile::prefetchRing(uint32_t /* pageNo */, uint32_t /* count */) {}
+void DiskFile::submit(std::vector<Request>& /* requestList */) {
+	ERROR();
+}
+void DiskFile::runCompletion() {}
+
+#endif
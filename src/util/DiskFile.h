@@ -35,10 +35,19 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "ByteBuffer.h"
+#include "DiskOverlay.h"
 
 
 class DiskFile {
@@ -56,20 +65,149 @@ public:
 		void byteswap();
 	};
 
+	// mmap            memcpy from/to mmapped file
+	// io_uring        asynchronous io using io_uring
+	// io_uring_direct asynchronous io using io_uring with O_DIRECT
+	enum class Backend {
+		mmap, io_uring, io_uring_direct,
+	};
+	static Backend toBackend(const std::string& string);
+	static const char* toString(Backend value);
+
+	// write-back policy of written page
+	//   none      kernel decides when to write back
+	//   periodic  flush dirty range every flush interval
+	//   idle      flush when disk becomes idle. at most 10 times per flush interval, at least once per flush interval
+	//   journal   append written page to journal file and fdatasync before write to image.
+	//             concurrent writers share one fdatasync (group commit). fdatasync starts at most once per
+	//             JOURNAL_SYNC_INTERVAL, and writers arriving in the interval join the next one.
+	//             image is flushed and journal is truncated at every flush interval or when journal becomes large.
+	//             journal is replayed at attach. supports only mmap backend
+	enum class Flush {
+		none, periodic, idle, journal,
+	};
+	static Flush toFlush(const std::string& string);
+	static const char* toString(Flush value);
+
+	// asynchronous request for io_uring backend
+	enum class Operation {
+		read, write, verify,
+	};
+	struct Request {
+		Operation              operation;
+		uint32_t               pageNo;  // first page number
+		std::vector<uint16_t*> buffers; // buffer of each page
+		void*                  context; // passed to Completion
+		bool                   barrier = false; // start after all previous requests are completed
+	};
+	// result is 0 for success, 1 for verify mismatch, -errno for error
+	// Completion is called from completion thread of DiskFile
+	using Completion = std::function<void(void* context, int result)>;
+
 	// default constructor
 	DiskFile() {
 		pageData = 0;
 		byteSize = 0;
 		pageSize = 0;
+		backend  = Backend::mmap;
+		fd       = -1;
+		ring     = 0;
+		flushMode     = Flush::none;
+		flushInterval = DEFAULT_FLUSH_INTERVAL;
+		journalFd     = -1;
 	}
 
-	void attach(const std::string& path);
+	// create new disk image of pageSize pages. image is sparse and occupies no disk block
+	static void create(const std::string& path, uint32_t pageSize);
+	// punch hole of all-zero block of existing image. return number of released byte
+	//   don't compact image that is attached by other process
+	static uint64_t compact(const std::string& path);
+	// copy image and its journal. disk block is shared with reflink if file system supports, otherwise hole is kept
+	static void copy(const std::string& source, const std::string& dest);
+	// remove image and its journal
+	static void remove(const std::string& path);
+	// disk space used by path in byte
+	static uint64_t getAllocatedSize(const std::string& path);
+
+	// path can be overlay file created by DiskOverlay::create. overlay supports only mmap backend
+	//   journal file of path is replayed even if flush is not journal
+	void attach(const std::string& path, Backend backend = Backend::mmap, Flush flush = Flush::none);
 	void detach();
 
+	Backend getBackend() {
+		return backend;
+	}
+	bool isAsync() {
+		return backend != Backend::mmap;
+	}
+	bool isOverlay() {
+		return overlay.isAttached();
+	}
+	DiskOverlay& getOverlay() {
+		return overlay;
+	}
+	// set completion before submit
+	void setCompletion(Completion completion_) {
+		completion = completion_;
+	}
+	// submit all requests at once. Completion can be called out of order
+	void submit(std::vector<Request>& requestList);
+
+	// Read-ahead
+	//   Detect sequential read stream and prefetch pages ahead of guest.
+	//   mmap and overlay use madvise(MADV_WILLNEED). io_uring uses asynchronous fadvise(WILLNEED).
+	//   io_uring_direct bypass host page cache, so no read-ahead.
+	//   Call readAhead before reading pages. not thread safe, call from one thread.
+	void readAhead(uint32_t pageNo, uint32_t count);
+	void setReadAhead(bool newValue) {
+		readAheadEnable = newValue;
+	}
+
+	// Sparse image
+	//   Hole of image is tracked in unit of SPARSE_BLOCK. holeBitmap is built from SEEK_HOLE at attach.
+	//   Read from hole returns zero without touching mapped file, and zero write to hole is skipped.
+	//   writePages punches hole for all-zero SPARSE_BLOCK in range. io_uring punches all-zero write request.
+	//   Overlay is not sparse aware. DiskOverlay::commit releases its page data.
+	static const constexpr uint32_t SPARSE_BLOCK      = 4096;
+	static const constexpr uint32_t SPARSE_BLOCK_PAGE = SPARSE_BLOCK / PAGE_SIZE_IN_BYTE;
+	void setSparse(bool newValue) {
+		sparseEnable = newValue;
+	}
+	bool isHole(uint32_t pageNo) {
+		if (holeBitmap.empty()) return false;
+		uint32_t blockNo = pageNo / SPARSE_BLOCK_PAGE;
+		return std::atomic_ref<uint64_t>(holeBitmap[blockNo / 64]).load(std::memory_order_acquire) & (1ULL << (blockNo % 64));
+	}
+
+	// Write-back
+	//   Dirty page is tracked in unit of SPARSE_BLOCK and flushed with msync.
+	//   io_uring backend uses fdatasync.
+	static const constexpr std::chrono::milliseconds DEFAULT_FLUSH_INTERVAL = std::chrono::milliseconds(1000);
+	static const constexpr uint64_t                  JOURNAL_MAX_BYTE       = 64 * 1024 * 1024;
+	static const constexpr std::chrono::microseconds JOURNAL_SYNC_INTERVAL  = std::chrono::microseconds(1000);
+	// call before attach
+	void setFlushInterval(std::chrono::milliseconds newValue) {
+		flushInterval = newValue;
+	}
+	Flush getFlush() {
+		return flushMode;
+	}
+	// write back dirty page now. journal mode also truncates journal
+	void flush();
+	// disk agent has no pending request
+	void notifyIdle();
+
+	// true if any asynchronous request is in flight
+	static bool isAsyncPending() {
+		return asyncPendingCount != 0;
+	}
+
 	void readPage  (uint32_t pageNo, uint16_t *buffer);
 	void writePage (uint32_t pageNo, uint16_t *buffer);
 	int  verifyPage(uint32_t pageNo, uint16_t *buffer);
 	void zeroPage  (uint32_t pageNo);
+	// write contiguous pages starting from pageNo. all-zero block becomes hole
+	void writePages(uint32_t pageNo, const std::vector<uint16_t*>& buffers);
 
 	void readPage  (uint32_t pageNo, Page& page) {
 		readPage(pageNo, page.data);
@@ -96,4 +234,100 @@ private:
 	PageData*   pageData;
 	uint32_t    byteSize;
 	uint32_t    pageSize;
+
+	DiskOverlay overlay;
+
+	// for read-ahead
+	static const constexpr uint32_t READ_AHEAD_MIN_WINDOW =   32; // 16KB
+	static const constexpr uint32_t READ_AHEAD_MAX_WINDOW = 2048; //  1MB
+	bool        readAheadEnable = true;
+	uint32_t    streamNext      = 0; // expected pageNo of next sequential read
+	uint32_t    streamWindow    = 0; // 0 means no sequential stream
+	uint32_t    prefetchStart   = 0; // prefetched range [prefetchStart, prefetchEnd)
+	uint32_t    prefetchEnd     = 0;
+
+	void prefetch(uint32_t pageNo, uint32_t count);
+
+	// for sparse image
+	std::atomic<bool>     sparseEnable = true;
+	std::vector<uint64_t> holeBitmap; // one bit for each SPARSE_BLOCK. 1 means hole
+
+	void buildHoleBitmap();
+	void setHole  (uint32_t blockNo);
+	void clearHole(uint32_t pageNo, uint32_t count);
+	bool punch    (uint32_t blockNo, uint32_t count);
+
+	void writePageData(uint32_t pageNo, uint16_t *buffer);
+
+	// for write-back
+	Flush                     flushMode;
+	std::chrono::milliseconds flushInterval;
+	std::vector<uint64_t>     dirtyBitmap;  // one bit for each SPARSE_BLOCK. 1 means dirty
+	std::atomic<bool>         syncPending  = false; // need fdatasync for punched hole or io_uring write
+	std::thread               flushThread;
+	std::mutex                flushMutex;
+	std::condition_variable   flushCV;
+	bool                      flushStop    = false; // guarded by flushMutex
+	bool                      flushRequest = false; // guarded by flushMutex. idle or large journal
+
+	void markDirty(uint32_t pageNo) {
+		if (dirtyBitmap.empty()) return;
+		uint32_t blockNo = pageNo / SPARSE_BLOCK_PAGE;
+		std::atomic_ref<uint64_t> word(dirtyBitmap[blockNo / 64]);
+		uint64_t mask = 1ULL << (blockNo % 64);
+		if (!(word.load(std::memory_order_relaxed) & mask)) word.fetch_or(mask, std::memory_order_release);
+	}
+	void flushDirty();
+	void runFlush();
+	void startFlush();
+	void stopFlush();
+
+	// for journal
+	//   record is fixed size. record of concurrent writer can be out of order in journal file
+	struct JournalRecord {
+		static const constexpr uint32_t MAGIC = 0x4C4E4A4D; // "MJNL"
+		uint32_t magic;
+		uint32_t pageNo;
+		uint64_t sequence;
+		uint32_t checksum; // of pageNo, sequence and data
+		uint32_t reserved;
+		PageData data;
+
+		uint32_t calculateChecksum() const;
+	};
+	int                   journalFd;
+	std::atomic<uint64_t> journalOffset   = 0; // next record offset
+	std::atomic<uint64_t> journalSequence = 0;
+	std::shared_mutex     checkpointMutex; // writer takes shared lock. checkpoint takes exclusive lock
+	// group commit. fdatasync covers record written before it starts
+	std::mutex              syncMutex;
+	std::condition_variable syncCV;
+	uint64_t                syncNext     = 1;     // guarded by syncMutex. generation of fdatasync that is not started yet
+	uint64_t                syncFinished = 0;     // guarded by syncMutex. generation of last finished fdatasync
+	bool                    syncLeader   = false; // guarded by syncMutex. true while leader gathers or syncs
+	std::chrono::steady_clock::time_point syncTime; // guarded by syncMutex. start time of last fdatasync
+
+	std::string getJournalPath() {
+		return path + ".journal";
+	}
+	void replayJournal();
+	void writeJournal(uint32_t pageNo, const std::vector<uint16_t*>& buffers);
+	// wait until record written by caller is durable
+	void syncJournal();
+	void checkpoint();
+
+	// for io_uring backend
+	class Ring;
+	Backend     backend;
+	int         fd;     // mmap backend also opens fd for hole punching
+	Ring*       ring;
+	Completion  completion;
+	std::thread completionThread;
+
+	static inline std::atomic<int> asyncPendingCount;
+
+	void attachRing();
+	void detachRing();
+	void prefetchRing(uint32_t pageNo, uint32_t count);
+	void runCompletion();
 };
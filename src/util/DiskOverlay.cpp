@@ -0,0 +1,315 @@
+/*******************************************************************************
+ * Copyright (c) 2025, Yasuhiro Hasegawa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+//
+// DiskOverlay.cpp
+//
+
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <set>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Util.h"
+static const Logger logger(__FILE__);
+
+#include "DiskOverlay.h"
+
+static uint32_t roundUp(uint32_t value, uint32_t unit) {
+	return ((value + unit - 1) / unit) * unit;
+}
+
+bool DiskOverlay::isOverlay(const std::string& path) {
+	std::ifstream ifs(path, std::ios::in | std::ios::binary);
+	char magic[sizeof(MAGIC)];
+	if (!ifs.read(magic, sizeof(magic))) return false;
+	return memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+bool DiskOverlay::readHeader(const std::string& path, Header& header) {
+	std::ifstream ifs(path, std::ios::in | std::ios::binary);
+	if (!ifs.read((char*)&header, sizeof(header))) return false;
+	return memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+std::string DiskOverlay::toBasePath(const std::string& path, const Header& header) {
+	std::filesystem::path baseFilePath(header.basePath);
+	if (baseFilePath.is_relative()) baseFilePath = std::filesystem::absolute(path).parent_path() / baseFilePath;
+	return baseFilePath.lexically_normal().string();
+}
+
+int64_t DiskOverlay::getModifyTime(const std::string& path) {
+	struct stat statBuffer;
+	int ret;
+	CHECK_SYSCALL(ret, stat(path.c_str(), &statBuffer))
+#if defined(__APPLE__)
+	const auto& time = statBuffer.st_mtimespec;
+#else
+	const auto& time = statBuffer.st_mtim;
+#endif
+	return (int64_t)time.tv_sec * 1'000'000'000 + time.tv_nsec;
+}
+
+std::vector<std::string> DiskOverlay::findOther(const std::string& path) {
+	Header header;
+	if (!readHeader(path, header)) ERROR();
+	const auto basePath = toBasePath(path, header);
+
+	std::vector<std::string> ret;
+	std::set<std::filesystem::path> dirSet = {
+		std::filesystem::absolute(path).parent_path(),
+		std::filesystem::path(basePath).parent_path(),
+	};
+	for(const auto& dir: dirSet) {
+		for(const auto& entry: std::filesystem::directory_iterator(dir)) {
+			if (!entry.is_regular_file()) continue;
+			if (std::filesystem::equivalent(entry.path(), path)) continue;
+			const auto otherPath = entry.path().string();
+			Header other;
+			if (!readHeader(otherPath, other)) continue;
+			if (toBasePath(otherPath, other) == basePath) ret.push_back(otherPath);
+		}
+	}
+	return ret;
+}
+
+void DiskOverlay::create(const std::string& path, const std::string& basePath_) {
+	if (!std::filesystem::exists(basePath_)) {
+		logger.error("unexpected basePath");
+		logger.error("  basePath  %s", basePath_);
+		ERROR();
+	}
+	if (isOverlay(basePath_)) {
+		logger.error("base is overlay  %s", basePath_);
+		ERROR();
+	}
+	auto baseSize = std::filesystem::file_size(basePath_);
+	if (baseSize % PAGE_SIZE_IN_BYTE) ERROR();
+
+	Header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version      = VERSION;
+	header.pageSize     = (uint32_t)(baseSize / PAGE_SIZE_IN_BYTE);
+	header.bitmapOffset = HEADER_SIZE;
+	header.dataOffset   = roundUp(header.bitmapOffset + roundUp(header.pageSize, 64) / 8, 4096);
+	header.baseByteSize = baseSize;
+	header.baseTime     = getModifyTime(basePath_);
+
+	// store base path relative to directory of overlay
+	auto overlayDir = std::filesystem::absolute(path).parent_path();
+	auto relative   = std::filesystem::relative(std::filesystem::absolute(basePath_), overlayDir).string();
+	if (sizeof(header.basePath) <= relative.size()) ERROR();
+	strcpy(header.basePath, relative.c_str());
+
+	{
+		std::ofstream ofs(path, std::ios::out | std::ios::binary | std::ios::trunc);
+		ofs.write((const char*)&header, sizeof(header));
+		if (!ofs) ERROR();
+	}
+	// extend file without allocating disk block
+	std::filesystem::resize_file(path, (uint64_t)header.dataOffset + (uint64_t)header.pageSize * PAGE_SIZE_IN_BYTE);
+
+	logger.info("DiskOverlay::create  %s  base %s  page %d", path, header.basePath, header.pageSize);
+}
+
+void DiskOverlay::attach(const std::string& path_, bool readOnlyBase) {
+	if (isAttached()) ERROR();
+	if (!isOverlay(path_)) {
+		logger.error("not overlay  %s", path_);
+		ERROR();
+	}
+	// check header and base before mapping
+	{
+		Header temp;
+		if (!readHeader(path_, temp)) ERROR();
+		if (temp.version != VERSION) {
+			logger.error("unexpected version  %d", temp.version);
+			ERROR();
+		}
+		auto tempBasePath = toBasePath(path_, temp);
+		auto baseByteSize = std::filesystem::file_size(tempBasePath);
+		if (baseByteSize != temp.baseByteSize || baseByteSize != (uint64_t)temp.pageSize * PAGE_SIZE_IN_BYTE) {
+			logger.error("base size mismatch  %s  %lu  %lu", tempBasePath, (unsigned long)baseByteSize, (unsigned long)temp.baseByteSize);
+			ERROR();
+		}
+		if (temp.committing) {
+			logger.error("commit of overlay is interrupted. base can be half committed  %s", tempBasePath);
+			logger.error("  overlay  %s", path_);
+			if (readOnlyBase) {
+				logger.error("run commit of overlay again");
+				ERROR();
+			}
+		} else if (getModifyTime(tempBasePath) != temp.baseTime) {
+			logger.error("base is changed after overlay is created  %s", tempBasePath);
+			logger.error("  overlay  %s", path_);
+			ERROR();
+		}
+	}
+	path = path_;
+
+	auto [mapPage, mapSize] = Util::mapFile(path);
+	header = (Header*)mapPage;
+	if (mapSize != header->dataOffset + header->pageSize * PAGE_SIZE_IN_BYTE) ERROR();
+	bitmap = (uint64_t*)((uint8_t*)mapPage + header->bitmapOffset);
+	data   = (uint8_t*)mapPage + header->dataOffset;
+	basePath = toBasePath(path, *header);
+
+	auto [basePage, baseMapSize] = Util::mapFile(basePath, readOnlyBase);
+	base     = (uint8_t*)basePage;
+	baseSize = baseMapSize;
+
+	CHECK_SYSCALL(fd, open(path.c_str(), O_RDWR))
+
+	logger.info("DiskOverlay::attach  %s  base %s  overlay page %d / %d", path, basePath, countPage(), header->pageSize);
+}
+
+void DiskOverlay::detach() {
+	if (!isAttached()) return;
+
+	logger.info("DiskOverlay::detach  %s", path);
+
+	Util::unmapFile(base);
+	Util::unmapFile(header);
+	::close(fd);
+
+	header   = 0;
+	bitmap   = 0;
+	data     = 0;
+	base     = 0;
+	baseSize = 0;
+	fd       = -1;
+}
+
+void DiskOverlay::writePage(uint32_t pageNo, const void* buffer) {
+	// write data before setting bit
+	memcpy(data + (uint64_t)pageNo * PAGE_SIZE_IN_BYTE, buffer, PAGE_SIZE_IN_BYTE);
+	std::atomic_ref<uint64_t>(bitmap[pageNo / 64]).fetch_or(1ULL << (pageNo % 64), std::memory_order_release);
+}
+
+void DiskOverlay::willNeed(uint32_t pageNo, uint32_t count) {
+	Util::willNeed(base, (uint64_t)pageNo * PAGE_SIZE_IN_BYTE, (uint64_t)count * PAGE_SIZE_IN_BYTE);
+}
+
+uint32_t DiskOverlay::countPage() {
+	uint32_t ret = 0;
+	for(uint32_t i = 0; i < roundUp(header->pageSize, 64) / 64; i++) {
+		ret += std::popcount(bitmap[i]);
+	}
+	return ret;
+}
+
+void DiskOverlay::commit() {
+	int ret;
+	// mark before writing base
+	header->committing = 1;
+	CHECK_SYSCALL(ret, msync(header, HEADER_SIZE, MS_SYNC))
+
+	uint32_t count = 0;
+	for(uint32_t pageNo = 0; pageNo < header->pageSize; pageNo++) {
+		if (!contains(pageNo)) continue;
+		memcpy(base + (uint64_t)pageNo * PAGE_SIZE_IN_BYTE, data + (uint64_t)pageNo * PAGE_SIZE_IN_BYTE, PAGE_SIZE_IN_BYTE);
+		count++;
+	}
+	// make sure base is written before clearing overlay
+	CHECK_SYSCALL(ret, msync(base, baseSize, MS_SYNC))
+
+	memset(bitmap, 0, roundUp(header->pageSize, 64) / 8);
+	// overlay stays valid for changed base
+	header->baseTime = getModifyTime(basePath);
+	CHECK_SYSCALL(ret, msync(header, header->dataOffset, MS_SYNC))
+	// clear after bitmap and baseTime are written
+	header->committing = 0;
+	CHECK_SYSCALL(ret, msync(header, HEADER_SIZE, MS_SYNC))
+	// release disk block of page data
+	Util::punchHole(fd, header->dataOffset, (uint64_t)header->pageSize * PAGE_SIZE_IN_BYTE);
+
+	logger.info("DiskOverlay::commit  %s  page %d", path, count);
+}
+
+void DiskOverlay::squash(const std::string& outputPath) {
+	{
+		std::ofstream ofs(outputPath, std::ios::out | std::ios::binary | std::ios::trunc);
+		for(uint32_t pageNo = 0; pageNo < header->pageSize; pageNo++) {
+			auto page = readPage(pageNo);
+			// skip all-zero page to make output sparse
+			if (Util::isZero(page, PAGE_SIZE_IN_BYTE)) {
+				ofs.seekp(PAGE_SIZE_IN_BYTE, std::ios::cur);
+			} else {
+				ofs.write((const char*)page, PAGE_SIZE_IN_BYTE);
+			}
+		}
+		if (!ofs) ERROR();
+	}
+	// extend file for trailing zero pages
+	std::filesystem::resize_file(outputPath, (uint64_t)header->pageSize * PAGE_SIZE_IN_BYTE);
+	logger.info("DiskOverlay::squash  %s  %s  page %d", path, outputPath, header->pageSize);
+}
+
+void DiskOverlay::save(const std::string& outputPath) {
+	create(outputPath, basePath);
+	DiskOverlay output;
+	output.attach(outputPath);
+	uint32_t count = 0;
+	for(uint32_t pageNo = 0; pageNo < header->pageSize; pageNo++) {
+		if (!contains(pageNo)) continue;
+		output.writePage(pageNo, data + (uint64_t)pageNo * PAGE_SIZE_IN_BYTE);
+		count++;
+	}
+	output.detach();
+	logger.info("DiskOverlay::save  %s  %s  page %d", path, outputPath, count);
+}
+
+void DiskOverlay::load(const std::string& inputPath) {
+	DiskOverlay input;
+	input.attach(inputPath);
+	if (input.getBasePath() != basePath) {
+		logger.error("base mismatch  %s  %s", input.getBasePath(), basePath);
+		ERROR();
+	}
+	// make overlay empty
+	memset(bitmap, 0, roundUp(header->pageSize, 64) / 8);
+	Util::punchHole(fd, header->dataOffset, (uint64_t)header->pageSize * PAGE_SIZE_IN_BYTE);
+
+	uint32_t count = 0;
+	for(uint32_t pageNo = 0; pageNo < header->pageSize; pageNo++) {
+		if (!input.contains(pageNo)) continue;
+		writePage(pageNo, input.readPage(pageNo));
+		count++;
+	}
+	input.detach();
+	logger.info("DiskOverlay::load  %s  %s  page %d", path, inputPath, count);
+}
@@ -0,0 +1,140 @@
+/*******************************************************************************
+ * Copyright (c) 2025, Yasuhiro Hasegawa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+//
+// DiskOverlay.h
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Copy-on-write overlay of disk image
+//   Overlay file holds header, page bitmap and page data.
+//   Page data of overlay file is sparse. Only written page occupy disk space.
+//   Base image is mapped read only and can be shared by many overlay.
+//   Header records size and modification time of base. attach refuses base that is changed after create,
+//   such as commit of other overlay of same base.
+//
+//   offset                 contents
+//   0                      Header
+//   Header.bitmapOffset    bitmap  one bit for each page. 1 means page is in overlay
+//   Header.dataOffset      page data  same layout as base image
+
+class DiskOverlay {
+public:
+	static const constexpr uint32_t PAGE_SIZE_IN_BYTE = 512;
+	static const constexpr uint32_t HEADER_SIZE       = 4096;
+	static const constexpr uint32_t VERSION           = 2;
+	static const constexpr char     MAGIC[8]          = {'M', 'E', 'S', 'A', 'O', 'V', 'L', '1'};
+
+	struct Header {
+		char     magic[8];
+		uint32_t version;
+		uint32_t pageSize;      // number of page
+		uint32_t bitmapOffset;  // in byte
+		uint32_t dataOffset;    // in byte
+		uint64_t baseByteSize;  // size of base at create or commit
+		int64_t  baseTime;      // modification time of base at create or commit in nanosecond
+		uint32_t committing;    // 1 while commit is writing base
+		uint32_t reserved;
+		char     basePath[HEADER_SIZE - 48]; // relative path from directory of overlay file or absolute path
+	};
+	static_assert(sizeof(Header) == HEADER_SIZE);
+
+	// true if path is overlay file
+	static bool isOverlay(const std::string& path);
+	// create empty overlay file of basePath
+	static void create(const std::string& path, const std::string& basePath);
+	// other overlay of same base in directory of path and directory of base
+	static std::vector<std::string> findOther(const std::string& path);
+
+	DiskOverlay() : header(0), bitmap(0), data(0), base(0), baseSize(0) {}
+
+	// readOnlyBase is false for commit
+	// overlay of interrupted commit can be attached only with readOnlyBase = false to run commit again
+	void attach(const std::string& path, bool readOnlyBase = true);
+	void detach();
+	bool isAttached() {
+		return header != 0;
+	}
+
+	uint32_t getPageSize() {
+		return header->pageSize;
+	}
+	const std::string& getBasePath() {
+		return basePath;
+	}
+
+	// true if page is in overlay
+	bool contains(uint32_t pageNo) {
+		return std::atomic_ref<uint64_t>(bitmap[pageNo / 64]).load(std::memory_order_acquire) & (1ULL << (pageNo % 64));
+	}
+	const uint8_t* readPage(uint32_t pageNo) {
+		return contains(pageNo) ? (data + (uint64_t)pageNo * PAGE_SIZE_IN_BYTE) : (base + (uint64_t)pageNo * PAGE_SIZE_IN_BYTE);
+	}
+	void writePage(uint32_t pageNo, const void* buffer);
+	// hint that pages of base image will be read soon
+	void willNeed(uint32_t pageNo, uint32_t count);
+
+	// number of page in overlay
+	uint32_t countPage();
+	// write pages in overlay to base image and make overlay empty. need attach with readOnlyBase = false
+	// other overlay of same base can not be attached after commit, because base is changed
+	// committing of header is set while base is written. crash during commit leaves base half committed,
+	// and commit again completes it, because page stays in overlay until base is written.
+	void commit();
+	// write whole contents to path as flat disk image
+	void squash(const std::string& path);
+	// write pages in overlay to new overlay file of same base
+	void save(const std::string& path);
+	// replace pages in overlay with pages of overlay file saved by save
+	void load(const std::string& path);
+
+private:
+	// read header of overlay file. return false if path is not overlay
+	static bool        readHeader(const std::string& path, Header& header);
+	// absolute path of base of overlay
+	static std::string toBasePath(const std::string& path, const Header& header);
+	// modification time of file in nanosecond
+	static int64_t     getModifyTime(const std::string& path);
+
+	std::string path;
+	std::string basePath;
+	Header*     header;
+	uint64_t*   bitmap;
+	uint8_t*    data;
+	uint8_t*    base;
+	uint32_t    baseSize;
+	int         fd = -1;  // for hole punching
+};
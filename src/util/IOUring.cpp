@@ -0,0 +1,156 @@
+/*******************************************************************************
+ * Copyright (c) 2025, Yasuhiro Hasegawa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+//
+// IOUring.cpp
+//
+
+#if defined(__linux__)
+
+#include <cerrno>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "Util.h"
+static const Logger logger(__FILE__);
+
+#include "IOUring.h"
+
+void IOUring::open(uint32_t entries) {
+	if (isOpen()) ERROR();
+
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+	if (fd < 0) {
+		int errNo = errno;
+		logger.fatal("io_uring_setup failed  errno = %d  %s", errNo, strerror(errNo));
+		ERROR();
+	}
+
+	sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cqRingSize = params.cq_off.cqes  + params.cq_entries * sizeof(io_uring_cqe);
+	bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+	if (singleMap) sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+	sqRing = mmap(0, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (sqRing == MAP_FAILED) ERROR();
+	if (singleMap) {
+		cqRing = sqRing;
+	} else {
+		cqRing = mmap(0, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (cqRing == MAP_FAILED) ERROR();
+	}
+	sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+	sqes = (io_uring_sqe*)mmap(0, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED) ERROR();
+
+	auto sq = (uint8_t*)sqRing;
+	sqHead    = (unsigned*)(sq + params.sq_off.head);
+	sqTail    = (unsigned*)(sq + params.sq_off.tail);
+	sqMask    = *(unsigned*)(sq + params.sq_off.ring_mask);
+	sqEntries = *(unsigned*)(sq + params.sq_off.ring_entries);
+	// use identity mapping between array and sqes
+	auto array = (unsigned*)(sq + params.sq_off.array);
+	for(unsigned i = 0; i < sqEntries; i++) array[i] = i;
+
+	auto cq = (uint8_t*)cqRing;
+	cqHead = (unsigned*)(cq + params.cq_off.head);
+	cqTail = (unsigned*)(cq + params.cq_off.tail);
+	cqMask = *(unsigned*)(cq + params.cq_off.ring_mask);
+	cqes   = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+	toSubmit = 0;
+	logger.info("IOUring::open  sq %d  cq %d", sqEntries, params.cq_entries);
+}
+
+void IOUring::close() {
+	if (!isOpen()) return;
+
+	munmap(sqes, sqesSize);
+	if (cqRing != sqRing) munmap(cqRing, cqRingSize);
+	munmap(sqRing, sqRingSize);
+	::close(fd);
+
+	fd     = -1;
+	sqRing = cqRing = 0;
+	sqes   = 0;
+}
+
+void IOUring::enter(unsigned toSubmit_, unsigned minComplete, unsigned flags) {
+	for(;;) {
+		int ret = (int)syscall(__NR_io_uring_enter, fd, toSubmit_, minComplete, flags, 0, 0);
+		if (0 <= ret) break;
+		int errNo = errno;
+		if (errNo == EINTR) continue;
+		logger.fatal("io_uring_enter failed  errno = %d  %s", errNo, strerror(errNo));
+		ERROR();
+	}
+}
+
+void IOUring::submit(std::function<void(io_uring_sqe& sqe)> prepare) {
+	std::unique_lock<std::mutex> lock(mutex);
+
+	unsigned tail = *sqTail;
+	// flush when submission queue is full
+	if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) == sqEntries) {
+		enter(toSubmit, 0, 0);
+		toSubmit = 0;
+	}
+	io_uring_sqe& sqe = sqes[tail & sqMask];
+	memset(&sqe, 0, sizeof(sqe));
+	prepare(sqe);
+	__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+	toSubmit++;
+}
+
+void IOUring::flush() {
+	std::unique_lock<std::mutex> lock(mutex);
+	if (toSubmit == 0) return;
+	enter(toSubmit, 0, 0);
+	toSubmit = 0;
+}
+
+void IOUring::wait(std::function<void(const io_uring_cqe& cqe)> process) {
+	unsigned head = *cqHead;
+	if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+		enter(0, 1, IORING_ENTER_GETEVENTS);
+	}
+	unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+	for(; head != tail; head++) {
+		process(cqes[head & cqMask]);
+	}
+	__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+}
+
+#endif
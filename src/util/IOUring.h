@@ -0,0 +1,94 @@
+/*******************************************************************************
+ * Copyright (c) 2025, Yasuhiro Hasegawa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+//
+// IOUring.h
+//
+
+#pragma once
+
+// Minimal io_uring wrapper using raw system call. Available only on Linux.
+
+#if defined(__linux__)
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+#include <linux/io_uring.h>
+
+class IOUring {
+public:
+	IOUring() : fd(-1), sqRing(0), cqRing(0), sqRingSize(0), cqRingSize(0), sqes(0), sqesSize(0),
+		sqHead(0), sqTail(0), sqMask(0), sqEntries(0), cqHead(0), cqTail(0), cqMask(0), cqes(0), toSubmit(0) {}
+	~IOUring() {
+		close();
+	}
+
+	void open(uint32_t entries);
+	void close();
+	bool isOpen() {
+		return 0 <= fd;
+	}
+
+	// prepare function fill sqe. submission is serialized by mutex.
+	void submit(std::function<void(io_uring_sqe& sqe)> prepare);
+	// submit all prepared sqe to kernel
+	void flush();
+
+	// wait at least one completion and call process for each completion
+	void wait(std::function<void(const io_uring_cqe& cqe)> process);
+
+private:
+	int            fd;
+	void*          sqRing;
+	void*          cqRing;
+	size_t         sqRingSize;
+	size_t         cqRingSize;
+	io_uring_sqe*  sqes;
+	size_t         sqesSize;
+
+	unsigned*      sqHead;
+	unsigned*      sqTail;
+	unsigned       sqMask;
+	unsigned       sqEntries;
+
+	unsigned*      cqHead;
+	unsigned*      cqTail;
+	unsigned       cqMask;
+	io_uring_cqe*  cqes;
+
+	std::mutex     mutex;    // guard submission queue
+	unsigned       toSubmit; // guarded by mutex
+
+	void enter(unsigned toSubmit, unsigned minComplete, unsigned flags);
+};
+
+#endif
@@ -0,0 +1,226 @@
+/*******************************************************************************
+ * Copyright (c) 2025, Yasuhiro Hasegawa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+
+//
+// PacketCapture.cpp
+//
+
+#include <cstring>
+
+#include "Util.h"
+static const Logger logger(__FILE__);
+
+#include "Perf.h"
+
+#include "PacketCapture.h"
+
+// pcapng block type
+static constexpr uint32_t BT_SHB = 0x0A0D0D0A; // section header block
+static constexpr uint32_t BT_IDB = 0x00000001; // interface description block
+static constexpr uint32_t BT_EPB = 0x00000006; // enhanced packet block
+
+static constexpr uint16_t OPT_ENDOFOPT  = 0;
+static constexpr uint16_t SHB_USERAPPL  = 4;
+static constexpr uint16_t IF_NAME       = 2;
+static constexpr uint16_t IF_TSRESOL    = 9;
+static constexpr uint16_t EPB_FLAGS     = 2;
+
+static constexpr uint16_t LINKTYPE_ETHERNET = 1;
+
+static void put16(std::vector<uint8_t>& buffer, uint16_t value) {
+	auto p = (const uint8_t*)&value;
+	buffer.insert(buffer.end(), p, p + sizeof(value));
+}
+static void put32(std::vector<uint8_t>& buffer, uint32_t value) {
+	auto p = (const uint8_t*)&value;
+	buffer.insert(buffer.end(), p, p + sizeof(value));
+}
+static void putData(std::vector<uint8_t>& buffer, const uint8_t* data, uint32_t length) {
+	buffer.insert(buffer.end(), data, data + length);
+	// pad to 32 bit boundary
+	buffer.resize((buffer.size() + 3) & ~3);
+}
+static void putOption(std::vector<uint8_t>& buffer, uint16_t code, const void* data, uint16_t length) {
+	put16(buffer, code);
+	put16(buffer, length);
+	putData(buffer, (const uint8_t*)data, length);
+}
+
+
+void PacketCapture::open(const std::string& path_, const std::string& interfaceName) {
+	if (file) ERROR();
+	path = path_;
+	file = fopen(path.c_str(), "wb");
+	if (file == 0) {
+		int errNo = errno;
+		logger.fatal("Cannot open  %s", path);
+		LOG_ERRNO(errNo)
+		ERROR();
+	}
+	writeHeader(interfaceName);
+
+	for(auto& ring: rings) {
+		ring.head = 0;
+		ring.tail = 0;
+	}
+	stopThread = false;
+	thread = std::thread(&PacketCapture::run, this);
+	enabled = true;
+	logger.info("PacketCapture open  %s", path);
+}
+
+void PacketCapture::close() {
+	if (file == 0) return;
+	enabled = false;
+	stopThread = true;
+	thread.join();
+	fclose(file);
+	file = 0;
+	logger.info("PacketCapture close  %s", path);
+}
+
+void PacketCapture::capture(Direction direction, std::chrono::microseconds timestamp, const std::span<uint8_t>& data) {
+	if (!isEnabled()) return;
+	auto& ring = rings[(int)direction];
+
+	auto head = ring.head.load(std::memory_order_relaxed);
+	if (head - ring.tail.load(std::memory_order_acquire) == RING_SIZE) {
+		// writer thread is behind. don't wait
+		PERF_COUNT(capture, drop)
+		return;
+	}
+	PERF_COUNT(capture, packet)
+	auto& slot = ring.slotList[head & (RING_SIZE - 1)];
+	slot.timestamp = timestamp.count();
+	slot.length         = std::min((uint32_t)data.size(), (uint32_t)net::PACKET_SIZE);
+	slot.originalLength = (uint32_t)data.size();
+	memcpy(slot.data, data.data(), slot.length);
+	ring.head.store(head + 1, std::memory_order_release);
+}
+
+bool PacketCapture::writeOne() {
+	// write older packet first
+	Ring* ringList[2] = {&rings[0], &rings[1]};
+	Ring* target = 0;
+	int   index  = 0;
+	for(int i = 0; i < 2; i++) {
+		auto ring = ringList[i];
+		auto tail = ring->tail.load(std::memory_order_relaxed);
+		if (tail == ring->head.load(std::memory_order_acquire)) continue;
+		if (target == 0 || ring->slotList[tail & (RING_SIZE - 1)].timestamp < target->slotList[target->tail & (RING_SIZE - 1)].timestamp) {
+			target = ring;
+			index  = i;
+		}
+	}
+	if (target == 0) return false;
+
+	auto tail = target->tail.load(std::memory_order_relaxed);
+	writePacket((Direction)index, target->slotList[tail & (RING_SIZE - 1)]);
+	target->tail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+void PacketCapture::run() {
+	bool dirty = false;
+	for(;;) {
+		if (writeOne()) {
+			dirty = true;
+			continue;
+		}
+		// both ring is empty
+		if (stopThread) break;
+		if (dirty) {
+			fflush(file);
+			dirty = false;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	fflush(file);
+}
+
+void PacketCapture::writeBlock(uint32_t type, const std::vector<uint8_t>& body) {
+	// block total length includes type and two length fields
+	uint32_t length = (uint32_t)body.size() + 12;
+	std::vector<uint8_t> block;
+	block.reserve(length);
+	put32(block, type);
+	put32(block, length);
+	block.insert(block.end(), body.begin(), body.end());
+	put32(block, length);
+	if (fwrite(block.data(), 1, block.size(), file) != block.size()) {
+		int errNo = errno;
+		logger.error("fwrite failed  %s", path);
+		LOG_ERRNO(errNo)
+	}
+}
+
+void PacketCapture::writeHeader(const std::string& interfaceName) {
+	{
+		std::vector<uint8_t> body;
+		put32(body, 0x1A2B3C4D); // byte order magic
+		put16(body, 1);          // major version
+		put16(body, 0);          // minor version
+		put32(body, 0xFFFFFFFF); // section length is not specified
+		put32(body, 0xFFFFFFFF);
+		const char* application = "mesa-emulator";
+		putOption(body, SHB_USERAPPL, application, (uint16_t)strlen(application));
+		putOption(body, OPT_ENDOFOPT, 0, 0);
+		writeBlock(BT_SHB, body);
+	}
+	{
+		std::vector<uint8_t> body;
+		put16(body, LINKTYPE_ETHERNET);
+		put16(body, 0);
+		put32(body, net::PACKET_SIZE); // snap length
+		putOption(body, IF_NAME, interfaceName.c_str(), (uint16_t)interfaceName.size());
+		uint8_t tsresol = 6; // microseconds
+		putOption(body, IF_TSRESOL, &tsresol, 1);
+		putOption(body, OPT_ENDOFOPT, 0, 0);
+		writeBlock(BT_IDB, body);
+	}
+}
+
+void PacketCapture::writePacket(Direction direction, const Slot& slot) {
+	PERF_COUNT(capture, write)
+	std::vector<uint8_t> body;
+	body.reserve(64 + slot.length);
+	put32(body, 0); // interface id
+	put32(body, (uint32_t)((uint64_t)slot.timestamp >> 32));
+	put32(body, (uint32_t)slot.timestamp);
+	put32(body, slot.length); // captured length
+	put32(body, slot.originalLength); // original length
+	putData(body, slot.data, slot.length);
+	// inbound is 1 and outbound is 2
+	uint32_t flags = direction == Direction::receive ? 1 : 2;
+	putOption(body, EPB_FLAGS, &flags, sizeof(flags));
+	putOption(body, OPT_ENDOFOPT, 0, 0);
+	writeBlock(BT_EPB, body);
+}
@@ -0,0 +1,105 @@
+/*******************************************************************************
+ * Copyright (c) 2025, Yasuhiro Hasegawa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+
+//
+// PacketCapture.h
+//
+
+#pragma once
+
+// Capture of emulated Ethernet traffic to pcapng file.
+// capture() copies packet into lock-free ring and never blocks. background thread writes file.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "net.h"
+
+class PacketCapture {
+public:
+	enum class Direction {
+		receive, transmit,
+	};
+
+	// number of slot in ring of each direction. must be power of 2
+	static constexpr uint32_t RING_SIZE = 1024;
+
+	PacketCapture() : file(0), stopThread(false), enabled(false) {}
+	~PacketCapture() {
+		close();
+	}
+
+	void open(const std::string& path, const std::string& interfaceName);
+	// write all captured packet and close file
+	void close();
+	bool isEnabled() const {
+		return enabled.load(std::memory_order_relaxed);
+	}
+
+	// only one thread can call capture for each direction. timestamp is since epoch
+	void capture(Direction direction, std::chrono::microseconds timestamp, const std::span<uint8_t>& data);
+
+private:
+	struct Slot {
+		int64_t  timestamp;
+		uint32_t length;         // captured length. clipped to PACKET_SIZE
+		uint32_t originalLength; // length of packet on wire
+		uint8_t  data[net::PACKET_SIZE];
+	};
+	// single producer single consumer ring
+	struct Ring {
+		std::vector<Slot>     slotList;
+		std::atomic<uint64_t> head; // next slot to write. updated by producer
+		std::atomic<uint64_t> tail; // next slot to read. updated by writer thread
+
+		Ring() : slotList(RING_SIZE), head(0), tail(0) {}
+	};
+
+	Ring              rings[2];
+	std::string       path;
+	FILE*             file;
+	std::thread       thread;
+	std::atomic<bool> stopThread;
+	std::atomic<bool> enabled;
+
+	void run();
+	// returns false if both ring is empty
+	bool writeOne();
+	void writeHeader(const std::string& interfaceName);
+	void writePacket(Direction direction, const Slot& slot);
+	void writeBlock(uint32_t type, const std::vector<uint8_t>& body);
+};
@@ -0,0 +1,346 @@
+/*******************************************************************************
+ * Copyright (c) 2025, Yasuhiro Hasegawa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+
+//
+// PacketRing.cpp
+//
+
+#if defined(__linux__)
+
+#include <cerrno>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Util.h"
+static const Logger logger(__FILE__);
+
+#include "Perf.h"
+
+#include "PacketRing.h"
+
+// copy output from "tcpdump -dd ether proto xns"
+static struct sock_filter xns_insn[] = {
+	{ 0x28, 0, 0, 0x0000000c },
+	{ 0x15, 0, 1, 0x00000600 },
+	{ 0x06, 0, 0, 0x00040000 },
+	{ 0x06, 0, 0, 0x00000000 },
+};
+
+// offset of packet data in TX frame. see tpacket_parse_header in net/packet/af_packet.c
+static constexpr uint32_t TX_DATA_OFFSET = TPACKET_ALIGN(sizeof(tpacket3_hdr));
+// offset of sockaddr_ll in RX packet
+static constexpr uint32_t RX_ADDR_OFFSET = TPACKET_ALIGN(sizeof(tpacket3_hdr));
+
+static_assert(PacketRing::BLOCK_SIZE % PacketRing::FRAME_SIZE == 0);
+static_assert((PacketRing::FRAME_SIZE * PacketRing::TX_FRAME_COUNT) % PacketRing::BLOCK_SIZE == 0);
+
+
+void PacketRing::open(const std::string& name_) {
+	if (isOpen()) ERROR();
+	name = name_;
+
+	ifindex = (int)::if_nametoindex(name.c_str());
+	if (ifindex == 0) {
+		int errNo = errno;
+		logger.fatal("Unexpected interface name  %s", name);
+		LOG_ERRNO(errNo)
+		ERROR();
+	}
+
+	int ret;
+	// protocol 0 receives no packet until bind. setup filter and ring before bind
+	CHECK_SYSCALL(fd, ::socket(AF_PACKET, SOCK_RAW, 0))
+	{
+		int version = TPACKET_V3;
+		CHECK_SYSCALL(ret, ::setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)))
+	}
+#if defined(PACKET_IGNORE_OUTGOING)
+	{
+		// don't receive packet sent by this socket. receive also checks sll_pkttype for older kernel
+		int value = 1;
+		LOG_SYSCALL(ret, ::setsockopt(fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &value, sizeof(value)))
+	}
+#endif
+	setFilter();
+	{
+		tpacket_req3 req;
+		memset(&req, 0, sizeof(req));
+		req.tp_block_size       = BLOCK_SIZE;
+		req.tp_block_nr         = BLOCK_COUNT;
+		req.tp_frame_size       = FRAME_SIZE;
+		req.tp_frame_nr         = (BLOCK_SIZE / FRAME_SIZE) * BLOCK_COUNT;
+		req.tp_retire_blk_tov   = BLOCK_TIMEOUT;
+		CHECK_SYSCALL(ret, ::setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)))
+	}
+	{
+		// kernel rejects TX ring with retire_blk_tov, sizeof_priv or feature_req_word
+		tpacket_req3 req;
+		memset(&req, 0, sizeof(req));
+		req.tp_block_size = BLOCK_SIZE;
+		req.tp_block_nr   = (FRAME_SIZE * TX_FRAME_COUNT) / BLOCK_SIZE;
+		req.tp_frame_size = FRAME_SIZE;
+		req.tp_frame_nr   = TX_FRAME_COUNT;
+		CHECK_SYSCALL(ret, ::setsockopt(fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)))
+	}
+
+	// RX ring is followed by TX ring
+	size_t rxSize = (size_t)BLOCK_SIZE * BLOCK_COUNT;
+	size_t txSize = (size_t)FRAME_SIZE * TX_FRAME_COUNT;
+	mapSize = rxSize + txSize;
+	void* p = ::mmap(0, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+	if (p == MAP_FAILED) {
+		int errNo = errno;
+		logger.fatal("mmap failed  mapSize = %lu", mapSize);
+		LOG_ERRNO(errNo)
+		ERROR();
+	}
+	map    = (uint8_t*)p;
+	rxRing = map;
+	txRing = map + rxSize;
+
+	rxBlockIndex = 0;
+	rxBlock      = 0;
+	rxPacket     = 0;
+	rxPacketLeft = 0;
+	txFrameIndex = 0;
+
+	{
+		sockaddr_ll addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sll_family   = AF_PACKET;
+		addr.sll_protocol = htons(ETH_P_ALL);
+		addr.sll_ifindex  = ifindex;
+		CHECK_SYSCALL(ret, ::bind(fd, (sockaddr*)&addr, sizeof(addr)))
+	}
+	{
+		// need to promiscuos mode to see all packet
+		packet_mreq mreq;
+		memset(&mreq, 0, sizeof(mreq));
+		mreq.mr_ifindex = ifindex;
+		mreq.mr_type    = PACKET_MR_PROMISC;
+		CHECK_SYSCALL(ret, ::setsockopt(fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)))
+	}
+
+	logger.info("PacketRing open  %s  ifindex = %d  fd = %d  rx = %lu  tx = %lu", name, ifindex, fd, rxSize, txSize);
+}
+void PacketRing::close() {
+	if (map) {
+		int ret;
+		LOG_SYSCALL(ret, ::munmap(map, mapSize))
+		map    = 0;
+		rxRing = 0;
+		txRing = 0;
+		rxBlock = 0;
+	}
+	if (0 <= fd) {
+		int ret;
+		LOG_SYSCALL(ret, ::close(fd))
+		fd = -1;
+	}
+}
+
+void PacketRing::setFilter() {
+	sock_fprog program;
+	program.len    = (unsigned short)COUNT_ELEMENT(xns_insn);
+	program.filter = xns_insn;
+	int ret;
+	CHECK_SYSCALL(ret, ::setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program)))
+}
+
+void PacketRing::releaseBlock() {
+	if (rxBlock) {
+		// return block to kernel
+		__atomic_store_n(&rxBlock->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+		rxBlock      = 0;
+		rxPacket     = 0;
+		rxPacketLeft = 0;
+		rxBlockIndex = (rxBlockIndex + 1) % BLOCK_COUNT;
+	}
+}
+
+void PacketRing::clear() {
+	releaseBlock();
+	for(;;) {
+		auto block = blockAt(rxBlockIndex);
+		if (!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) break;
+		rxBlock = block;
+		releaseBlock();
+	}
+}
+
+// no error check
+int PacketRing::select(microseconds timeout) {
+	pollfd fds;
+	fds.fd      = fd;
+	fds.events  = POLLIN | POLLERR;
+	fds.revents = 0;
+	// round up to millisecond
+	int ms = (int)((timeout.count() + 999) / 1000);
+	int ret;
+	LOG_SYSCALL(ret, ::poll(&fds, 1, ms))
+	return ret;
+}
+
+int PacketRing::receive(data_type& data, microseconds timeout, microseconds* timestamp) {
+	PERF_COUNT(packet, read)
+	for(;;) {
+		if (rxBlock && rxPacketLeft == 0) releaseBlock();
+
+		if (rxBlock == 0) {
+			auto block = blockAt(rxBlockIndex);
+			if (!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+				PERF_COUNT(packet, read_select)
+				select(timeout);
+				if (!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+					PERF_COUNT(packet, read_empty)
+					data = data_type{};
+					return 0;
+				}
+			}
+			// one block contains many packet
+			PERF_COUNT(packet, read_block)
+			rxBlock      = block;
+			rxPacketLeft = block->hdr.bh1.num_pkts;
+			rxPacket     = (tpacket3_hdr*)((uint8_t*)block + block->hdr.bh1.offset_to_first_pkt);
+			// retired block by timeout can be empty
+			if (rxPacketLeft == 0) continue;
+		}
+
+		auto header = rxPacket;
+		rxPacketLeft--;
+		if (rxPacketLeft) rxPacket = (tpacket3_hdr*)((uint8_t*)header + header->tp_next_offset);
+
+		auto addr = (sockaddr_ll*)((uint8_t*)header + RX_ADDR_OFFSET);
+		if (addr->sll_pkttype == PACKET_OUTGOING) {
+			PERF_COUNT(packet, read_outgoing)
+			continue;
+		}
+
+		data = data_type{(uint8_t*)header + header->tp_mac, header->tp_snaplen};
+		if (timestamp) {
+			int64_t microseconds = (int64_t)header->tp_sec * 1000'000 + header->tp_nsec / 1000; // convert to microseconds
+			*timestamp = std::chrono::microseconds(microseconds);
+		}
+		return data.size();
+	}
+}
+
+static void copyMemory(const uint8_t* source, uint8_t* dest, uint32_t size) {
+	memcpy(dest, source, size);
+}
+
+bool PacketRing::fillFrame(const data_type& data, copy_type copy) {
+	if (FRAME_SIZE - TX_DATA_OFFSET < data.size()) {
+		logger.error("Unexpected size  %lu", data.size());
+		return false;
+	}
+
+	auto frame = frameAt(txFrameIndex);
+	for(;;) {
+		auto status = __atomic_load_n(&frame->tp_status, __ATOMIC_ACQUIRE);
+		if (status == TP_STATUS_AVAILABLE) break;
+		if (status & TP_STATUS_WRONG_FORMAT) {
+			logger.error("Unexpected frame status  %X", status);
+			__atomic_store_n(&frame->tp_status, TP_STATUS_AVAILABLE, __ATOMIC_RELEASE);
+			break;
+		}
+		// all frame are in flight. block until kernel sends pending frame
+		PERF_COUNT(packet, transmit_wait)
+		int ret;
+		LOG_SYSCALL(ret, ::send(fd, 0, 0, 0))
+		if (ret < 0) return false;
+	}
+
+	// data is copied directly into the frame shared with kernel
+	copy(data.data(), (uint8_t*)frame + TX_DATA_OFFSET, data.size());
+	frame->tp_len         = data.size();
+	frame->tp_snaplen     = data.size();
+	frame->tp_next_offset = 0;
+	__atomic_store_n(&frame->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+	txFrameIndex = (txFrameIndex + 1) % TX_FRAME_COUNT;
+	return true;
+}
+
+bool PacketRing::kick() {
+	PERF_COUNT(packet, transmit_kick)
+	int ret = ::send(fd, 0, 0, MSG_DONTWAIT);
+	if (ret < 0) {
+		int errNo = errno;
+		// frame stays in ring and will be sent by next send
+		if (errNo != EAGAIN && errNo != ENOBUFS) {
+			logger.error("send failed");
+			LOG_ERRNO(errNo)
+			return false;
+		}
+	}
+	return true;
+}
+
+int PacketRing::transmit(const data_type& data) {
+	PERF_COUNT(packet, transmit)
+	if (!fillFrame(data, copyMemory)) return -1;
+	if (!kick()) return -1;
+	return data.size();
+}
+
+int PacketRing::transmitBatch(const std::vector<data_type>& dataList) {
+	return transmitBatchCopy(dataList, copyMemory);
+}
+
+int PacketRing::transmitBatchCopy(const std::vector<data_type>& dataList, copy_type copy) {
+	int count = 0;
+	for(const auto& data: dataList) {
+		PERF_COUNT(packet, transmit)
+		if (!fillFrame(data, copy)) break;
+		count++;
+	}
+	// one system call for all frame
+	if (count && !kick()) return 0;
+	return count;
+}
+
+uint32_t PacketRing::getDropCount() {
+	tpacket_stats_v3 stats;
+	socklen_t len = sizeof(stats);
+	int ret;
+	CHECK_SYSCALL(ret, ::getsockopt(fd, SOL_PACKET, PACKET_STATISTICS, &stats, &len))
+	return stats.tp_drops;
+}
+
+#endif
@@ -0,0 +1,122 @@
+/*******************************************************************************
+ * Copyright (c) 2025, Yasuhiro Hasegawa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+
+//
+// PacketRing.h
+//
+
+#pragma once
+
+// AF_PACKET socket with TPACKET_V3 memory mapped RX and TX ring. Available only on Linux.
+
+#if defined(__linux__)
+
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <linux/if_packet.h>
+
+struct PacketRing {
+	using data_type = std::span<uint8_t>;
+	using microseconds = std::chrono::microseconds;
+	// copies size bytes from source to dest
+	using copy_type = void (*)(const uint8_t* source, uint8_t* dest, uint32_t size);
+
+	// RX ring is BLOCK_COUNT blocks of BLOCK_SIZE. kernel fills many packet in one block
+	static constexpr uint32_t BLOCK_SIZE    = 1 << 18;
+	static constexpr uint32_t BLOCK_COUNT   = 16;
+	// kernel retires partially filled block after BLOCK_TIMEOUT milliseconds
+	static constexpr uint32_t BLOCK_TIMEOUT = 1;
+	// TX ring is TX_FRAME_COUNT frames of FRAME_SIZE
+	static constexpr uint32_t FRAME_SIZE     = 2048;
+	static constexpr uint32_t TX_FRAME_COUNT = 256;
+
+	std::string name;
+	int         fd;
+	int         ifindex;
+	uint8_t*    map;
+	size_t      mapSize;
+	uint8_t*    rxRing;
+	uint8_t*    txRing;
+
+	// current RX block. packet in block is valid until block is released
+	uint32_t            rxBlockIndex;
+	tpacket_block_desc* rxBlock;
+	tpacket3_hdr*       rxPacket;
+	uint32_t            rxPacketLeft;
+
+	uint32_t    txFrameIndex;
+
+	PacketRing() : fd(-1), ifindex(0), map(0), mapSize(0), rxRing(0), txRing(0),
+		rxBlockIndex(0), rxBlock(0), rxPacket(0), rxPacketLeft(0), txFrameIndex(0) {}
+	~PacketRing() { close(); }
+
+	// open socket bound to interface name with XNS filter
+	void open(const std::string& name);
+	void close();
+	bool isOpen() {
+		return 0 <= fd;
+	}
+
+	void clear(); // release all RX block
+	int  select(microseconds timeout);
+
+	// data points to RX ring. data is valid until next call of receive or clear
+	int  receive(data_type& data, microseconds timeout, microseconds* timestamp = 0);
+	// copy data into TX frame and kick kernel
+	int  transmit(const data_type& data);
+	// copy all data into TX frames and kick kernel once. returns number of data transmitted
+	int  transmitBatch(const std::vector<data_type>& dataList);
+	// same as transmitBatch but data is copied into TX frames by copy
+	int  transmitBatchCopy(const std::vector<data_type>& dataList, copy_type copy);
+
+	// dropped packet count from PACKET_STATISTICS. counter is reset by each call
+	uint32_t getDropCount();
+
+private:
+	tpacket_block_desc* blockAt(uint32_t index) {
+		return (tpacket_block_desc*)(rxRing + (size_t)index * BLOCK_SIZE);
+	}
+	tpacket3_hdr* frameAt(uint32_t index) {
+		return (tpacket3_hdr*)(txRing + (size_t)index * FRAME_SIZE);
+	}
+	void releaseBlock();
+	// returns false if data cannot be written to TX frame
+	bool fillFrame(const data_type& data, copy_type copy);
+	// returns false if send failed
+	bool kick();
+	void setFilter();
+};
+
+#endif
@@ -33,6 +33,8 @@
 // Perf.cpp
 //
 
+#include <map>
+#include <sstream>
 #include <vector>
 
 #include "Util.h"
@@ -44,6 +46,44 @@ namespace perf {
 
 #include "Perf.inc"
 
+uint64_t Histogram::percentile(double percentile) const {
+    uint64_t total = count;
+    if (total == 0) return 0;
+    uint64_t target = (uint64_t)(total * percentile / 100.0);
+    if (target == 0) target = 1;
+    uint64_t sum_ = 0;
+    for(int i = 0; i < BUCKET_SIZE; i++) {
+        sum_ += bucket[i];
+        if (target <= sum_) {
+            // upper bound of bucket i is 2^i - 1. don't exceed max
+            uint64_t upper = (i == 0) ? 0 : ((i == 64) ? UINT64_MAX : ((1ULL << i) - 1));
+            return std::min(upper, max.load());
+        }
+    }
+    return max;
+}
+std::string Histogram::toString() const {
+    uint64_t count_ = count;
+    uint64_t average = count_ ? (sum / count_) : 0;
+    return std_sprintf("count %s  avg %s  p50 %s  p90 %s  p99 %s  max %s",
+        formatWithCommas(count_), formatWithCommas(average),
+        formatWithCommas(percentile(50)), formatWithCommas(percentile(90)), formatWithCommas(percentile(99)), formatWithCommas(max.load()));
+}
+
+static void dumpHistogram(const std::string& group) {
+    size_t nameLen = 0;
+    for(const auto& e: allHistogram) {
+        if (!group.empty() && e.group != group) continue;
+        nameLen = std::max(nameLen, e.name.length());
+    }
+    std::string format = std_sprintf("%%-%ds = %%s", nameLen);
+    for(const auto& e: allHistogram) {
+        if (!group.empty() && e.group != group) continue;
+        if (e.value.count == 0) continue;
+        logger.info(format.c_str(), e.name, e.value.toString());
+    }
+}
+
 // output aligned name and value
 // value can be very large number. output with thousands separator
 void dump() {
@@ -63,6 +103,7 @@ void dump() {
     for(auto& e: outputs) {
         logger.info(format.c_str(), e.first, e.second);
     }
+    dumpHistogram("");
 }
 void dump(const std::string& group) {
     std::vector<std::pair<std::string, std::string>> outputs;
@@ -82,12 +123,72 @@ void dump(const std::string& group) {
     for(auto& e: outputs) {
         logger.info(format.c_str(), e.first, e.second);
     }
+    dumpHistogram(group);
+}
+
+// one line for each entry
+//   C group name value
+//   H group name count sum max bucket0 ... bucket64
+std::string toText() {
+    std::ostringstream oss;
+    for(const auto& e: all) {
+        oss << "C " << e.group << " " << e.name << " " << e.value << "\n";
+    }
+    for(const auto& e: allHistogram) {
+        const auto& h = e.value;
+        oss << "H " << e.group << " " << e.name << " " << h.count << " " << h.sum << " " << h.max;
+        for(const auto& b: h.bucket) oss << " " << b;
+        oss << "\n";
+    }
+    return oss.str();
+}
+bool merge(const std::string& text) {
+    std::map<std::pair<std::string, std::string>, uint64_t*>  counterMap;
+    std::map<std::pair<std::string, std::string>, Histogram*> histogramMap;
+    for(auto& e: all) counterMap[{e.group, e.name}] = &e.value;
+    for(auto& e: allHistogram) histogramMap[{e.group, e.name}] = &e.value;
+
+    std::istringstream iss(text);
+    for(std::string line; std::getline(iss, line);) {
+        std::istringstream lss(line);
+        std::string type;
+        std::string group;
+        std::string name;
+        if (!(lss >> type >> group >> name)) return false;
+        if (type == "C") {
+            uint64_t value;
+            if (!(lss >> value)) return false;
+            // ignore counter that is not in this process
+            if (counterMap.contains({group, name})) *counterMap[{group, name}] += value;
+        } else if (type == "H") {
+            uint64_t count;
+            uint64_t sum;
+            uint64_t max;
+            uint64_t bucket[Histogram::BUCKET_SIZE];
+            if (!(lss >> count >> sum >> max)) return false;
+            for(auto& b: bucket) {
+                if (!(lss >> b)) return false;
+            }
+            if (!histogramMap.contains({group, name})) continue;
+            auto& h = *histogramMap[{group, name}];
+            h.count += count;
+            h.sum   += sum;
+            if (h.max < max) h.max = max;
+            for(int i = 0; i < Histogram::BUCKET_SIZE; i++) h.bucket[i] += bucket[i];
+        } else {
+            return false;
+        }
+    }
+    return true;
 }
 
 void clear() {
     for(const auto& e: all) {
         e.value = 0;
     }
+    for(const auto& e: allHistogram) {
+        e.value.clear();
+    }
 }
 
 }
\ No newline at end of file
@@ -35,14 +35,18 @@
 
 #pragma once
 
+#include <atomic>
+#include <bit>
 #include <cstdint>
 #include <vector>
 #include <string>
 
 #define PERF_DECLARE(group, name) namespace group { extern uint64_t name; }
+#define PERF_HISTOGRAM_DECLARE(group, name) namespace group { extern Histogram name; }
 
 #define PERF_COUNT(group, name) { if (PERF_ENABLE) perf::group::name++; }
 #define PERF_ADD(group, name, value) { if (PERF_ENABLE) perf::group::name += value; }
+#define PERF_RECORD(group, name, value) { if (PERF_ENABLE) perf::group::name.record(value); }
 
 #define PERF_LOG() { if (PERF_ENABLE) perf::dump(); }
 #define PERF_CLEAR() { perf::clear(); }
@@ -58,12 +62,59 @@ struct Entry {
     Entry(const char* group_, const char* name_, uint64_t& value_) : group(group_), name(name_), value(value_) {}
 };
 
-extern std::vector<perf::Entry> all;
+// log-bucketed histogram
+//   bucket 0 holds value 0. bucket n holds value in [2^(n-1), 2^n)
+//   record can be called from any thread
+struct Histogram {
+    static const constexpr int BUCKET_SIZE = 65;
+
+    std::atomic<uint64_t> bucket[BUCKET_SIZE];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+
+    Histogram() {
+        clear();
+    }
+
+    void record(uint64_t value) {
+        bucket[std::bit_width(value)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+        uint64_t oldMax = max.load(std::memory_order_relaxed);
+        while(oldMax < value && !max.compare_exchange_weak(oldMax, value, std::memory_order_relaxed)) {}
+    }
+    void clear() {
+        for(auto& e: bucket) e = 0;
+        count = 0;
+        sum   = 0;
+        max   = 0;
+    }
+    // upper bound of bucket that contains percentile. percentile is [0..100]
+    uint64_t percentile(double percentile) const;
+    // count, average, p50, p90, p99 and max
+    std::string toString() const;
+};
+
+struct HistogramEntry {
+    std::string group;
+    std::string name;
+    Histogram&  value;
+    HistogramEntry(const char* group_, const char* name_, Histogram& value_) : group(group_), name(name_), value(value_) {}
+};
+
+extern std::vector<perf::Entry>          all;
+extern std::vector<perf::HistogramEntry> allHistogram;
 
 void dump();
 void dump(const std::string& group);
 void clear();
 
+// all counter and histogram as text to pass to other process
+std::string toText();
+// add counter and histogram in text of toText to this process. return false for unexpected text
+bool merge(const std::string& text);
+
 // memory
 PERF_DECLARE(memory, Fetch)
 PERF_DECLARE(memory, Store)
@@ -110,12 +161,24 @@ PERF_DECLARE(processor, busyWait)
 PERF_DECLARE(processor, interruptRequest)
 PERF_DECLARE(processor, timeoutRequest)
 PERF_DECLARE(processor, updatePTC)
+PERF_DECLARE(processor, idle)
+PERF_DECLARE(processor, idle_time)
+PERF_DECLARE(processor, idle_wakeup_time)
+PERF_DECLARE(processor, fastForward)
+PERF_DECLARE(processor, fastForward_time)
 
 // network
 PERF_DECLARE(network, transmit)
+PERF_DECLARE(network, transmit_batch)
 PERF_DECLARE(network, receive_request)
 PERF_DECLARE(network, receive_process)
 PERF_DECLARE(network, receive_packet)
+PERF_DECLARE(network, receive_ring)
+PERF_DECLARE(network, receive_drop)
+// number of packet in receive ring after enqueue
+PERF_HISTOGRAM_DECLARE(network, ring_occupancy)
+// number of packet transmitted by one batch
+PERF_HISTOGRAM_DECLARE(network, transmit_batch_size)
 
 // disk
 PERF_DECLARE(disk, process)
@@ -123,6 +186,47 @@ PERF_DECLARE(disk, read)
 PERF_DECLARE(disk, write)
 PERF_DECLARE(disk, verify)
 PERF_DECLARE(disk, process_time)
+PERF_DECLARE(disk, async_submit)
+PERF_DECLARE(disk, io_error)
+PERF_DECLARE(disk, iocb)
+PERF_DECLARE(disk, transfer)
+PERF_DECLARE(disk, merge)
+PERF_DECLARE(disk, dependency_wait)
+PERF_DECLARE(disk, latency_time)
+PERF_DECLARE(disk, readahead_hit)
+PERF_DECLARE(disk, readahead_miss)
+PERF_DECLARE(disk, readahead_issue)
+PERF_DECLARE(disk, readahead_page)
+PERF_DECLARE(disk, sparse_read)
+PERF_DECLARE(disk, sparse_skip)
+PERF_DECLARE(disk, sparse_punch)
+PERF_DECLARE(disk, flush)
+PERF_DECLARE(disk, flush_page)
+PERF_DECLARE(disk, journal_page)
+PERF_DECLARE(disk, journal_sync)
+PERF_DECLARE(disk, checkpoint)
+// latency in microseconds. wait is from AgentDisk::Call to start of io. service is io time
+PERF_HISTOGRAM_DECLARE(disk, read_wait)
+PERF_HISTOGRAM_DECLARE(disk, read_service)
+PERF_HISTOGRAM_DECLARE(disk, write_wait)
+PERF_HISTOGRAM_DECLARE(disk, write_service)
+PERF_HISTOGRAM_DECLARE(disk, verify_wait)
+PERF_HISTOGRAM_DECLARE(disk, verify_service)
+PERF_HISTOGRAM_DECLARE(disk, flush_time)
+// number of page
+PERF_HISTOGRAM_DECLARE(disk, iocb_page)
+PERF_HISTOGRAM_DECLARE(disk, transfer_page)
+
+// floppy
+PERF_DECLARE(floppy, batch)
+PERF_DECLARE(floppy, iocb)
+PERF_DECLARE(floppy, read)
+PERF_DECLARE(floppy, write)
+PERF_DECLARE(floppy, format)
+PERF_DECLARE(floppy, sector)
+// latency in microseconds from AgentFloppy::Call to completion of batch
+PERF_HISTOGRAM_DECLARE(floppy, latency)
+PERF_HISTOGRAM_DECLARE(floppy, service)
 
 // agent
 PERF_DECLARE(agent, beep)
@@ -164,4 +268,49 @@ PERF_DECLARE(bpf, read_empty)
 PERF_DECLARE(bpf, read_select)
 PERF_DECLARE(bpf, read_zero)
 
+// packet
+PERF_DECLARE(packet, read)
+PERF_DECLARE(packet, read_block)
+PERF_DECLARE(packet, read_empty)
+PERF_DECLARE(packet, read_select)
+PERF_DECLARE(packet, read_outgoing)
+PERF_DECLARE(packet, transmit)
+PERF_DECLARE(packet, transmit_wait)
+PERF_DECLARE(packet, transmit_kick)
+
+// capture
+PERF_DECLARE(capture, packet)
+PERF_DECLARE(capture, drop)
+PERF_DECLARE(capture, write)
+
+// checkpoint
+PERF_DECLARE(checkpoint, take)
+PERF_DECLARE(checkpoint, skip)
+PERF_DECLARE(checkpoint, page)
+PERF_DECLARE(checkpoint, map_chunk)
+PERF_DECLARE(checkpoint, write_byte)
+// time in microseconds. pause is time processor is stopped to copy changed page
+PERF_HISTOGRAM_DECLARE(checkpoint, pause_time)
+PERF_HISTOGRAM_DECLARE(checkpoint, write_time)
+
+// xns
+PERF_DECLARE(xns, echo)
+PERF_DECLARE(xns, boot_request)
+PERF_DECLARE(xns, boot_data)
+PERF_DECLARE(xns, checksum_error)
+
+// vswitch
+PERF_DECLARE(vswitch, transmit)
+PERF_DECLARE(vswitch, transmit_batch)
+PERF_DECLARE(vswitch, transmit_message)
+PERF_DECLARE(vswitch, transmit_flood)
+PERF_DECLARE(vswitch, transmit_unknown)
+PERF_DECLARE(vswitch, transmit_drop)
+PERF_DECLARE(vswitch, transmit_stale)
+PERF_DECLARE(vswitch, receive)
+PERF_DECLARE(vswitch, receive_batch)
+PERF_DECLARE(vswitch, receive_loss)
+PERF_DECLARE(vswitch, receive_delay)
+PERF_DECLARE(vswitch, learn)
+
 }
@@ -47,6 +47,10 @@ void ThreadControl::start() {
     logger.info("thread start   %s", name);
     thread = std::thread(function);
     map[thread.get_id()] = this->name;
+    if (!cpuList.empty()) {
+        logger.info("thread affinity %s  %s", name, cpuList);
+        Util::setAffinity(thread, cpuList);
+    }
 }
 
 void ThreadControl::join() {
@@ -50,6 +50,7 @@ public:
 	std::string           name;
 	std::function<void()> function;
 	std::thread           thread;
+	std::string           cpuList; // cpu to run thread such as "0-3,8". empty for any cpu
 
 	ThreadControl() {}
 	ThreadControl(const char* name_, std::function<void()> function_) : name(name_), function(function_) {}
@@ -59,6 +60,10 @@ public:
 		function = function_;
 	}
 
+	void setAffinity(const std::string& cpuList_) {
+		cpuList = cpuList_;
+	}
+
 	void start();
 	void join();
 };
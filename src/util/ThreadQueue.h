@@ -34,10 +34,12 @@
 
 #pragma once
 
+#include <atomic>
 #include <chrono>
 #include <deque>
 #include <functional>
 #include <mutex>
+#include <vector>
 
 #include "Util.h"
 
@@ -51,35 +53,53 @@ class ThreadQueueProcessor {
     std::condition_variable cv;
     std::deque<T>           queue;
     static inline bool      stopThread;
+    // number of data pushed but not yet processed, sum of all instance of same type
+    //   each instance adds and subtracts own data only. never reset
+    static inline std::atomic<int> pendingCount;
 public:
     ThreadQueueProcessor(const char* name_) : name(name_) {}
     ThreadQueueProcessor() {}
 
     virtual void process(const T& data) = 0;
+    // called with all data queued at the time. override to process data as batch
+    virtual void processBatch(const std::vector<T>& dataList) {
+        for(const auto& data: dataList) {
+            if (stopThread) break;
+            process(data);
+        }
+    }
 
     static void stop() {
         stopThread = true;
     }
+    static bool isPending() {
+        return pendingCount != 0;
+    }
     void push(const T& data) {
         std::unique_lock<std::mutex> lock(mutex);
         queue.push_front(data);
+        pendingCount++;
         cv.notify_one();
     }
     void clear() {
         std::unique_lock<std::mutex> lock(mutex);
+        pendingCount -= (int)queue.size();
         queue.clear();
     }
     using Predicate = std::function<bool(const T&)>;
     void erase_if(Predicate pred) {
-        std::erase_if(queue, pred);
+        std::unique_lock<std::mutex> lock(mutex);
+        pendingCount -= (int)std::erase_if(queue, pred);
     }
 
     void run() {
         logger.info("ThreadQueue start %s", name);
         stopThread = false;
-        queue.clear();
+        // other instance of same type can be running. discard own data only
+        clear();
 
         {
+            std::vector<T> dataList;
             std::unique_lock<std::mutex> lock(mutex);
             for(;;) {
                 if (stopThread) goto exit;
@@ -87,12 +107,14 @@ public:
                     cv.wait_for(lock, Util::ONE_SECOND);
                     if (stopThread) goto exit;
                 }
-                while(!queue.empty()) {
-                    if (stopThread) goto exit;
-                    T data = queue.back();
-                    process(data);
-                    queue.pop_back();
-                }
+                // take all queued data in order of push
+                dataList.assign(queue.rbegin(), queue.rend());
+                queue.clear();
+                // don't block push() while processing data
+                lock.unlock();
+                processBatch(dataList);
+                lock.lock();
+                pendingCount -= (int)dataList.size();
             }
         }
     exit:
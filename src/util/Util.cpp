@@ -42,6 +42,7 @@
 #include <chrono>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <iterator>
 #include <bit>
 
@@ -52,6 +53,19 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 #include <log4cxx/logger.h>
 #include <log4cxx/level.h>
 
@@ -340,7 +354,7 @@ public:
 static std::map<void*, MapInfo>mapInfoMap;
 int MapInfo::count = 0;
 
-Util::MapFileResult Util::mapFile  (const std::string& path) {
+Util::MapFileResult Util::mapFile  (const std::string& path, bool readOnly) {
 	// sanity check
 	if (!std::filesystem::exists(path)) {
 		logger.error("unexpected path");
@@ -351,9 +365,9 @@ Util::MapFileResult Util::mapFile  (const std::string& path) {
 	MapInfo mapInfo;
 	mapInfo.path = path;
 
-	CHECK_SYSCALL(mapInfo.fd, open(path.c_str(), O_RDWR))
+	CHECK_SYSCALL(mapInfo.fd, open(path.c_str(), readOnly ? O_RDONLY : O_RDWR))
 	mapInfo.size = std::filesystem::file_size(path);
-	mapInfo.page = mmap(nullptr, mapInfo.size, PROT_READ | PROT_WRITE, MAP_SHARED, mapInfo.fd, 0);
+	mapInfo.page = mmap(nullptr, mapInfo.size, readOnly ? PROT_READ : (PROT_READ | PROT_WRITE), MAP_SHARED, mapInfo.fd, 0);
 	// sanity check
 	if (std::numeric_limits<uint32_t>::max() < mapInfo.size) ERROR()
 	if (mapInfo.page == MAP_FAILED) ERROR()
@@ -380,6 +394,139 @@ void  Util::unmapFile(void* mapPage) {
 	mapInfoMap.erase(mapInfo.page);
 }
 
+void Util::willNeed(void* mapPage, uint64_t offset, uint64_t length) {
+	static const uint64_t hostPageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+	uint64_t start = offset & ~(hostPageSize - 1);
+	int ret = madvise((uint8_t*)mapPage + start, (size_t)(offset + length - start), MADV_WILLNEED);
+	if (ret < 0) {
+		int errNo = errno;
+		logger.warn("madvise failed  offset = %lu  length = %lu", (unsigned long)offset, (unsigned long)length);
+		LOG_ERRNO(errNo)
+	}
+}
+
+bool Util::isZero(const void* data, uint32_t size) {
+	const uint64_t* p = (const uint64_t*)data;
+	uint64_t bits = 0;
+	for(uint32_t i = 0; i < size / sizeof(uint64_t); i++) bits |= p[i];
+	return bits == 0;
+}
+
+bool Util::getMemoryUsage(int pid, MemoryUsage& usage) {
+	std::ifstream ifs(std_sprintf("/proc/%d/smaps_rollup", pid));
+	if (!ifs) return false;
+
+	usage = {0, 0, 0, 0};
+	std::string name;
+	uint64_t    value;
+	std::string unit;
+	// Rss:  1234 kB
+	for(std::string line; std::getline(ifs, line);) {
+		std::istringstream iss(line);
+		if (!(iss >> name >> value >> unit)) continue;
+		value *= 1024;
+		if (name == "Rss:") usage.rss = value;
+		else if (name == "Pss:") usage.pss = value;
+		else if (name == "Shared_Clean:" || name == "Shared_Dirty:") usage.shared += value;
+		else if (name == "Private_Clean:" || name == "Private_Dirty:") usage.privateSize += value;
+	}
+	return true;
+}
+
+std::vector<int> Util::toCPUList(const std::string& string) {
+	std::vector<int> ret;
+	std::istringstream iss(string);
+	for(std::string range; std::getline(iss, range, ',');) {
+		int first;
+		int last;
+		char c;
+		std::istringstream rss(range);
+		if (!(rss >> first)) return {};
+		if (rss >> c) {
+			if (c != '-' || !(rss >> last) || !rss.eof()) return {};
+		} else {
+			last = first;
+		}
+		if (first < 0 || last < first) return {};
+		for(int i = first; i <= last; i++) ret.push_back(i);
+	}
+	return ret;
+}
+
+#if defined(__linux__)
+static bool setAffinity(pthread_t thread, const std::string& cpuList) {
+	auto list = Util::toCPUList(cpuList);
+	if (list.empty()) {
+		logger.fatal("Unexpected cpuList  \"%s\"", cpuList);
+		ERROR();
+	}
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	for(auto e: list) CPU_SET(e, &cpuSet);
+	int errNo = pthread_setaffinity_np(thread, sizeof(cpuSet), &cpuSet);
+	if (errNo) {
+		logger.warn("setAffinity failed  cpuList = %s", cpuList);
+		LOG_ERRNO(errNo)
+		return false;
+	}
+	return true;
+}
+bool Util::setAffinity(std::thread& thread, const std::string& cpuList) {
+	return ::setAffinity(thread.native_handle(), cpuList);
+}
+bool Util::setAffinity(const std::string& cpuList) {
+	return ::setAffinity(pthread_self(), cpuList);
+}
+bool Util::setMemoryNode(int node) {
+	if (node < 0 || 64 <= node) {
+		logger.fatal("Unexpected node  %d", node);
+		ERROR();
+	}
+	// MPOL_PREFERRED falls back to other node when node is full
+	unsigned long nodeMask = 1UL << node;
+	int ret = syscall(SYS_set_mempolicy, MPOL_PREFERRED, &nodeMask, sizeof(nodeMask) * 8);
+	if (ret < 0) {
+		int errNo = errno;
+		logger.warn("setMemoryNode failed  node = %d", node);
+		LOG_ERRNO(errNo)
+		return false;
+	}
+	return true;
+}
+#else
+bool Util::setAffinity(std::thread&, const std::string& cpuList) {
+	logger.warn("setAffinity is not supported  cpuList = %s", cpuList);
+	return false;
+}
+bool Util::setAffinity(const std::string& cpuList) {
+	logger.warn("setAffinity is not supported  cpuList = %s", cpuList);
+	return false;
+}
+bool Util::setMemoryNode(int node) {
+	logger.warn("setMemoryNode is not supported  node = %d", node);
+	return false;
+}
+#endif
+
+bool Util::punchHole(int fd, uint64_t offset, uint64_t length) {
+#if defined(__linux__)
+	int ret = fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t)offset, (off_t)length);
+#elif defined(F_PUNCHHOLE)
+	fpunchhole_t punchhole = {0, 0, (off_t)offset, (off_t)length};
+	int ret = fcntl(fd, F_PUNCHHOLE, &punchhole);
+#else
+	int ret = -1;
+	errno = ENOTSUP;
+#endif
+	if (ret < 0) {
+		int errNo = errno;
+		logger.warn("punchHole failed  offset = %lu  length = %lu", (unsigned long)offset, (unsigned long)length);
+		LOG_ERRNO(errNo)
+		return false;
+	}
+	return true;
+}
+
 // Time stuff
 uint64_t Util::getSecondsSinceEpoch() {
 	auto duration = std::chrono::system_clock::now().time_since_epoch();
@@ -393,12 +540,75 @@ std::string Util::toString(uint32_t unixTime) {
     return std_sprintf("%d-%02d-%02d %02d:%02d:%02d", 1900 + tm.tm_year, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
 }
 
-void Util::byteswap(uint16_t* source, uint16_t* dest, int size) {
+static void byteswapScalar(const uint16_t* source, uint16_t* dest, int size) {
 	for(int i = 0; i < size; i++) {
 		dest[i] = std::byteswap(source[i]);
 	}
 }
 
+#if defined(__x86_64__)
+// pshufb with mask that swap each pair of byte
+__attribute__((target("ssse3")))
+static void byteswapSSSE3(const uint16_t* source, uint16_t* dest, int size) {
+	const __m128i mask = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+	int i = 0;
+	for(; i + 8 <= size; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(source + i));
+		_mm_storeu_si128((__m128i*)(dest + i), _mm_shuffle_epi8(v, mask));
+	}
+	byteswapScalar(source + i, dest + i, size - i);
+}
+__attribute__((target("avx2")))
+static void byteswapAVX2(const uint16_t* source, uint16_t* dest, int size) {
+	// vpshufb shuffles within each 128 bit lane
+	const __m256i mask = _mm256_setr_epi8(
+		1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+		1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+	int i = 0;
+	for(; i + 32 <= size; i += 32) {
+		__m256i v0 = _mm256_loadu_si256((const __m256i*)(source + i));
+		__m256i v1 = _mm256_loadu_si256((const __m256i*)(source + i + 16));
+		_mm256_storeu_si256((__m256i*)(dest + i),      _mm256_shuffle_epi8(v0, mask));
+		_mm256_storeu_si256((__m256i*)(dest + i + 16), _mm256_shuffle_epi8(v1, mask));
+	}
+	for(; i + 16 <= size; i += 16) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(source + i));
+		_mm256_storeu_si256((__m256i*)(dest + i), _mm256_shuffle_epi8(v, mask));
+	}
+	byteswapSSSE3(source + i, dest + i, size - i);
+}
+#elif defined(__aarch64__)
+// NEON is always available on aarch64
+static void byteswapNEON(const uint16_t* source, uint16_t* dest, int size) {
+	int i = 0;
+	for(; i + 16 <= size; i += 16) {
+		uint8x16_t v0 = vld1q_u8((const uint8_t*)(source + i));
+		uint8x16_t v1 = vld1q_u8((const uint8_t*)(source + i + 8));
+		vst1q_u8((uint8_t*)(dest + i),     vrev16q_u8(v0));
+		vst1q_u8((uint8_t*)(dest + i + 8), vrev16q_u8(v1));
+	}
+	byteswapScalar(source + i, dest + i, size - i);
+}
+#endif
+
+std::vector<Util::ByteswapKernel> Util::getByteswapKernelList() {
+	std::vector<ByteswapKernel> list;
+	list.push_back({"scalar", byteswapScalar});
+#if defined(__x86_64__)
+	if (__builtin_cpu_supports("ssse3")) list.push_back({"ssse3", byteswapSSSE3});
+	if (__builtin_cpu_supports("avx2"))  list.push_back({"avx2",  byteswapAVX2});
+#elif defined(__aarch64__)
+	list.push_back({"neon", byteswapNEON});
+#endif
+	return list;
+}
+
+void Util::byteswap(uint16_t* source, uint16_t* dest, int size) {
+	// select kernel once at first call
+	static const auto function = getByteswapKernelList().back().function;
+	function(source, dest, size);
+}
+
 
 void std_vsprintf_(std::string& result, int bufferSize, const char* format, va_list ap) {
 	char* buf = (char*)alloca(bufferSize);
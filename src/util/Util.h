@@ -41,6 +41,7 @@
 #include <source_location>
 #include <concepts>
 #include <variant>
+#include <thread>
 
 #include <log4cxx/logger.h>
 #include <vector>
@@ -319,11 +320,44 @@ public:
 
 		MapFileResult(void* mapPage_, uint32_t mapSize_) : mapPage(mapPage_), mapSize(mapSize_) {}
 	};
-	static MapFileResult mapFile(const std::string& path);
+	static MapFileResult mapFile(const std::string& path, bool readOnly = false);
 	static void          unmapFile(void* mapPage);
-
+	// release disk block of file range. file size is not changed. return false if not supported
+	static bool          punchHole(int fd, uint64_t offset, uint64_t length);
+	// madvise(MADV_WILLNEED) for range of mapped file. offset is aligned to host page
+	static void          willNeed(void* mapPage, uint64_t offset, uint64_t length);
+	// true if all bytes are zero. size must be multiple of 8
+	static bool          isZero(const void* data, uint32_t size);
+
+	// memory of process in byte. shared is page mapped by other process such as copy-on-write page after fork
+	struct MemoryUsage {
+		uint64_t rss;
+		uint64_t pss;
+		uint64_t shared;
+		uint64_t privateSize;
+	};
+	// read /proc/PID/smaps_rollup. return false if not available
+	static bool          getMemoryUsage(int pid, MemoryUsage& usage);
+
+	// parse cpu list such as "0-3,8". return empty for invalid string
+	static std::vector<int> toCPUList(const std::string& string);
+	// bind thread to cpu in cpuList. return false if not supported
+	static bool          setAffinity(std::thread& thread, const std::string& cpuList);
+	static bool          setAffinity(const std::string& cpuList); // calling thread
+	// allocate memory of calling process from NUMA node if possible. return false if not supported
+	static bool          setMemoryNode(int node);
+
+	// swap bytes of size words from source to dest. source and dest can be same
 	static void    byteswap  (uint16_t* source, uint16_t* dest, int size);
 
+	// byteswap implementation. byteswap uses fastest one supported by cpu
+	struct ByteswapKernel {
+		const char* name;
+		void      (*function)(const uint16_t* source, uint16_t* dest, int size);
+	};
+	// list of kernel supported by cpu. first is scalar and last is used by byteswap
+	static std::vector<ByteswapKernel> getByteswapKernelList();
+
 	//From System.mesa
 	//-- Time of day
 	//
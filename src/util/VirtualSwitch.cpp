@@ -0,0 +1,460 @@
+/*******************************************************************************
+ * Copyright (c) 2025, Yasuhiro Hasegawa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+
+//
+// VirtualSwitch.cpp
+//
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Util.h"
+static const Logger logger(__FILE__);
+
+#include "Perf.h"
+
+#include "VirtualSwitch.h"
+
+// size of Ethernet header
+static constexpr uint32_t HEADER_SIZE = 14;
+
+static uint64_t toAddress(const uint8_t* p) {
+	uint64_t address = 0;
+	for(int i = 0; i < 6; i++) {
+		address <<= 8;
+		address |= p[i];
+	}
+	return address;
+}
+// group address has 1 in lsb of first byte
+static bool isGroup(uint64_t address) {
+	return (address >> 40) & 1;
+}
+
+bool VirtualSwitch::isVirtual(const std::string& name) {
+	return name.starts_with(PREFIX);
+}
+
+VirtualSwitch::Config VirtualSwitch::parse(const std::string& name) {
+	if (!isVirtual(name)) ERROR();
+
+	std::vector<std::string> tokenList;
+	{
+		std::string rest = name.substr(strlen(PREFIX));
+		for(;;) {
+			auto pos = rest.find(',');
+			tokenList.push_back(rest.substr(0, pos));
+			if (pos == std::string::npos) break;
+			rest = rest.substr(pos + 1);
+		}
+	}
+
+	Config config;
+	config.switchName = tokenList[0];
+	if (config.switchName.empty() || config.switchName.find('/') != std::string::npos) {
+		logger.fatal("Unexpected switch name  %s", name);
+		ERROR();
+	}
+	for(size_t i = 1; i < tokenList.size(); i++) {
+		const auto& token = tokenList[i];
+		auto pos = token.find('=');
+		if (pos == std::string::npos) {
+			logger.fatal("Unexpected option  %s", token);
+			ERROR();
+		}
+		auto key   = token.substr(0, pos);
+		auto value = token.substr(pos + 1);
+		if (key == "address") {
+			config.address = net::fromString(value);
+		} else if (key == "delay") {
+			config.delay = std::stoul(value);
+		} else if (key == "loss") {
+			config.loss = std::stod(value);
+		} else if (key == "seed") {
+			config.seed = std::stoul(value);
+		} else {
+			logger.fatal("Unexpected option  %s", token);
+			ERROR();
+		}
+	}
+	if (config.address == 0) {
+		// locally administered address from pid and counter
+		static std::atomic<uint32_t> counter;
+		config.address = 0x02'00'00'00'00'00ULL | ((uint64_t)(::getpid() & 0xFF'FFFF) << 8) | (counter++ & 0xFF);
+	}
+	return config;
+}
+
+void VirtualSwitch::open(const Config& config_) {
+	if (isOpen()) ERROR();
+	config = config_;
+
+	auto dir = std::string(DIRECTORY) + "/" + config.switchName;
+	std::filesystem::create_directories(dir);
+	path = dir + "/" + std_sprintf("%012lX", config.address);
+
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (sizeof(addr.sun_path) <= path.size()) {
+		logger.fatal("Too long path  %s", path);
+		ERROR();
+	}
+	strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+	int ret;
+	if (std::filesystem::exists(path)) {
+		// connect to socket without receiver fails with ECONNREFUSED
+		int probe;
+		CHECK_SYSCALL(probe, ::socket(AF_UNIX, SOCK_DGRAM, 0))
+		int errNo = (::connect(probe, (sockaddr*)&addr, sizeof(addr)) == 0) ? 0 : errno;
+		::close(probe);
+		if (errNo == 0) {
+			logger.fatal("port is used by other instance  %s", path);
+			ERROR();
+		}
+		if (errNo != ECONNREFUSED && errNo != ENOENT) {
+			logger.fatal("unexpected port  %s", path);
+			LOG_ERRNO(errNo)
+			ERROR();
+		}
+		// remove socket left by previous run
+		logger.warn("remove stale port  %s", path);
+		std::error_code ec;
+		std::filesystem::remove(path, ec);
+	}
+	CHECK_SYSCALL(fd, ::socket(AF_UNIX, SOCK_DGRAM, 0))
+	CHECK_SYSCALL(ret, ::bind(fd, (sockaddr*)&addr, sizeof(addr)))
+	{
+		// close removes path only if it is still socket of this port
+		struct stat statBuffer;
+		CHECK_SYSCALL(ret, ::stat(path.c_str(), &statBuffer))
+		pathDevice = statBuffer.st_dev;
+		pathInode  = statBuffer.st_ino;
+	}
+	{
+		int size = 1024 * 1024;
+		LOG_SYSCALL(ret, ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)))
+	}
+	{
+		// sendto blocks while receive queue of peer is full. drop packet after SEND_TIMEOUT
+		timeval timeout;
+		timeout.tv_sec  = 0;
+		timeout.tv_usec = SEND_TIMEOUT;
+		LOG_SYSCALL(ret, ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)))
+	}
+
+	random.seed(config.seed ? config.seed : std::random_device()());
+	portListTime = std::filesystem::file_time_type{};
+
+	logger.info("VirtualSwitch open  %s  delay = %u  loss = %.2f", path, config.delay, config.loss);
+}
+void VirtualSwitch::close() {
+	if (0 <= fd) {
+		int ret;
+		LOG_SYSCALL(ret, ::close(fd))
+		fd = -1;
+		struct stat statBuffer;
+		if (::stat(path.c_str(), &statBuffer) == 0 && statBuffer.st_dev == pathDevice && statBuffer.st_ino == pathInode) {
+			std::error_code ec;
+			std::filesystem::remove(path, ec);
+		}
+	}
+	pending.clear();
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		table.clear();
+	}
+	portList.clear();
+}
+
+void VirtualSwitch::clear() {
+	pending.clear();
+	uint8_t buffer[net::PACKET_SIZE];
+	for(;;) {
+		if (::recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT) < 0) break;
+	}
+}
+
+// no error check
+int VirtualSwitch::select(microseconds timeout) {
+	if (!pending.empty()) return 1;
+	pollfd fds;
+	fds.fd      = fd;
+	fds.events  = POLLIN;
+	fds.revents = 0;
+	// round up to millisecond
+	int ms = (int)((timeout.count() + 999) / 1000);
+	int ret;
+	LOG_SYSCALL(ret, ::poll(&fds, 1, ms))
+	return ret;
+}
+
+void VirtualSwitch::fill() {
+	PERF_COUNT(vswitch, receive_batch)
+	std::uniform_real_distribution<double> distribution(0, 100);
+	// receive all packet in socket up to BATCH_SIZE without blocking
+	for(uint32_t i = 0; i < BATCH_SIZE; i++) {
+		Packet packet;
+		sockaddr_un addr;
+		socklen_t   addrLen = sizeof(addr);
+		memset(&addr, 0, sizeof(addr));
+		int ret = ::recvfrom(fd, packet.data, sizeof(packet.data), MSG_DONTWAIT, (sockaddr*)&addr, &addrLen);
+		if (ret < 0) {
+			int errNo = errno;
+			if (errNo != EAGAIN && errNo != EWOULDBLOCK) {
+				logger.error("recvfrom failed");
+				LOG_ERRNO(errNo)
+			}
+			break;
+		}
+		PERF_COUNT(vswitch, receive)
+		if (ret < (int)HEADER_SIZE) continue;
+
+		auto source = toAddress(packet.data + 6);
+		if (!isGroup(source) && addr.sun_path[0]) learn(source, addr.sun_path);
+
+		if (config.loss && distribution(random) < config.loss) {
+			PERF_COUNT(vswitch, receive_loss)
+			continue;
+		}
+		packet.length = ret;
+		packet.time   = std::chrono::steady_clock::now() + microseconds(config.delay);
+		pending.push_back(packet);
+	}
+}
+
+int VirtualSwitch::receive(data_type& data, microseconds timeout, microseconds* timestamp) {
+	auto deadline = std::chrono::steady_clock::now() + timeout;
+	for(;;) {
+		auto now = std::chrono::steady_clock::now();
+		if (!pending.empty() && pending.front().time <= now) {
+			current = pending.front();
+			pending.pop_front();
+			data = data_type{current.data, current.length};
+			if (timestamp) {
+				*timestamp = std::chrono::duration_cast<microseconds>(std::chrono::system_clock::now().time_since_epoch());
+			}
+			return data.size();
+		}
+		if (deadline <= now) break;
+
+		// wait until deadline or time of first pending packet
+		auto wait = deadline - now;
+		if (!pending.empty()) {
+			PERF_COUNT(vswitch, receive_delay)
+			wait = std::min(wait, pending.front().time - now);
+		}
+		pollfd fds;
+		fds.fd      = fd;
+		fds.events  = POLLIN;
+		fds.revents = 0;
+		int ms = (int)((std::chrono::duration_cast<microseconds>(wait).count() + 999) / 1000);
+		int ret;
+		LOG_SYSCALL(ret, ::poll(&fds, 1, ms))
+		if (0 < ret) fill();
+	}
+	data = data_type{};
+	return 0;
+}
+
+void VirtualSwitch::learn(uint64_t address, const std::string& portPath) {
+	std::unique_lock<std::mutex> lock(mutex);
+	auto it = table.find(address);
+	if (it != table.end() && it->second == portPath) return;
+	PERF_COUNT(vswitch, learn)
+	table[address] = portPath;
+}
+void VirtualSwitch::dropPort(const std::string& portPath) {
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		std::erase_if(table, [&](const auto& e){ return e.second == portPath; });
+	}
+	std::erase(portList, portPath);
+}
+
+void VirtualSwitch::updatePortList() {
+	auto dir = std::string(DIRECTORY) + "/" + config.switchName;
+	std::error_code ec;
+	auto time = std::filesystem::last_write_time(dir, ec);
+	if (!ec && time == portListTime) return;
+
+	portList.clear();
+	for(const auto& entry: std::filesystem::directory_iterator(dir, ec)) {
+		if (!entry.is_socket(ec)) continue;
+		auto entryPath = entry.path().string();
+		if (entryPath == path) continue;
+		portList.push_back(entryPath);
+	}
+	portListTime = time;
+}
+
+bool VirtualSwitch::send(const std::string& portPath, const data_type& data) {
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, portPath.c_str(), sizeof(addr.sun_path) - 1);
+
+	PERF_COUNT(vswitch, transmit_message)
+	int ret = ::sendto(fd, data.data(), data.size(), 0, (sockaddr*)&addr, sizeof(addr));
+	if (ret < 0) return handleError(portPath, errno);
+	return true;
+}
+
+bool VirtualSwitch::handleError(const std::string& portPath, int errNo) {
+	switch(errNo) {
+	case ECONNREFUSED:
+		// socket of terminated process. file is left to open of same address, that probes before remove
+		PERF_COUNT(vswitch, transmit_stale)
+		return false;
+	case ENOENT:
+		return false;
+	case EAGAIN:
+	case ENOBUFS:
+		// receiver is congested for SEND_TIMEOUT. drop packet like real switch
+		PERF_COUNT(vswitch, transmit_drop)
+		return true;
+	default:
+		logger.error("sendto failed  %s", portPath);
+		LOG_ERRNO(errNo)
+		return true;
+	}
+}
+
+void VirtualSwitch::flood(const data_type& data) {
+	PERF_COUNT(vswitch, transmit_flood)
+	updatePortList();
+	std::vector<std::string> staleList;
+	for(const auto& portPath: portList) {
+		if (!send(portPath, data)) staleList.push_back(portPath);
+	}
+	for(const auto& portPath: staleList) dropPort(portPath);
+}
+
+int VirtualSwitch::transmit(const data_type& data) {
+	PERF_COUNT(vswitch, transmit)
+	if (data.size() < HEADER_SIZE) return -1;
+
+	auto destination = toAddress(data.data());
+	if (!isGroup(destination)) {
+		std::string portPath;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			auto it = table.find(destination);
+			if (it != table.end()) portPath = it->second;
+		}
+		if (!portPath.empty()) {
+			if (send(portPath, data)) return data.size();
+			dropPort(portPath);
+		}
+		PERF_COUNT(vswitch, transmit_unknown)
+	}
+	// broadcast, multicast or unknown destination
+	flood(data);
+	return data.size();
+}
+
+void VirtualSwitch::resolve(const data_type& data, std::vector<Message>& messageList) {
+	auto destination = toAddress(data.data());
+	if (!isGroup(destination)) {
+		std::unique_lock<std::mutex> lock(mutex);
+		auto it = table.find(destination);
+		if (it != table.end()) {
+			messageList.push_back({it->second, data});
+			return;
+		}
+		PERF_COUNT(vswitch, transmit_unknown)
+	}
+	PERF_COUNT(vswitch, transmit_flood)
+	updatePortList();
+	for(const auto& portPath: portList) {
+		messageList.push_back({portPath, data});
+	}
+}
+
+int VirtualSwitch::transmitBatch(const std::vector<data_type>& dataList) {
+	PERF_COUNT(vswitch, transmit_batch)
+	std::vector<Message> messageList;
+	int count = 0;
+	for(const auto& data: dataList) {
+		PERF_COUNT(vswitch, transmit)
+		if (data.size() < HEADER_SIZE) break;
+		resolve(data, messageList);
+		count++;
+	}
+
+	const size_t size = messageList.size();
+#if defined(__linux__)
+	PERF_ADD(vswitch, transmit_message, size)
+	// one sendmmsg for all message
+	std::vector<sockaddr_un> addrList(size);
+	std::vector<iovec>       iovList(size);
+	std::vector<mmsghdr>     msgList(size);
+	for(size_t i = 0; i < size; i++) {
+		const auto& message = messageList[i];
+		auto& addr = addrList[i];
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, message.path.c_str(), sizeof(addr.sun_path) - 1);
+		iovList[i].iov_base = message.data.data();
+		iovList[i].iov_len  = message.data.size();
+		memset(&msgList[i], 0, sizeof(msgList[i]));
+		msgList[i].msg_hdr.msg_name    = &addr;
+		msgList[i].msg_hdr.msg_namelen = sizeof(addr);
+		msgList[i].msg_hdr.msg_iov     = &iovList[i];
+		msgList[i].msg_hdr.msg_iovlen  = 1;
+	}
+	for(size_t i = 0; i < size; ) {
+		int ret = ::sendmmsg(fd, msgList.data() + i, size - i, 0);
+		if (ret < 0) {
+			// message i is not sent. continue with next message
+			const auto& portPath = messageList[i].path;
+			if (!handleError(portPath, errno)) dropPort(portPath);
+			i++;
+		} else {
+			i += ret;
+		}
+	}
+#else
+	for(const auto& message: messageList) {
+		if (!send(message.path, message.data)) dropPort(message.path);
+	}
+#endif
+	return count;
+}
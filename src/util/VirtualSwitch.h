@@ -0,0 +1,143 @@
+/*******************************************************************************
+ * Copyright (c) 2025, Yasuhiro Hasegawa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+
+//
+// VirtualSwitch.h
+//
+
+#pragma once
+
+// Port of virtual learning Ethernet switch.
+// Each port is a Unix datagram socket in DIRECTORY/<switch>/ named by its Ethernet address.
+// Ports in same process and in other processes on same host can exchange packet without privilege.
+// open refuses address of live port, and removes only stale socket left by previous run.
+//
+// Interface name is "vswitch:<switch>[,address=<address>][,delay=<microseconds>][,loss=<percent>][,seed=<n>]"
+//   delay and loss are applied to received packet for test
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <random>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "net.h"
+
+struct VirtualSwitch {
+	using data_type = std::span<uint8_t>;
+	using microseconds = std::chrono::microseconds;
+	using time_point = std::chrono::steady_clock::time_point;
+
+	static constexpr const char* PREFIX    = "vswitch:";
+	static constexpr const char* DIRECTORY = "/tmp/mesa-vswitch";
+	// maximum number of packet received by one fill
+	static constexpr uint32_t BATCH_SIZE = 32;
+	// microseconds to wait for congested port before dropping packet
+	static constexpr uint32_t SEND_TIMEOUT = 10'000;
+
+	struct Config {
+		std::string switchName;
+		uint64_t    address = 0;
+		uint32_t    delay   = 0;   // microseconds
+		double      loss    = 0;   // percent
+		uint32_t    seed    = 0;   // 0 means random seed
+	};
+	// true if name is interface name of virtual switch
+	static bool isVirtual(const std::string& name);
+	// parse interface name. generates local address if address is not specified
+	static Config parse(const std::string& name);
+
+	struct Packet {
+		time_point time;
+		uint32_t   length;
+		uint8_t    data[net::PACKET_SIZE];
+	};
+
+	Config      config;
+	std::string path;
+	int         fd;
+	uint64_t    pathDevice; // identity of socket file of path
+	uint64_t    pathInode;
+
+	VirtualSwitch() : fd(-1), pathDevice(0), pathInode(0) {}
+	~VirtualSwitch() { close(); }
+
+	void open(const Config& config);
+	void close();
+	bool isOpen() {
+		return 0 <= fd;
+	}
+
+	void clear(); // discard received packet
+	int  select(microseconds timeout);
+
+	// data points to internal buffer. data is valid until next call of receive
+	int  receive(data_type& data, microseconds timeout, microseconds* timestamp = 0);
+	int  transmit(const data_type& data);
+	// send all data with one system call if possible. returns number of data transmitted
+	int  transmitBatch(const std::vector<data_type>& dataList);
+
+private:
+	struct Message {
+		std::string path;
+		data_type   data;
+	};
+
+	// receive side. used only by receive thread
+	std::deque<Packet> pending;
+	Packet             current;
+	std::mt19937       random;
+
+	// learning table from address to socket path. guarded by mutex
+	std::mutex                                mutex;
+	std::unordered_map<uint64_t, std::string> table;
+	// socket path of all port for flooding. rescan when modification time of directory is changed
+	// used only by transmit thread
+	std::vector<std::string>        portList;
+	std::filesystem::file_time_type portListTime;
+
+	void fill();
+	void learn(uint64_t address, const std::string& path);
+	// remove port from learning table and portList. socket file is not removed
+	void dropPort(const std::string& path);
+	void updatePortList();
+	// returns false if port doesn't exist anymore
+	bool send(const std::string& path, const data_type& data);
+	bool handleError(const std::string& path, int errNo);
+	void flood(const data_type& data);
+	// append message for data to messageList
+	void resolve(const data_type& data, std::vector<Message>& messageList);
+};
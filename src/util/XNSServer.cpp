@@ -0,0 +1,261 @@
+/*******************************************************************************
+ * Copyright (c) 2025, Yasuhiro Hasegawa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+
+//
+// XNSServer.cpp
+//
+
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+#include "Util.h"
+static const Logger logger(__FILE__);
+
+#include "Perf.h"
+
+#include "XNSServer.h"
+
+namespace xns {
+
+static uint16_t get16(const uint8_t* p) {
+	return (uint16_t)((p[0] << 8) | p[1]);
+}
+static uint32_t get32(const uint8_t* p) {
+	return ((uint32_t)get16(p) << 16) | get16(p + 2);
+}
+static uint64_t get48(const uint8_t* p) {
+	return ((uint64_t)get16(p) << 32) | get32(p + 2);
+}
+static void put16(uint8_t* p, uint16_t value) {
+	p[0] = (uint8_t)(value >> 8);
+	p[1] = (uint8_t)value;
+}
+static void put32(uint8_t* p, uint32_t value) {
+	put16(p + 0, (uint16_t)(value >> 16));
+	put16(p + 2, (uint16_t)value);
+}
+static void put48(uint8_t* p, uint64_t value) {
+	put16(p + 0, (uint16_t)(value >> 32));
+	put32(p + 2, (uint32_t)value);
+}
+
+// ones complement add and left cycle of each word after checksum word
+uint16_t checksum(const uint8_t* data, uint32_t length) {
+	uint32_t sum = 0;
+	for(uint32_t i = 2; i < length; i += 2) {
+		// odd last byte is padded with zero
+		uint16_t word = (i + 1 < length) ? get16(data + i) : (uint16_t)(data[i] << 8);
+		sum += word;
+		if (0xFFFF < sum) sum = (sum & 0xFFFF) + 1;
+		sum = ((sum << 1) | (sum >> 15)) & 0xFFFF;
+	}
+	// 0xFFFF means no checksum
+	if (sum == 0xFFFF) sum = 0;
+	return (uint16_t)sum;
+}
+
+bool Packet::parse(const std::span<uint8_t>& frame) {
+	if (frame.size() < ETHER_HEADER_SIZE + IDP_HEADER_SIZE) return false;
+	const uint8_t* p = frame.data();
+	if (get16(p + 12) != ETHER_TYPE) return false;
+
+	const uint8_t* idp = p + ETHER_HEADER_SIZE;
+	uint16_t length = get16(idp + 2);
+	if (length < IDP_HEADER_SIZE || frame.size() < ETHER_HEADER_SIZE + length) return false;
+	uint16_t sum = get16(idp + 0);
+	if (sum != 0xFFFF && sum != checksum(idp, length)) {
+		PERF_COUNT(xns, checksum_error)
+		return false;
+	}
+
+	etherDestination   = get48(p + 0);
+	etherSource        = get48(p + 6);
+	packetType         = idp[5];
+	destination.net    = get32(idp + 6);
+	destination.host   = get48(idp + 10);
+	destination.socket = get16(idp + 16);
+	source.net         = get32(idp + 18);
+	source.host        = get48(idp + 22);
+	source.socket      = get16(idp + 28);
+	data.assign(idp + IDP_HEADER_SIZE, idp + length);
+	return true;
+}
+
+void Packet::build(std::vector<uint8_t>& frame) const {
+	uint32_t length = IDP_HEADER_SIZE + (uint32_t)data.size();
+	// IDP packet is word aligned in frame
+	uint32_t size = ETHER_HEADER_SIZE + ((length + 1) & ~1U);
+	frame.assign(std::max(size, (uint32_t)net::minBytesPerEthernetPacket), 0);
+
+	uint8_t* p = frame.data();
+	put48(p + 0, etherDestination);
+	put48(p + 6, etherSource);
+	put16(p + 12, ETHER_TYPE);
+
+	uint8_t* idp = p + ETHER_HEADER_SIZE;
+	put16(idp + 2, (uint16_t)length);
+	idp[4] = 0; // transport control
+	idp[5] = packetType;
+	put32(idp + 6,  destination.net);
+	put48(idp + 10, destination.host);
+	put16(idp + 16, destination.socket);
+	put32(idp + 18, source.net);
+	put48(idp + 22, source.host);
+	put16(idp + 28, source.socket);
+	std::copy(data.begin(), data.end(), idp + IDP_HEADER_SIZE);
+	put16(idp + 0, checksum(idp, length));
+}
+
+
+void Server::addBootFile(uint64_t bootFileNumber, const std::string& path) {
+	std::ifstream in(path, std::ios::binary);
+	if (!in) {
+		logger.fatal("Cannot open  %s", path);
+		ERROR();
+	}
+	auto& file = bootFileMap[bootFileNumber];
+	file.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	logger.info("boot file  %s  %s  %s byte", net::toHexaDecimalString(bootFileNumber), path, formatWithCommas(file.size()));
+}
+
+void Server::run() {
+	logger.info("XNS server start  %s  %s", driver->device.name, net::toHexaDecimalString(driver->device.address));
+	for(;;) {
+		if (stopThread) break;
+		std::span<uint8_t> frame;
+		if (driver->receive(frame, std::chrono::milliseconds(100))) process(frame);
+	}
+	logger.info("XNS server stop");
+}
+
+bool Server::process(const std::span<uint8_t>& frame) {
+	Packet request;
+	if (!request.parse(frame)) return false;
+	// ignore own packet
+	if (request.etherSource == driver->device.address) return false;
+
+	if (request.packetType == PT_ECHO && request.destination.socket == SOCKET_ECHO) {
+		processEcho(request);
+		return true;
+	}
+	if (request.packetType == PT_BOOT && request.destination.socket == SOCKET_BOOT) {
+		processBoot(request);
+		return true;
+	}
+	return false;
+}
+
+void Server::reply(const Packet& request, Packet& response) {
+	response.etherDestination   = request.etherSource;
+	response.etherSource        = driver->device.address;
+	response.packetType         = request.packetType;
+	response.destination        = request.source;
+	response.source.net         = request.destination.net;
+	response.source.host        = driver->device.address;
+	response.source.socket      = request.destination.socket;
+}
+
+void Server::processEcho(const Packet& request) {
+	if (request.data.size() < 2 || get16(request.data.data()) != ECHO_REQUEST) return;
+	PERF_COUNT(xns, echo)
+
+	Packet response;
+	reply(request, response);
+	response.data = request.data;
+	put16(response.data.data(), ECHO_REPLY);
+
+	std::vector<uint8_t> frame;
+	response.build(frame);
+	std::span<uint8_t> span{frame};
+	driver->transmit(span);
+}
+
+void Server::processBoot(const Packet& request) {
+	if (request.data.size() < 8 || get16(request.data.data()) != BOOT_SIMPLE_REQUEST) return;
+	PERF_COUNT(xns, boot_request)
+
+	uint64_t bootFileNumber = get48(request.data.data() + 2);
+	auto it = bootFileMap.find(bootFileNumber);
+	if (it == bootFileMap.end()) {
+		logger.warn("Unknown boot file number  %s", net::toHexaDecimalString(bootFileNumber));
+		return;
+	}
+	const auto& file = it->second;
+	// last packet has no data
+	const uint32_t lastPacketNumber = (uint32_t)((file.size() + BOOT_DATA_SIZE - 1) / BOOT_DATA_SIZE) + 1;
+
+	auto build = [&](uint32_t packetNumber, std::vector<uint8_t>& frame) {
+		size_t offset = (size_t)(packetNumber - 1) * BOOT_DATA_SIZE;
+		size_t size   = offset < file.size() ? std::min((size_t)BOOT_DATA_SIZE, file.size() - offset) : 0;
+
+		Packet response;
+		reply(request, response);
+		response.data.resize(10 + size);
+		uint8_t* p = response.data.data();
+		put16(p + 0, BOOT_SIMPLE_DATA);
+		put48(p + 2, bootFileNumber);
+		put16(p + 8, (uint16_t)packetNumber);
+		if (size) std::copy(file.begin() + offset, file.begin() + offset + size, p + 10);
+		response.build(frame);
+	};
+
+	if (10 <= request.data.size()) {
+		// request of one packet
+		uint32_t packetNumber = get16(request.data.data() + 8);
+		if (packetNumber == 0 || lastPacketNumber < packetNumber) return;
+		PERF_COUNT(xns, boot_data)
+		std::vector<uint8_t> frame;
+		build(packetNumber, frame);
+		std::span<uint8_t> span{frame};
+		driver->transmit(span);
+		return;
+	}
+
+	// send whole file
+	logger.info("boot  %s  to %s  %u packets", net::toHexaDecimalString(bootFileNumber), net::toHexaDecimalString(request.source.host), lastPacketNumber);
+	// whole file at once overruns receive ring of guest, and virtual switch drops packet to congested port
+	std::vector<std::vector<uint8_t>> frameList(BOOT_BURST_SIZE);
+	std::vector<net::Driver::data_type> dataList;
+	for(uint32_t first = 1; first <= lastPacketNumber; first += BOOT_BURST_SIZE) {
+		if (first != 1 && interval.count()) std::this_thread::sleep_for(interval);
+		const uint32_t count = std::min(BOOT_BURST_SIZE, lastPacketNumber - first + 1);
+		dataList.clear();
+		for(uint32_t i = 0; i < count; i++) {
+			build(first + i, frameList[i]);
+			dataList.emplace_back(frameList[i]);
+		}
+		PERF_ADD(xns, boot_data, count)
+		driver->transmitBatch(dataList);
+	}
+}
+
+}
@@ -0,0 +1,141 @@
+/*******************************************************************************
+ * Copyright (c) 2025, Yasuhiro Hasegawa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+
+//
+// XNSServer.h
+//
+
+#pragma once
+
+// Minimal XNS services for network boot and latency benchmark without outside server.
+//   echo  responds to echo request on socket 2
+//   boot  sends boot file by simple boot protocol on socket 10
+//
+// Packet layout (big endian 16 bit word)
+//   Ethernet  destination(6) source(6) type(2) = 0x0600
+//   IDP       checksum length transportControl(1) packetType(1)
+//             destination net(4) host(6) socket(2)  source net(4) host(6) socket(2)
+//   echo      operation  1 = request  2 = reply.  rest of data is echoed
+//   boot      etherBootPacketType  bootFileNumber(6)
+//               simpleRequest 1  optional packetNumber. without packetNumber all packets are sent
+//                                in burst of BOOT_BURST_SIZE packets with interval between burst
+//               simpleData    2  packetNumber  data(512). packet without data marks end of file
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "net.h"
+
+namespace xns {
+
+constexpr uint16_t ETHER_TYPE = 0x0600;
+
+constexpr uint32_t ETHER_HEADER_SIZE = 14;
+constexpr uint32_t IDP_HEADER_SIZE   = 30;
+
+constexpr uint8_t PT_ECHO = 2;
+constexpr uint8_t PT_BOOT = 9;
+
+constexpr uint16_t SOCKET_ECHO = 2;
+constexpr uint16_t SOCKET_BOOT = 10;
+
+constexpr uint16_t ECHO_REQUEST = 1;
+constexpr uint16_t ECHO_REPLY   = 2;
+
+constexpr uint16_t BOOT_SIMPLE_REQUEST = 1;
+constexpr uint16_t BOOT_SIMPLE_DATA    = 2;
+// data size of one simpleData packet
+constexpr uint32_t BOOT_DATA_SIZE      = 512;
+// burst is far smaller than receive ring of guest (AgentNetwork RING_SIZE = 64)
+constexpr uint32_t BOOT_BURST_SIZE     = 16;
+
+constexpr std::chrono::microseconds DEFAULT_INTERVAL{1000};
+
+// XNS checksum of IDP packet. data points IDP header
+uint16_t checksum(const uint8_t* data, uint32_t length);
+
+struct Address {
+	uint32_t net;
+	uint64_t host;
+	uint16_t socket;
+};
+
+// IDP packet in Ethernet frame
+struct Packet {
+	uint64_t etherDestination;
+	uint64_t etherSource;
+	uint8_t  packetType;
+	Address  destination;
+	Address  source;
+	std::vector<uint8_t> data; // IDP data
+
+	// returns false if frame is not valid IDP packet
+	bool parse(const std::span<uint8_t>& frame);
+	// build Ethernet frame with checksum. frame is padded to minimum length
+	void build(std::vector<uint8_t>& frame) const;
+};
+
+class Server {
+public:
+	Server(net::Driver* driver_) : driver(driver_), interval(DEFAULT_INTERVAL), stopThread(false) {}
+
+	// serve boot file of bootFileNumber
+	void addBootFile(uint64_t bootFileNumber, const std::string& path);
+	// interval between burst of simpleData packets to avoid overrun of receiver. 0 sends burst back to back
+	void setInterval(std::chrono::microseconds newValue) {
+		interval = newValue;
+	}
+
+	// process packet until stop. stop before run makes run return at once
+	void run();
+	void stop() {
+		stopThread = true;
+	}
+	// returns true if frame is processed
+	bool process(const std::span<uint8_t>& frame);
+
+private:
+	net::Driver*                              driver;
+	std::chrono::microseconds                 interval;
+	std::atomic<bool>                         stopThread;
+	std::map<uint64_t, std::vector<uint8_t>>  bootFileMap;
+
+	void reply(const Packet& request, Packet& response);
+	void processEcho(const Packet& request);
+	void processBoot(const Packet& request);
+};
+
+}
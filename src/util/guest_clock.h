@@ -0,0 +1,65 @@
+/*******************************************************************************
+ * Copyright (c) 2025, Yasuhiro Hasegawa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+//
+// guest_clock.h
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+#include "tsc_clock.h"
+
+// guest_clock is the clock seen by Mesa processor (IT and timer tick)
+// In virtual time mode, processor can skip idle time by advance() instead of waiting in real time.
+
+namespace guest_clock {
+
+using clock = std::chrono::steady_clock;
+
+// skipped time in microseconds
+extern std::atomic<int64_t> skipped;
+
+void enable(bool newValue);
+bool isEnabled();
+
+// advance guest clock by duration. has no effect when virtual time mode is disabled
+void advance(std::chrono::microseconds duration);
+
+inline clock::time_point now() {
+    return tsc_clock::now() + std::chrono::microseconds(skipped.load(std::memory_order_relaxed));
+}
+inline std::chrono::microseconds getSkipped() {
+    return std::chrono::microseconds(skipped.load(std::memory_order_relaxed));
+}
+
+}
@@ -31,23 +31,38 @@
 
  #include <vector>
  #include <regex>
+ #include <array>
 
+#if defined(__APPLE__)
 #include <net/bpf.h>
 #include <net/if.h>
 #include <net/if_dl.h>
 #include <sys/ioctl.h>
+#endif
+#if defined(__linux__)
+#include <linux/if_packet.h>
+#include <net/if.h>
+#endif
 #include <ifaddrs.h>
 #include <unistd.h>
 
 #include "Util.h"
 static const Logger logger(__FILE__);
 
+#if defined(__APPLE__)
 #include "BPF.h"
+#endif
+#if defined(__linux__)
+#include "PacketRing.h"
+#endif
+
+#include "VirtualSwitch.h"
 
 #include "net.h"
 
 namespace net {
 
+#if defined(__APPLE__)
 std::vector<Device> getDeviceList() {
     std::vector<Device> list;
 
@@ -58,7 +73,7 @@ std::vector<Device> getDeviceList() {
 
 	for(; ifap; ifap = ifap->ifa_next) {
 		auto *p = ifap->ifa_addr;
-		if (p->sa_family == AF_LINK) {
+		if (p && p->sa_family == AF_LINK) {
 			struct sockaddr_dl *sdl = (struct sockaddr_dl *) ifap->ifa_addr;
 			if (sdl->sdl_alen != 0) {
 				uint8_t* data = (uint8_t*)sdl->sdl_data;
@@ -85,7 +100,61 @@ std::vector<Device> getDeviceList() {
 
     return list;
 }
+#endif
+#if defined(__linux__)
+std::vector<Device> getDeviceList() {
+    std::vector<Device> list;
+
+	struct ifaddrs *ifap;
+	int ret;
+
+	CHECK_SYSCALL(ret, ::getifaddrs(&ifap))
+
+	for(auto p = ifap; p; p = p->ifa_next) {
+		if (p->ifa_addr && p->ifa_addr->sa_family == AF_PACKET) {
+			struct sockaddr_ll *sll = (struct sockaddr_ll *) p->ifa_addr;
+			if (sll->sll_halen != 0) {
+				// copy address
+                uint64_t address = 0;
+                for(int i = 0; i < sll->sll_halen; i++) {
+                    address <<= 8;
+                    address |= sll->sll_addr[i];
+                }
+                Device device(p->ifa_name, address);
+
+				list.push_back(device);
+			}
+		}
+	}
+	::freeifaddrs(ifap);
+
+    return list;
+}
+#endif
+int Driver::transmitBatchCopy(const std::vector<data_type>& dataList, copy_type copy) {
+    // reuse buffer of calling thread
+    thread_local std::vector<std::array<uint8_t, PACKET_SIZE>> bufferList;
+    thread_local std::vector<data_type>                        copyList;
+
+    if (bufferList.size() < dataList.size()) bufferList.resize(dataList.size());
+    copyList.clear();
+    for(size_t i = 0; i < dataList.size(); i++) {
+        const auto& data = dataList[i];
+        if (PACKET_SIZE < data.size()) {
+            logger.error("Unexpected size  %lu", data.size());
+            break;
+        }
+        copy(data.data(), bufferList[i].data(), data.size());
+        copyList.emplace_back(bufferList[i].data(), data.size());
+    }
+    return transmitBatch(copyList);
+}
+
 Device  getDevice(const std::string& name) {
+    if (VirtualSwitch::isVirtual(name)) {
+        auto config = VirtualSwitch::parse(name);
+        return Device(name, config.address);
+    }
     auto list = getDeviceList();
     for(auto e: list) {
         if (e.name == name) return e;
@@ -95,6 +164,43 @@ Device  getDevice(const std::string& name) {
 }
 
 
+class Driver_VirtualSwitch : public Driver {
+public:
+    Driver_VirtualSwitch(Device device) : Driver(device) {}
+
+    void open() {
+        auto config = VirtualSwitch::parse(device.name);
+        // use address of device. parse generates new address if name has no address
+        config.address = device.address;
+        port.open(config);
+    }
+
+    void close() {
+        port.close();
+    }
+
+    int  select  (std::chrono::microseconds timeout) {
+        return port.select(timeout);
+    }
+    void clear() {
+        port.clear();
+    }
+
+    int  transmit(const data_type& data) {
+        return port.transmit(data);
+    }
+    int  transmitBatch(const std::vector<data_type>& dataList) {
+        return port.transmitBatch(dataList);
+    }
+    int  receive (data_type& data, std::chrono::microseconds timeout, std::chrono::microseconds* timestamp) {
+        return port.receive(data, timeout, timestamp);
+    }
+
+    VirtualSwitch port;
+};
+
+
+#if defined(__APPLE__)
 class Driver_BPF : public Driver {
 public:
     Driver_BPF(Device device) : Driver(device) {}
@@ -149,8 +255,56 @@ public:
 };
 
 Driver* getDriver(const Device& device) {
+    if (VirtualSwitch::isVirtual(device.name)) return new Driver_VirtualSwitch(device);
     return new Driver_BPF(device);
 }
+#endif
+
+
+#if defined(__linux__)
+class Driver_PacketRing : public Driver {
+public:
+    Driver_PacketRing(Device device) : Driver(device) {}
+
+    void open() {
+        ring.open(device.name);
+    }
+
+    void close() {
+        if (ring.isOpen()) {
+            logger.info("packet drop    = %u", ring.getDropCount());
+            ring.close();
+        }
+    }
+
+    int  select  (std::chrono::microseconds timeout) {
+        return ring.select(timeout);
+    }
+    void clear() {
+        ring.clear();
+    }
+
+    int  transmit(const data_type& data) {
+        return ring.transmit(data);
+    }
+    int  transmitBatch(const std::vector<data_type>& dataList) {
+        return ring.transmitBatch(dataList);
+    }
+    int  transmitBatchCopy(const std::vector<data_type>& dataList, copy_type copy) {
+        return ring.transmitBatchCopy(dataList, copy);
+    }
+    int  receive (data_type& data, std::chrono::microseconds timeout, std::chrono::microseconds* timestamp) {
+        return ring.receive(data, timeout, timestamp);
+    }
+
+    PacketRing ring;
+};
+
+Driver* getDriver(const Device& device) {
+    if (VirtualSwitch::isVirtual(device.name)) return new Driver_VirtualSwitch(device);
+    return new Driver_PacketRing(device);
+}
+#endif
 
 
 std::string toOctalString(uint64_t address) {
@@ -69,6 +69,20 @@ using microseconds = std::chrono::microseconds;
 
     virtual int  select  (microseconds timeout) = 0;
 	virtual int  transmit(const data_type& data) = 0;
+    // transmit all data with one system call if possible. returns number of data transmitted
+    virtual int  transmitBatch(const std::vector<data_type>& dataList) {
+        int count = 0;
+        for(const auto& data: dataList) {
+            if (transmit(data) != (int)data.size()) break;
+            count++;
+        }
+        return count;
+    }
+    // copies size bytes from source to dest
+    using copy_type = void (*)(const uint8_t* source, uint8_t* dest, uint32_t size);
+    // same as transmitBatch but data is copied into driver buffer by copy.
+    // driver with buffer shared with kernel copies data directly into the buffer
+    virtual int  transmitBatchCopy(const std::vector<data_type>& dataList, copy_type copy);
     virtual int  receive(data_type& data, microseconds timeout, microseconds* timestamp = 0) = 0;
     virtual void clear() = 0;
 
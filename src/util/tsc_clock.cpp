@@ -0,0 +1,137 @@
+/*******************************************************************************
+ * Copyright (c) 2025, Yasuhiro Hasegawa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+//
+// tsc_clock.cpp
+//
+
+#include <thread>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+#include "Util.h"
+static const Logger logger(__FILE__);
+
+#include "tsc_clock.h"
+
+namespace tsc_clock {
+
+std::atomic<bool> enable = false;
+uint64_t baseCount  = 0;
+int64_t  baseTime   = 0;
+uint64_t multiplier = 0;
+
+static uint64_t frequency = 0; // counts per second
+
+static int64_t steadyNano() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now().time_since_epoch()).count();
+}
+
+// read counter and steady_clock as close as possible
+static void readPair(uint64_t& count, int64_t& nano) {
+    // first sample always assigns count and nano
+    int64_t  t0 = steadyNano();
+    count       = readCounter();
+    int64_t  t1 = steadyNano();
+    nano        = t0 + (t1 - t0) / 2;
+    int64_t minWindow = t1 - t0;
+    for(int i = 1; i < 5; i++) {
+        t0 = steadyNano();
+        uint64_t c = readCounter();
+        t1 = steadyNano();
+        if (t1 - t0 < minWindow) {
+            minWindow = t1 - t0;
+            count     = c;
+            nano      = t0 + (t1 - t0) / 2;
+        }
+    }
+}
+
+#if defined(__x86_64__)
+static bool hasInvariantTSC() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx)) return false;
+    if (eax < 0x80000007) return false;
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    return (edx & (1U << 8)) != 0;
+}
+#endif
+
+void calibrate() {
+    if (enable) return;
+
+#if defined(__x86_64__)
+    if (!hasInvariantTSC()) {
+        logger.warn("tsc_clock  no invariant TSC. use steady_clock");
+        return;
+    }
+    uint64_t count0 = 0, count1 = 0;
+    int64_t  nano0  = 0, nano1  = 0;
+    readPair(count0, nano0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    readPair(count1, nano1);
+    if (count1 <= count0 || nano1 <= nano0) {
+        logger.warn("tsc_clock  unexpected TSC value. use steady_clock");
+        return;
+    }
+    frequency  = (uint64_t)((unsigned __int128)(count1 - count0) * 1'000'000'000 / (nano1 - nano0));
+    multiplier = (uint64_t)(((unsigned __int128)(nano1 - nano0) << 32) / (count1 - count0));
+    baseCount  = count1;
+    baseTime   = nano1;
+#elif defined(__aarch64__)
+    asm volatile("mrs %0, cntfrq_el0" : "=r"(frequency));
+    if (frequency == 0) {
+        logger.warn("tsc_clock  unexpected counter frequency. use steady_clock");
+        return;
+    }
+    multiplier = (uint64_t)(((unsigned __int128)1'000'000'000 << 32) / frequency);
+    readPair(baseCount, baseTime);
+#else
+    logger.warn("tsc_clock  unsupported cpu. use steady_clock");
+    return;
+#endif
+
+    enable.store(true, std::memory_order_release);
+    logger.info("tsc_clock  %s", info());
+}
+
+std::string info() {
+    if (!enable) return "steady_clock";
+#if defined(__x86_64__)
+    const char* source = "TSC";
+#else
+    const char* source = "CNTVCT";
+#endif
+    return std_sprintf("%s  %s Hz", source, formatWithCommas(frequency));
+}
+
+}
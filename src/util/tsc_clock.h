@@ -0,0 +1,87 @@
+/*******************************************************************************
+ * Copyright (c) 2025, Yasuhiro Hasegawa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+//
+// tsc_clock.h
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+// tsc_clock is drop-in replacement of std::chrono::steady_clock::now() for hot path.
+// It reads cpu counter (TSC on x86_64, CNTVCT_EL0 on aarch64) and converts it to steady_clock time.
+// Before calibrate() or on unsupported cpu, it falls back to steady_clock.
+
+namespace tsc_clock {
+
+using clock      = std::chrono::steady_clock;
+using time_point = clock::time_point;
+
+// set by calibrate(). baseCount, baseTime and multiplier are written before enable
+extern std::atomic<bool> enable;
+extern uint64_t baseCount;  // counter value at calibration
+extern int64_t  baseTime;   // steady_clock time in nanoseconds at baseCount
+extern uint64_t multiplier; // nanoseconds per count in 32.32 fixed point
+
+// calibrate counter against steady_clock. call once before starting threads
+void calibrate();
+// return description of clock source for log
+std::string info();
+
+inline uint64_t readCounter() {
+#if defined(__x86_64__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t value;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+#else
+    return 0;
+#endif
+}
+
+inline time_point now() {
+    if (!enable.load(std::memory_order_acquire)) return clock::now();
+    // counter of other core can be slightly behind baseCount
+    int64_t delta = (int64_t)(readCounter() - baseCount);
+    if (delta < 0) delta = 0;
+    int64_t nano  = baseTime + (int64_t)(((unsigned __int128)delta * multiplier) >> 32);
+    return time_point(std::chrono::duration_cast<clock::duration>(std::chrono::nanoseconds(nano)));
+}
+
+}
@@ -97,6 +97,9 @@ void start() {
         logger.info("scanThread started");
     }
 }
+void afterFork() {
+    scanThreadRunning = false;
+}
 void enable() {
     std::unique_lock<std::mutex> lock(mutex);
     enableScan = true;
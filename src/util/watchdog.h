@@ -42,6 +42,8 @@ namespace watchdog {
 void start();
 void enable();
 void disable();
+// call in child process after fork. scan thread of parent doesn't exist in child
+void afterFork();
 
 struct Watchdog;
 void insert(Watchdog* watchdog);
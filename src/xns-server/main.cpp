@@ -0,0 +1,160 @@
+/*******************************************************************************
+ * Copyright (c) 2025, Yasuhiro Hasegawa
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *******************************************************************************/
+
+
+//
+// main.cpp
+//
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <string>
+#include <vector>
+
+#include "../util/Util.h"
+static const Logger logger(__FILE__);
+
+#include "../util/net.h"
+#include "../util/XNSServer.h"
+
+// xns-server serve INTERFACE [--interval MICROSECONDS] [BFN PATH]...  answer echo and boot request. BFN is boot file number
+// xns-server echo  INTERFACE HOST [COUNT]   measure round trip time of echo to HOST
+//
+// --interval is wait between burst of boot file packets. default is 1000. 0 sends burst back to back
+// INTERFACE can be host interface or virtual switch like vswitch:lab
+
+static void usage() {
+	logger.info("usage");
+	logger.info("  xns-server serve INTERFACE [--interval MICROSECONDS] [BFN PATH]...");
+	logger.info("  xns-server echo  INTERFACE HOST [COUNT]");
+}
+
+static xns::Server* server = 0;
+static void signalHandler(int) {
+	if (server) server->stop();
+}
+
+static int serve(net::Driver* driver, int argc, char** argv) {
+	xns::Server myServer(driver);
+	if (2 <= argc && std::string(argv[0]) == "--interval") {
+		myServer.setInterval(std::chrono::microseconds(std::stoi(argv[1])));
+		argc -= 2;
+		argv += 2;
+	}
+	for(int i = 0; i + 1 < argc; i += 2) {
+		myServer.addBootFile(net::fromString(argv[i]), argv[i + 1]);
+	}
+	server = &myServer;
+	std::signal(SIGINT, signalHandler);
+	std::signal(SIGTERM, signalHandler);
+	myServer.run();
+	server = 0;
+	return 0;
+}
+
+static int echo(net::Driver* driver, uint64_t host, int count) {
+	const uint16_t SOCKET = 0x1234;
+	const auto     timeout = std::chrono::milliseconds(1000);
+
+	std::vector<int64_t> timeList;
+	int lost = 0;
+	for(int i = 0; i < count; i++) {
+		xns::Packet request;
+		request.etherDestination   = host;
+		request.etherSource        = driver->device.address;
+		request.packetType         = xns::PT_ECHO;
+		request.destination        = {0, host, xns::SOCKET_ECHO};
+		request.source             = {0, driver->device.address, SOCKET};
+		// operation and sequence number followed by padding
+		request.data.assign(64, 0);
+		request.data[1] = xns::ECHO_REQUEST;
+		request.data[2] = (uint8_t)(i >> 8);
+		request.data[3] = (uint8_t)i;
+
+		std::vector<uint8_t> frame;
+		request.build(frame);
+		std::span<uint8_t> span{frame};
+
+		auto start = std::chrono::steady_clock::now();
+		driver->transmit(span);
+		bool received = false;
+		for(;;) {
+			auto now = std::chrono::steady_clock::now();
+			if (start + timeout <= now) break;
+			std::span<uint8_t> data;
+			if (driver->receive(data, std::chrono::duration_cast<std::chrono::microseconds>(start + timeout - now)) == 0) continue;
+			xns::Packet reply;
+			if (!reply.parse(data)) continue;
+			if (reply.packetType != xns::PT_ECHO || reply.source.host != host || reply.destination.socket != SOCKET) continue;
+			if (reply.data.size() < 4 || reply.data[1] != xns::ECHO_REPLY || reply.data[2] != request.data[2] || reply.data[3] != request.data[3]) continue;
+			timeList.push_back(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+			received = true;
+			break;
+		}
+		if (!received) lost++;
+	}
+
+	logger.info("echo  %s  count %d  lost %d", net::toHexaDecimalString(host), count, lost);
+	if (!timeList.empty()) {
+		std::sort(timeList.begin(), timeList.end());
+		auto percentile = [&](int p) {
+			return timeList[(timeList.size() - 1) * p / 100];
+		};
+		logger.info("round trip  p50 %ld us  p95 %ld us  max %ld us", percentile(50), percentile(95), timeList.back());
+	}
+	return lost == count ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		usage();
+		return 1;
+	}
+	std::string command = argv[1];
+	auto device = net::getDevice(argv[2]);
+	auto driver = net::getDriver(device);
+
+	int ret = 1;
+	if (command == "serve" && argc % 2 == 1) {
+		// option and BFN PATH are both pair of argument
+		driver->open();
+		ret = serve(driver, argc - 3, argv + 3);
+		driver->close();
+	} else if (command == "echo" && (argc == 4 || argc == 5)) {
+		driver->open();
+		ret = echo(driver, net::fromString(argv[3]), argc == 5 ? std::stoi(argv[4]) : 10);
+		driver->close();
+	} else {
+		usage();
+	}
+	delete driver;
+	return ret;
+}